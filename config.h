@@ -7,7 +7,12 @@
 #ifndef CONFIG_H
 #define CONFIG_H
 
+// FUSE 3 build is selected by 'make FUSE3=1'
+#ifdef VMASFS_FUSE3
+#define FUSE_USE_VERSION 30
+#else
 #define FUSE_USE_VERSION 27
+#endif
 #define PROGRAM "vmas-fs"
 #define VERSION "0.4.1"
 
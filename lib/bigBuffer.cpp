@@ -12,8 +12,14 @@
 #include <syslog.h>
 
 #include "bigBuffer.h"
+#include "probes.h"
+#include "saveProfile.h"
+#include "statistics.h"
 
 const char *BigBuffer::passwd = NULL;
+const zip_uint16_t BigBuffer::ENCRYPTION_METHOD;
+zip_uint64_t BigBuffer::maxMemory = 0;
+SaveProfile *BigBuffer::saveProfile = NULL;
 
 
 /**
@@ -26,6 +32,26 @@ private:
      */
     char *m_ptr;
 
+    /**
+     * Allocate internal buffer accounting it in buffer memory.
+     * @throws
+     *      std::bad_alloc  If memory can not be allocated or maxMemory is
+     *                      reached
+     */
+    void allocate() {
+        int64_t total = Statistics::global.bufferAllocated(chunkSize);
+        if (maxMemory != 0 && total > (int64_t)maxMemory) {
+            Statistics::global.bufferAllocated(-(int64_t)chunkSize);
+            throw std::bad_alloc();
+        }
+        m_ptr = (char *)malloc(chunkSize);
+        if (m_ptr == NULL) {
+            Statistics::global.bufferAllocated(-(int64_t)chunkSize);
+            throw std::bad_alloc();
+        }
+        VMASFS_PROBE2(chunk__alloc, (unsigned int)chunkSize, total);
+    }
+
 public:
     /**
      * By default internal buffer is NULL, so this can be used for creating
@@ -48,6 +74,7 @@ public:
     ~ChunkWrapper() {
         if (m_ptr != NULL) {
             free(m_ptr);
+            Statistics::global.bufferAllocated(-(int64_t)chunkSize);
         }
     }
 
@@ -65,14 +92,12 @@ public:
     /**
      * Return pointer to internal storage and initialize it if needed.
      * @throws
-     *      std::bad_alloc  If memory can not be allocated
+     *      std::bad_alloc  If memory can not be allocated or maxMemory is
+     *                      reached
      */
     char *ptr(bool init = false) {
         if (init && m_ptr == NULL) {
-            m_ptr = (char *)malloc(chunkSize);
-            if (m_ptr == NULL) {
-                throw std::bad_alloc();
-            }
+            allocate();
         }
         return m_ptr;
     }
@@ -119,10 +144,7 @@ public:
             count = chunkSize - offset;
         }
         if (m_ptr == NULL) {
-            m_ptr = (char *)malloc(chunkSize);
-            if (m_ptr == NULL) {
-                throw std::bad_alloc();
-            }
+            allocate();
             if (offset > 0) {
                 memset(m_ptr, 0, offset);
             }
@@ -145,10 +167,11 @@ public:
 BigBuffer::BigBuffer(): len(0) {
 }
 
-BigBuffer::BigBuffer(struct zip *z, zip_uint64_t nodeId, zip_uint64_t length):
-        len(length) {
-    int zep = 0;
-    struct zip_file *zf = open(z, nodeId, &zep);
+BigBuffer::BigBuffer(struct zip *z, zip_uint64_t nodeId, zip_uint64_t length,
+        bool encrypted): len(length) {
+    VMASFS_PROBE2(buffer__load__start, nodeId, length);
+    uint64_t started = Statistics::now();
+    struct zip_file *zf = open(z, nodeId, encrypted);
     if (zf == NULL) {
         syslog(LOG_WARNING, "%s", zip_strerror(z));
         throw std::runtime_error(zip_strerror(z));
@@ -185,29 +208,33 @@ BigBuffer::BigBuffer(struct zip *z, zip_uint64_t nodeId, zip_uint64_t length):
         syslog(LOG_WARNING, "%s", zip_strerror(z));
         throw std::runtime_error(zip_strerror(z));
     }
+    uint64_t elapsed = Statistics::now() - started;
+    Statistics::global.inflated(len, elapsed);
+    TraceLog::global.complete("zip", "inflate", started, elapsed, len);
+    VMASFS_PROBE2(buffer__load__done, nodeId, len);
 }
 
 BigBuffer::~BigBuffer() {
 }
 
-struct zip_file *BigBuffer::open(struct zip *z, zip_uint64_t nodeId, int *zep) {
-    struct zip_file *zf;
-
-    if (passwd != NULL) {
-        zf = zip_fopen_index_encrypted(z, nodeId, 0, passwd);
+bool BigBuffer::fits(zip_uint64_t size) {
+    if (maxMemory == 0) {
+        return true;
     }
-    else {
-        zf = zip_fopen_index(z, nodeId, 0);
-        if (zf == NULL) {
-            int sep;
-            zip_error_get(z, zep, &sep);
-            if (ZIP_ER_NOPASSWD == *zep) {
-                zf = zip_fopen_index_encrypted(z, nodeId, 0, passwd);
-            }
-        }
+    zip_uint64_t need = (zip_uint64_t)chunksCount(size) * chunkSize;
+    int64_t used = Statistics::global.bufferBytes();
+    if (used < 0) {
+        used = 0;
     }
+    return need <= maxMemory && (zip_uint64_t)used <= maxMemory - need;
+}
 
-    return zf;
+struct zip_file *BigBuffer::open(struct zip *z, zip_uint64_t nodeId,
+        bool encrypted) {
+    if (encrypted) {
+        return zip_fopen_index_encrypted(z, nodeId, 0, passwd);
+    }
+    return zip_fopen_index(z, nodeId, 0);
 }
 
 int BigBuffer::read(char *buf, size_t size, zip_uint64_t offset) const {
@@ -235,6 +262,7 @@ int BigBuffer::write(const char *buf, size_t size, zip_uint64_t offset) {
     int chunk = chunkNumber(offset);
     int pos = chunkOffset(offset);
     int nwritten = size;
+    zip_uint64_t oldLen = len;
 
     if (offset > len) {
         if (len > 0) {
@@ -244,14 +272,22 @@ int BigBuffer::write(const char *buf, size_t size, zip_uint64_t offset) {
     } else if (size > unsigned(len - offset)) {
         len = size + offset;
     }
-    chunks.resize(chunksCount(len));
-    while (size > 0) {
-        size_t w = chunks[chunk].write(buf, pos, size);
+    try {
+        chunks.resize(chunksCount(len));
+        while (size > 0) {
+            size_t w = chunks[chunk].write(buf, pos, size);
 
-        size -= w;
-        buf += w;
-        ++ chunk;
-        pos = 0;
+            size -= w;
+            buf += w;
+            ++ chunk;
+            pos = 0;
+        }
+    }
+    catch (...) {
+        // chunks allocated after old end of file are freed
+        len = oldLen;
+        chunks.resize(chunksCount(len));
+        throw;
     }
     return nwritten;
 }
@@ -273,10 +309,12 @@ zip_int64_t BigBuffer::zipUserFunctionCallback(void *state, void *data,
     switch (cmd) {
         case ZIP_SOURCE_OPEN: {
             b->pos = 0;
+            b->started = Statistics::now();
             return 0;
         }
         case ZIP_SOURCE_READ: {
             int r = b->buf->read((char*)data, len, b->pos);
+            VMASFS_PROBE3(save__read, b->buf, b->pos, r);
             b->pos += r;
             return r;
         }
@@ -288,6 +326,17 @@ zip_int64_t BigBuffer::zipUserFunctionCallback(void *state, void *data,
             st->mtime = b->mtime;
             return sizeof(struct zip_stat);
         }
+        case ZIP_SOURCE_CLOSE: {
+            // data is compressed and written while it is read
+            uint64_t elapsed = Statistics::now() - b->started;
+            Statistics::global.deflated(b->pos, elapsed);
+            TraceLog::global.complete("save", "compress", b->started, elapsed,
+                    b->pos);
+            if (saveProfile != NULL) {
+                saveProfile->entrySaved(b->name, b->pos, elapsed);
+            }
+            return 0;
+        }
         case ZIP_SOURCE_FREE: {
             delete b;
             return 0;
@@ -300,10 +349,18 @@ zip_int64_t BigBuffer::zipUserFunctionCallback(void *state, void *data,
 
 int BigBuffer::saveToZip(time_t mtime, struct zip *z, const char *fname,
         bool newFile, zip_int64_t &index) {
+    // encryption of replaced entry is set before its data is touched, so
+    // entry is not saved unencrypted if encryption is not supported
+    if (!newFile && passwd != NULL &&
+            zip_file_set_encryption(z, index, ENCRYPTION_METHOD, passwd) != 0) {
+        syslog(LOG_ERR, "unable to encrypt %s: %s", fname, zip_strerror(z));
+        return -EIO;
+    }
     struct zip_source *s;
     struct CallBackStruct *cbs = new CallBackStruct();
     cbs->buf = this;
     cbs->mtime = mtime;
+    cbs->name = fname;
     if ((s=zip_source_function(z, zipUserFunctionCallback, cbs)) == NULL) {
         delete cbs;
         return -ENOMEM;
@@ -316,6 +373,12 @@ int BigBuffer::saveToZip(time_t mtime, struct zip *z, const char *fname,
         return -ENOMEM;
     }
     if (newFile) {
+        if (passwd != NULL &&
+                zip_file_set_encryption(z, nid, ENCRYPTION_METHOD, passwd) != 0) {
+            syslog(LOG_ERR, "unable to encrypt %s: %s", fname, zip_strerror(z));
+            zip_delete(z, nid);
+            return -EIO;
+        }
         index = nid;
     }
     return 0;
@@ -10,10 +10,13 @@
 #include <zip.h>
 #include <unistd.h>
 
+#include <string>
 #include <vector>
 
 #include "types.h"
 
+class SaveProfile;
+
 class BigBuffer {
 private:
     //TODO: use >> and <<
@@ -27,14 +30,19 @@ private:
         size_t pos;
         const BigBuffer *buf;
         time_t mtime;
+        // when libzip started reading data (for statistics)
+        uint64_t started;
+        // entry name (for save profile)
+        std::string name;
     };
 
     chunks_t chunks;
 
     /**
      * Callback for zip_source_function.
-     * ZIP_SOURCE_CLOSE is not needed to be handled, ZIP_SOURCE_ERROR is
-     * never called because read() always successfull.
+     * ZIP_SOURCE_CLOSE only accounts written data in statistics and save
+     * profile,
+     * ZIP_SOURCE_ERROR is never called because read() always successfull.
      * See zip_source_function(3) for details.
      */
     static zip_int64_t zipUserFunctionCallback(void *state, void *data,
@@ -65,6 +73,12 @@ public:
     zip_uint64_t len;
     /* store password here, Can be NULL */
     static const char *passwd;
+    // method used to encrypt saved entries if password is given
+    static const zip_uint16_t ENCRYPTION_METHOD = ZIP_EM_AES_256;
+    // limit of memory held by all buffers (in bytes), 0 if not limited
+    static zip_uint64_t maxMemory;
+    // entries written when archive is closed are recorded here if not NULL
+    static SaveProfile *saveProfile;
 
     /**
      * Create new file buffer without mapping to file in a zip archive
@@ -77,18 +91,28 @@ public:
      * @param z         Zip file
      * @param nodeId    Node index inside zip file
      * @param length    File length
+     * @param encrypted Entry data is encrypted
      * @throws 
      *      std::exception  On file read error
      *      std::bad_alloc  On memory insufficiency
      */
-    BigBuffer(struct zip *z, zip_uint64_t nodeId, zip_uint64_t length);
+    BigBuffer(struct zip *z, zip_uint64_t nodeId, zip_uint64_t length,
+            bool encrypted = false);
 
     ~BigBuffer();
 
     /**
-     * open a file inside zip archive
+     * Check if buffer of 'size' bytes can be allocated without exceeding
+     * maxMemory
+     */
+    static bool fits(zip_uint64_t size);
+
+    /**
+     * open a file inside zip archive, encrypted file is opened with
+     * password given by user
      */
-    static struct zip_file *open(struct zip *z, zip_uint64_t nodeId, int *zep);
+    static struct zip_file *open(struct zip *z, zip_uint64_t nodeId,
+            bool encrypted);
 
     /**
      * Dispatch read requests to chunks of a file and write result to
@@ -107,19 +131,22 @@ public:
      * Dispatch write request to chunks of a file and grow 'chunks' vector if
      * necessary.
      * If 'offset' is after file end, tail of last chunk cleared before growing.
+     * If memory can not be allocated, file length is not changed.
      *
      * @param buf       Source buffer
      * @param size      Number of bytes to be written
      * @param offset    Offset in file to start writing from
      * @return number of bytes written
      * @throws
-     *      std::bad_alloc  If there are no memory for buffer
+     *      std::bad_alloc  If there are no memory for buffer or maxMemory
+     *                      is reached
      */
     int write(const char *buf, size_t size, zip_uint64_t offset);
 
     /**
      * Create (or replace) file element in zip file. Class instance should
-     * not be destroyed until zip_close() is called.
+     * not be destroyed until zip_close() is called. If password is given,
+     * entry is encrypted with AES-256 (by libzip when archive is closed).
      *
      * @param mtime     File modification time
      * @param z         ZIP archive structure
@@ -130,6 +157,7 @@ public:
      * @return
      *      0       If successfull
      *      -ENOMEM If there are no memory
+     *      -EIO    If entry can not be encrypted
      */
     int saveToZip(time_t mtime, struct zip *z, const char *fname,
             bool newFile, zip_int64_t &index);
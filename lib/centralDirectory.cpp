@@ -0,0 +1,270 @@
+////////////////////////////////////////////////////////////////////////////
+//  Copyright (C) 2021 by V+ Publicidad SpA                               //
+//  http://www.vmaspublicidad.com                                         //
+//                                                                        //
+////////////////////////////////////////////////////////////////////////////
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <cstring>
+
+#include "centralDirectory.h"
+
+// ZIP structure signatures and sizes (see APPNOTE.TXT)
+#define LOCAL_HEADER_SIG        (0x04034b50)
+#define LOCAL_HEADER_LEN        (30)
+#define CD_FILE_HEADER_SIG      (0x02014b50)
+#define CD_FILE_HEADER_LEN      (46)
+#define EOCD_SIG                (0x06054b50)
+#define EOCD_LEN                (22)
+#define EOCD64_LOCATOR_SIG      (0x07064b50)
+#define EOCD64_LOCATOR_LEN      (20)
+#define EOCD64_SIG              (0x06064b50)
+#define EOCD64_LEN              (56)
+#define MAX_COMMENT_LEN         (0xFFFF)
+#define EF_ZIP64                (0x0001)
+
+static inline zip_uint16_t getShort(const zip_uint8_t *data) {
+    return data[0] | (data[1] << 8);
+}
+
+static inline zip_uint32_t getLong(const zip_uint8_t *data) {
+    return (zip_uint32_t)data[0] | ((zip_uint32_t)data[1] << 8) |
+        ((zip_uint32_t)data[2] << 16) | ((zip_uint32_t)data[3] << 24);
+}
+
+static inline zip_uint64_t getLongLong(const zip_uint8_t *data) {
+    return (zip_uint64_t)getLong(data) | ((zip_uint64_t)getLong(data + 4) << 32);
+}
+
+const size_t CentralDirectory::LOCAL_HEADER_SIZE;
+
+CentralDirectory::CentralDirectory(): m_data(NULL), m_size(0), m_mtime(0),
+        m_cdOffset(0), m_cdSize(0), m_count(0), m_lastDosTime(0),
+        m_lastTime(0) {
+}
+
+CentralDirectory::~CentralDirectory() {
+    if (m_data != NULL) {
+        munmap((void*)m_data, m_size);
+    }
+}
+
+bool CentralDirectory::open(const char *fileName) {
+    int fd = ::open(fileName, O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size < EOCD_LEN) {
+        ::close(fd);
+        return false;
+    }
+    void *p = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (p == MAP_FAILED) {
+        return false;
+    }
+    m_data = (const zip_uint8_t *)p;
+    m_size = st.st_size;
+    m_mtime = st.st_mtime;
+    return locate();
+}
+
+bool CentralDirectory::locate() {
+    // EOCD is located at the end of file and followed only by comment
+    size_t start = 0;
+    if (m_size > EOCD_LEN + MAX_COMMENT_LEN) {
+        start = m_size - EOCD_LEN - MAX_COMMENT_LEN;
+    }
+    const zip_uint8_t *eocd = NULL;
+    for (size_t pos = m_size - EOCD_LEN + 1; pos-- > start; ) {
+        const zip_uint8_t *p = m_data + pos;
+        if (getLong(p) == EOCD_SIG &&
+                pos + EOCD_LEN + getShort(p + 20) == m_size) {
+            eocd = p;
+            break;
+        }
+    }
+    if (eocd == NULL) {
+        return false;
+    }
+    m_count = getShort(eocd + 10);
+    m_cdSize = getLong(eocd + 12);
+    m_cdOffset = getLong(eocd + 16);
+
+    if (eocd - m_data >= EOCD64_LOCATOR_LEN &&
+            getLong(eocd - EOCD64_LOCATOR_LEN) == EOCD64_LOCATOR_SIG) {
+        zip_uint64_t offset = getLongLong(eocd - EOCD64_LOCATOR_LEN + 8);
+        // offset is not trusted, so check it without overflow
+        if (m_size < EOCD64_LEN || offset > m_size - EOCD64_LEN) {
+            return false;
+        }
+        const zip_uint8_t *eocd64 = m_data + offset;
+        if (getLong(eocd64) != EOCD64_SIG) {
+            return false;
+        }
+        m_count = getLongLong(eocd64 + 32);
+        m_cdSize = getLongLong(eocd64 + 40);
+        m_cdOffset = getLongLong(eocd64 + 48);
+    }
+    return m_cdOffset <= m_size && m_cdSize <= m_size - m_cdOffset;
+}
+
+zip_uint64_t CentralDirectory::hash() const {
+    // FNV-1a over 64-bit words, tail is processed byte-by-byte
+    const zip_uint64_t FNV_PRIME = 0x100000001b3ULL;
+    zip_uint64_t h = 0xcbf29ce484222325ULL;
+    const zip_uint8_t *p = m_data + m_cdOffset;
+    const zip_uint8_t *end = p + m_cdSize;
+    for (; p + 8 <= end; p += 8) {
+        h ^= getLongLong(p);
+        h *= FNV_PRIME;
+    }
+    for (; p < end; ++p) {
+        h ^= *p;
+        h *= FNV_PRIME;
+    }
+    return h;
+}
+
+bool CentralDirectory::localHeaderOffsets(std::vector<zip_uint64_t> &offsets) const {
+    offsets.clear();
+    offsets.reserve(m_count);
+    zip_uint64_t pos = 0;
+    Entry entry;
+    while (!atEnd(pos)) {
+        if (!readEntry(pos, entry)) {
+            return false;
+        }
+        offsets.push_back(entry.offset);
+    }
+    return offsets.size() == m_count;
+}
+
+bool CentralDirectory::readEntry(zip_uint64_t &pos, Entry &entry) const {
+    if (m_cdSize - pos < CD_FILE_HEADER_LEN) {
+        return false;
+    }
+    const zip_uint8_t *p = m_data + m_cdOffset + pos;
+    if (getLong(p) != CD_FILE_HEADER_SIG) {
+        return false;
+    }
+    entry.versionMadeBy = getShort(p + 4);
+    entry.flags = getShort(p + 8);
+    entry.method = getShort(p + 10);
+    entry.mtime = dosTime(getShort(p + 12), getShort(p + 14));
+    entry.crc = getLong(p + 16);
+    entry.compSize = getLong(p + 20);
+    entry.size = getLong(p + 24);
+    entry.nameLength = getShort(p + 28);
+    entry.extraLength = getShort(p + 30);
+    zip_uint16_t commentLen = getShort(p + 32);
+    entry.externalAttributes = getLong(p + 38);
+    entry.offset = getLong(p + 42);
+
+    zip_uint64_t len = CD_FILE_HEADER_LEN + entry.nameLength +
+        entry.extraLength + commentLen;
+    if (m_cdSize - pos < len) {
+        return false;
+    }
+    entry.name = (const char *)p + CD_FILE_HEADER_LEN;
+    entry.extra = p + CD_FILE_HEADER_LEN + entry.nameLength;
+    pos += len;
+
+    // overflowed values are stored in ZIP64 extra field in fixed order
+    const zip_uint8_t *ef = entry.extra, *end = entry.extra + entry.extraLength;
+    zip_uint16_t type, flen;
+    const zip_uint8_t *field;
+    while (nextExtraField(ef, end, type, flen, field)) {
+        if (type != EF_ZIP64) {
+            continue;
+        }
+        const zip_uint8_t *fend = field + flen;
+        if (entry.size == 0xFFFFFFFF) {
+            if (field + 8 > fend) {
+                return false;
+            }
+            entry.size = getLongLong(field);
+            field += 8;
+        }
+        if (entry.compSize == 0xFFFFFFFF) {
+            if (field + 8 > fend) {
+                return false;
+            }
+            entry.compSize = getLongLong(field);
+            field += 8;
+        }
+        if (entry.offset == 0xFFFFFFFF) {
+            if (field + 8 > fend) {
+                return false;
+            }
+            entry.offset = getLongLong(field);
+        }
+        break;
+    }
+
+    entry.localExtra = NULL;
+    entry.localExtraLength = 0;
+    if (entry.offset <= m_size && m_size - entry.offset >= LOCAL_HEADER_LEN) {
+        const zip_uint8_t *lh = m_data + entry.offset;
+        zip_uint64_t extraOffset = entry.offset + LOCAL_HEADER_LEN +
+            getShort(lh + 26);
+        zip_uint16_t extraLen = getShort(lh + 28);
+        if (getLong(lh) == LOCAL_HEADER_SIG && extraOffset <= m_size &&
+                m_size - extraOffset >= extraLen) {
+            entry.localExtra = m_data + extraOffset;
+            entry.localExtraLength = extraLen;
+        }
+    }
+    return true;
+}
+
+bool CentralDirectory::localDataOffset(const zip_uint8_t *header,
+        zip_uint64_t headerOffset, zip_uint64_t &dataOffset) {
+    if (getLong(header) != LOCAL_HEADER_SIG) {
+        return false;
+    }
+    dataOffset = headerOffset + LOCAL_HEADER_LEN + getShort(header + 26) +
+        getShort(header + 28);
+    return true;
+}
+
+bool CentralDirectory::nextExtraField(const zip_uint8_t *&data,
+        const zip_uint8_t *end, zip_uint16_t &type, zip_uint16_t &len,
+        const zip_uint8_t *&field) {
+    if (data == NULL || end - data < 4) {
+        return false;
+    }
+    type = getShort(data);
+    len = getShort(data + 2);
+    if (end - data - 4 < len) {
+        return false;
+    }
+    field = data + 4;
+    data += 4 + len;
+    return true;
+}
+
+time_t CentralDirectory::dosTime(zip_uint16_t dtime, zip_uint16_t ddate) const {
+    // neighbour entries often have the same time, and mktime() is slow
+    zip_uint32_t key = ((zip_uint32_t)ddate << 16) | dtime;
+    if (key == m_lastDosTime && key != 0) {
+        return m_lastTime;
+    }
+    struct tm tm;
+    memset(&tm, 0, sizeof(tm));
+    tm.tm_isdst = -1;
+    tm.tm_year = ((ddate >> 9) & 127) + 1980 - 1900;
+    tm.tm_mon = ((ddate >> 5) & 15) - 1;
+    tm.tm_mday = ddate & 31;
+    tm.tm_hour = (dtime >> 11) & 31;
+    tm.tm_min = (dtime >> 5) & 63;
+    tm.tm_sec = (dtime << 1) & 62;
+    m_lastDosTime = key;
+    m_lastTime = mktime(&tm);
+    return m_lastTime;
+}
@@ -0,0 +1,157 @@
+////////////////////////////////////////////////////////////////////////////
+//  Copyright (C) 2021 by V+ Publicidad SpA                               //
+//  http://www.vmaspublicidad.com                                         //
+//                                                                        //
+////////////////////////////////////////////////////////////////////////////
+
+#ifndef CENTRAL_DIRECTORY_H
+#define CENTRAL_DIRECTORY_H
+
+#include <zip.h>
+#include <stddef.h>
+#include <time.h>
+
+#include <vector>
+
+/**
+ * Read-only view of ZIP archive central directory. Archive is mapped into
+ * memory, so only pages with end of central directory record and
+ * central directory itself are actually read.
+ */
+class CentralDirectory {
+public:
+    // size of fixed part of local file header
+    static const size_t LOCAL_HEADER_SIZE = 30;
+
+    /**
+     * Central directory entry. Pointers refer to mapped archive data.
+     */
+    struct Entry {
+        // raw file name, not zero-terminated
+        const char *name;
+        zip_uint16_t nameLength;
+        // creator OS in high byte
+        zip_uint16_t versionMadeBy;
+        // general purpose bit flag
+        zip_uint16_t flags;
+        zip_uint16_t method;
+        // modification time converted from MS-DOS date and time
+        time_t mtime;
+        zip_uint32_t crc;
+        zip_uint64_t compSize, size;
+        // offset of local file header
+        zip_uint64_t offset;
+        zip_uint32_t externalAttributes;
+        // central directory extra fields
+        const zip_uint8_t *extra;
+        zip_uint16_t extraLength;
+        // local header extra fields (NULL if local header is invalid)
+        const zip_uint8_t *localExtra;
+        zip_uint16_t localExtraLength;
+    };
+
+private:
+    // must not be defined
+    CentralDirectory (const CentralDirectory &);
+    CentralDirectory &operator= (const CentralDirectory &);
+
+    const zip_uint8_t *m_data;
+    size_t m_size;
+    time_t m_mtime;
+
+    zip_uint64_t m_cdOffset, m_cdSize, m_count;
+
+    // last converted MS-DOS date and time
+    mutable zip_uint32_t m_lastDosTime;
+    mutable time_t m_lastTime;
+
+    /**
+     * Convert MS-DOS date and time to time_t the same way as libzip does.
+     */
+    time_t dosTime(zip_uint16_t dtime, zip_uint16_t ddate) const;
+
+    /**
+     * Find end of central directory record (and ZIP64 end of central
+     * directory record if present) and fill central directory location.
+     * @return false if archive structure is invalid
+     */
+    bool locate();
+
+public:
+    CentralDirectory();
+    ~CentralDirectory();
+
+    /**
+     * Map archive and locate central directory.
+     * @return false if file can not be mapped or is not a ZIP archive
+     */
+    bool open(const char *fileName);
+
+    inline zip_uint64_t archiveSize() const {
+        return m_size;
+    }
+
+    inline time_t archiveMTime() const {
+        return m_mtime;
+    }
+
+    /**
+     * Number of entries declared in end of central directory record
+     */
+    inline zip_uint64_t count() const {
+        return m_count;
+    }
+
+    /**
+     * 64-bit hash of central directory bytes
+     */
+    zip_uint64_t hash() const;
+
+    /**
+     * Get local file header offsets of all entries in central directory
+     * order (the same order is used for libzip indices).
+     * @return false if central directory is damaged
+     */
+    bool localHeaderOffsets(std::vector<zip_uint64_t> &offsets) const;
+
+    /**
+     * Check that there are no more entries at position 'pos'
+     */
+    inline bool atEnd(zip_uint64_t pos) const {
+        return pos >= m_cdSize;
+    }
+
+    /**
+     * Parse central directory entry at position 'pos' (0 is the first
+     * entry) and move 'pos' to the next entry.
+     * @return false if entry is damaged
+     */
+    bool readEntry(zip_uint64_t &pos, Entry &entry) const;
+
+    /**
+     * Find offset of entry data using fixed part of local file header
+     * (LOCAL_HEADER_SIZE bytes) read from archive
+     * @param header local file header data
+     * @param headerOffset offset of local file header in archive
+     * @param dataOffset (OUT) offset of entry data in archive
+     * @return false if header is damaged
+     */
+    static bool localDataOffset(const zip_uint8_t *header,
+            zip_uint64_t headerOffset, zip_uint64_t &dataOffset);
+
+    /**
+     * Get next extra field from extra fields block and move 'data' to
+     * the next field.
+     * @param data (INOUT) current position in extra fields block
+     * @param end end of extra fields block
+     * @param type (OUT) extra field type ID
+     * @param len (OUT) field data length
+     * @param field (OUT) field data
+     * @return false if there are no more fields or field is damaged
+     */
+    static bool nextExtraField(const zip_uint8_t *&data,
+            const zip_uint8_t *end, zip_uint16_t &type, zip_uint16_t &len,
+            const zip_uint8_t *&field);
+};
+
+#endif
@@ -0,0 +1,34 @@
+////////////////////////////////////////////////////////////////////////////
+//  Copyright (C) 2021 by V+ Publicidad SpA                               //
+//  http://www.vmaspublicidad.com                                         //
+//                                                                        //
+////////////////////////////////////////////////////////////////////////////
+
+#include "dirCursor.h"
+#include "fileNode.h"
+
+const off_t DirCursor::DOTS_END;
+const off_t DirCursor::TAIL_OFFSET;
+
+DirCursor::DirCursor (): m_offset(0) {
+}
+
+filemap_t::const_iterator DirCursor::seek (const FileNode *dir,
+        off_t offset) {
+    if (offset <= DOTS_END) {
+        return dir->childs.begin();
+    }
+    if (offset == m_offset && !m_name.empty()) {
+        return dir->childs.upper_bound(m_name.c_str());
+    }
+    filemap_t::const_iterator i = dir->childs.begin();
+    for (off_t n = DOTS_END; n < offset && i != dir->childs.end(); ++n) {
+        ++i;
+    }
+    return i;
+}
+
+void DirCursor::returned (const char *name, off_t offset) {
+    m_name = name;
+    m_offset = offset;
+}
@@ -0,0 +1,58 @@
+////////////////////////////////////////////////////////////////////////////
+//  Copyright (C) 2021 by V+ Publicidad SpA                               //
+//  http://www.vmaspublicidad.com                                         //
+//                                                                        //
+////////////////////////////////////////////////////////////////////////////
+
+#ifndef DIR_CURSOR_H
+#define DIR_CURSOR_H
+
+#include <sys/types.h>
+
+#include <string>
+
+#include "types.h"
+
+/**
+ * Position in directory listing that is read by parts (kept in file
+ * handle of opened directory).
+ *
+ * Offset of entry is its number in listing: "." and ".." have offsets 1
+ * and 2, children follow in name order. Listing is resumed after the name
+ * of last returned child, so finding the next part costs O(log n) and
+ * children added or removed between parts don't shift the remaining ones.
+ * Only seek to offset other than the last returned one (seekdir) walks
+ * children from the beginning.
+ * Pseudo-directory listed after children has offset TAIL_OFFSET.
+ */
+class DirCursor {
+private:
+    // offset of last returned child
+    off_t m_offset;
+    // name of last returned child, empty if no child was returned
+    std::string m_name;
+
+public:
+    // offset of last entry before children ("..")
+    static const off_t DOTS_END = 2;
+    // offset of entry listed after all children (statistics
+    // pseudo-directory in root), nothing follows it
+    static const off_t TAIL_OFFSET = ((off_t)1 << 62);
+
+    DirCursor ();
+
+    /**
+     * Find first child to return after entry with given offset. Caller
+     * must hold tree lock, children of directory must be loaded.
+     *
+     * @return iterator pointing to child or end of children
+     */
+    filemap_t::const_iterator seek (const FileNode *dir, off_t offset);
+
+    /**
+     * Remember child returned with given offset
+     */
+    void returned (const char *name, off_t offset);
+};
+
+#endif
@@ -0,0 +1,37 @@
+////////////////////////////////////////////////////////////////////////////
+//  Copyright (C) 2021 by V+ Publicidad SpA                               //
+//  http://www.vmaspublicidad.com                                         //
+//                                                                        //
+////////////////////////////////////////////////////////////////////////////
+
+#ifndef ENTRY_RECORD_H
+#define ENTRY_RECORD_H
+
+#include <zip.h>
+
+/**
+ * Attributes of existing ZIP archive entry in fixed-size form. Records are
+ * stored as-is in mount index file, so only fixed-width fields are
+ * allowed here.
+ */
+struct EntryRecord {
+    enum {
+        IS_DIR = 1,
+        HAS_CRETIME = 2,
+        ENCRYPTED = 4
+    };
+
+    // entry index in ZIP archive
+    zip_int64_t id;
+    // uncompressed size
+    zip_uint64_t size;
+    // offset of local file header in archive
+    zip_uint64_t offset;
+    zip_int64_t mtime, atime, ctime, cretime;
+    // offset of zero-terminated name in names table
+    zip_uint64_t nameOffset;
+    zip_uint32_t mode, uid, gid;
+    zip_uint32_t flags;
+};
+
+#endif
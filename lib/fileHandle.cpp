@@ -0,0 +1,96 @@
+////////////////////////////////////////////////////////////////////////////
+//  Copyright (C) 2021 by V+ Publicidad SpA                               //
+//  http://www.vmaspublicidad.com                                         //
+//                                                                        //
+////////////////////////////////////////////////////////////////////////////
+
+#include <cstddef>
+#include <new>
+
+#include "fileHandle.h"
+#include "lock.h"
+
+const size_t FileHandle::MIN_READAHEAD;
+const size_t FileHandle::MAX_READAHEAD;
+
+FileHandle::FileHandle () {
+    reset(NULL, 0);
+}
+
+void FileHandle::reset (FileNode *node, int flags) {
+    m_nextFree = NULL;
+    m_readEnd = -1;
+    m_sequentialReads = 0;
+    m_readahead = 0;
+    this->node = node;
+    this->flags = flags;
+    stream = NULL;
+    dataOffset = -1;
+    text = NULL;
+}
+
+void FileHandle::readDone (off_t offset, size_t size) {
+    if (offset == m_readEnd || (m_readEnd == -1 && offset == 0)) {
+        ++m_sequentialReads;
+        if (m_readahead == 0) {
+            m_readahead = MIN_READAHEAD;
+        } else if (m_readahead < MAX_READAHEAD) {
+            m_readahead *= 2;
+        }
+    } else {
+        m_sequentialReads = 0;
+        m_readahead = 0;
+    }
+    m_readEnd = offset + size;
+}
+
+FileHandlePool::FileHandlePool (): m_free(NULL), m_used(0) {
+    pthread_mutex_init(&m_lock, NULL);
+}
+
+FileHandlePool::~FileHandlePool () {
+    for (std::vector<FileHandle *>::iterator i = m_chunks.begin();
+            i != m_chunks.end(); ++i) {
+        delete[] *i;
+    }
+    pthread_mutex_destroy(&m_lock);
+}
+
+FileHandle *FileHandlePool::allocate (FileNode *node, int flags) {
+    MutexLock lock(m_lock);
+    if (m_free == NULL) {
+        FileHandle *chunk = new FileHandle[CHUNK_SIZE];
+        try {
+            m_chunks.push_back(chunk);
+        }
+        catch (...) {
+            delete[] chunk;
+            throw;
+        }
+        for (size_t i = 0; i < CHUNK_SIZE; ++i) {
+            chunk[i].m_nextFree = m_free;
+            m_free = &chunk[i];
+        }
+    }
+    FileHandle *handle = m_free;
+    m_free = handle->m_nextFree;
+    handle->reset(node, flags);
+    ++m_used;
+    return handle;
+}
+
+void FileHandlePool::release (FileHandle *handle) {
+    if (handle == NULL) {
+        return;
+    }
+    MutexLock lock(m_lock);
+    handle->node = NULL;
+    handle->m_nextFree = m_free;
+    m_free = handle;
+    --m_used;
+}
+
+size_t FileHandlePool::used () {
+    MutexLock lock(m_lock);
+    return m_used;
+}
@@ -0,0 +1,127 @@
+////////////////////////////////////////////////////////////////////////////
+//  Copyright (C) 2021 by V+ Publicidad SpA                               //
+//  http://www.vmaspublicidad.com                                         //
+//                                                                        //
+////////////////////////////////////////////////////////////////////////////
+
+#ifndef FILE_HANDLE_H
+#define FILE_HANDLE_H
+
+#include <pthread.h>
+#include <sys/types.h>
+
+#include <string>
+#include <vector>
+
+class FileNode;
+class ZipStream;
+
+/**
+ * State of one open() of file node (kept in file handle of opened file).
+ * Several handles may refer to the same node, node data is shared.
+ *
+ * Handle is used only by operations on its node, so its fields are
+ * protected by node lock (see VmasFSData).
+ */
+class FileHandle {
+friend class FileHandlePool;
+private:
+    // must not be defined
+    FileHandle (const FileHandle &);
+    FileHandle &operator= (const FileHandle &);
+
+    // next free handle in pool
+    FileHandle *m_nextFree;
+
+    // offset just after the last read, -1 before first read
+    off_t m_readEnd;
+    // number of reads in a row that started at m_readEnd
+    unsigned int m_sequentialReads;
+    size_t m_readahead;
+
+    FileHandle ();
+
+    void reset (FileNode *node, int flags);
+
+public:
+    // read-ahead window grows from MIN_READAHEAD to MAX_READAHEAD while
+    // reads are sequential
+    static const size_t MIN_READAHEAD = 128 * 1024;
+    static const size_t MAX_READAHEAD = 4 * 1024 * 1024;
+
+    FileNode *node;
+    // flags passed to open()
+    int flags;
+    // data is read directly from archive (direct I/O), NULL if data is
+    // read from node buffer
+    ZipStream *stream;
+    // offset of data in archive file if entry is stored without
+    // compression and read by I/O engine, -1 otherwise
+    off_t dataOffset;
+    // content of pseudo-file rendered on open (see
+    // VmasFSData::enableStats), NULL for archive files
+    std::string *text;
+
+    /**
+     * Account read of 'size' bytes from 'offset' (size is the number of
+     * bytes actually read)
+     */
+    void readDone (off_t offset, size_t size);
+
+    /**
+     * Check if last reads were sequential (the first read from start of
+     * file is counted as sequential)
+     */
+    inline bool isSequential () const {
+        return m_sequentialReads > 0;
+    }
+
+    /**
+     * Number of bytes worth reading ahead of current position: 0 for
+     * random access, doubled on each sequential read up to MAX_READAHEAD
+     */
+    inline size_t readahead () const {
+        return m_readahead;
+    }
+};
+
+/**
+ * Pool of file handles. Handles are allocated by chunks and returned to
+ * system only when pool is destroyed, so open() and release() of many
+ * small files do not call allocator. Pool is thread-safe.
+ */
+class FileHandlePool {
+private:
+    // must not be defined
+    FileHandlePool (const FileHandlePool &);
+    FileHandlePool &operator= (const FileHandlePool &);
+
+    static const size_t CHUNK_SIZE = 64;
+
+    pthread_mutex_t m_lock;
+    std::vector<FileHandle *> m_chunks;
+    FileHandle *m_free;
+    size_t m_used;
+
+public:
+    FileHandlePool ();
+    ~FileHandlePool ();
+
+    /**
+     * Get handle for node opened with given flags
+     * @throws std::bad_alloc
+     */
+    FileHandle *allocate (FileNode *node, int flags);
+
+    /**
+     * Return handle to pool
+     */
+    void release (FileHandle *handle);
+
+    /**
+     * Number of handles in use
+     */
+    size_t used ();
+};
+
+#endif
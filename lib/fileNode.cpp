@@ -18,36 +18,88 @@
 
 #include "fileNode.h"
 #include "extraField.h"
+#include "statistics.h"
 
 const zip_int64_t FileNode::ROOT_NODE_INDEX = -1;
 const zip_int64_t FileNode::NEW_NODE_INDEX = -2;
 
-FileNode::FileNode(struct zip *zip, const char *fname, zip_int64_t _id) {
+/**
+ * Arena pointer is stored in front of node. Header is padded to keep
+ * node aligned.
+ */
+union NodeHeader {
+    NodeArena *arena;
+    zip_uint64_t align;
+};
+
+void *FileNode::operator new (size_t size, NodeArena *arena) {
+    void *p;
+    if (arena == NULL) {
+        p = ::operator new(sizeof(NodeHeader) + size);
+    } else {
+        p = arena->allocate(sizeof(NodeHeader) + size);
+    }
+    ((NodeHeader *)p)->arena = arena;
+    return (NodeHeader *)p + 1;
+}
+
+void FileNode::operator delete (void *p, NodeArena *) {
+    FileNode::operator delete (p);
+}
+
+void FileNode::operator delete (void *p) {
+    if (p == NULL) {
+        return;
+    }
+    NodeHeader *h = (NodeHeader *)p - 1;
+    if (h->arena == NULL) {
+        ::operator delete(h);
+    } else {
+        h->arena->release(h, sizeof(NodeHeader) + sizeof(FileNode));
+    }
+}
+
+NodeArena *FileNode::arena() const {
+    return ((const NodeHeader *)this - 1)->arena;
+}
+
+FileNode::FileNode(struct zip *zip, const char *fname, zip_int64_t _id,
+        NodeArena *arena): childs(ltstr(), filemap_t::allocator_type(arena)) {
     this->zip = zip;
+    buffer = NULL;
     metadataChanged = false;
-    full_name = fname;
+    renamed = false;
+    childsLoaded = true;
+    encrypted = false;
+    parent = NULL;
+    is_dir = false;
+    m_name = NULL;
+    parse_name(fname);
     id = _id;
+    ino = 0;
+    nlookup = 0;
     m_uid = 0;
     m_gid = 0;
 }
 
 FileNode *FileNode::createFile (struct zip *zip, const char *fname, 
-        uid_t owner, gid_t group, mode_t mode) {
-    FileNode *n = new FileNode(zip, fname, NEW_NODE_INDEX);
-    if (n == NULL) {
-        return NULL;
-    }
-    n->state = NEW;
+        uid_t owner, gid_t group, mode_t mode, NodeArena *arena) {
+    FileNode *n = new (arena) FileNode(zip, fname, NEW_NODE_INDEX, arena);
     n->is_dir = false;
-    n->buffer = new BigBuffer();
-    if (!n->buffer) {
+    try {
+        n->buffer = new BigBuffer();
+    }
+    catch (...) {
+        // node is not counted as changed yet
+        n->state = CLOSED;
         delete n;
-        return NULL;
+        throw;
     }
+    n->state = NEW;
+    Statistics::global.dirtyChanged(1);
     n->has_cretime = true;
     n->m_mtime = n->m_atime = n->m_ctime = n->cretime = time(NULL);
 
-    n->parse_name();
     n->m_mode = mode;
     n->m_uid = owner;
     n->m_gid = group;
@@ -55,22 +107,24 @@ FileNode *FileNode::createFile (struct zip *zip, const char *fname,
     return n;
 }
 
-FileNode *FileNode::createSymlink(struct zip *zip, const char *fname) {
-    FileNode *n = new FileNode(zip, fname, NEW_NODE_INDEX);
-    if (n == NULL) {
-        return NULL;
-    }
-    n->state = NEW;
+FileNode *FileNode::createSymlink(struct zip *zip, const char *fname,
+        NodeArena *arena) {
+    FileNode *n = new (arena) FileNode(zip, fname, NEW_NODE_INDEX, arena);
     n->is_dir = false;
-    n->buffer = new BigBuffer();
-    if (!n->buffer) {
+    try {
+        n->buffer = new BigBuffer();
+    }
+    catch (...) {
+        // node is not counted as changed yet
+        n->state = CLOSED;
         delete n;
-        return NULL;
+        throw;
     }
+    n->state = NEW;
+    Statistics::global.dirtyChanged(1);
     n->has_cretime = true;
     n->m_mtime = n->m_atime = n->m_ctime = n->cretime = time(NULL);
 
-    n->parse_name();
     n->m_mode = S_IFLNK | 0777;
 
     return n;
@@ -80,11 +134,8 @@ FileNode *FileNode::createSymlink(struct zip *zip, const char *fname) {
  * Create intermediate directory to build full tree
  */
 FileNode *FileNode::createIntermediateDir(struct zip *zip,
-        const char *fname) {
-    FileNode *n = new FileNode(zip, fname, NEW_NODE_INDEX);
-    if (n == NULL) {
-        return NULL;
-    }
+        const char *fname, NodeArena *arena) {
+    FileNode *n = new (arena) FileNode(zip, fname, NEW_NODE_INDEX, arena);
     n->state = NEW_DIR;
     n->is_dir = true;
     n->has_cretime = true;
@@ -92,52 +143,42 @@ FileNode *FileNode::createIntermediateDir(struct zip *zip,
     n->m_size = 0;
     n->m_mode = S_IFDIR | 0775;
 
-    n->parse_name();
-
     return n;
 }
 
 FileNode *FileNode::createDir(struct zip *zip, const char *fname,
-        zip_int64_t id, uid_t owner, gid_t group, mode_t mode) {
-    FileNode *n = createNodeForZipEntry(zip, fname, id);
-    if (n == NULL) {
-        return NULL;
-    }
-    n->state = CLOSED;
-    n->has_cretime = true;
-    n->cretime = n->m_mtime;
+        uid_t owner, gid_t group, mode_t mode, NodeArena *arena) {
+    FileNode *n = createIntermediateDir(zip, fname, arena);
     // FUSE does not pass S_IFDIR bit here
     n->m_mode = S_IFDIR | mode;
     n->m_uid = owner;
     n->m_gid = group;
-    n->is_dir = true;
+    // directory entry is added to archive on save
+    n->metadataChanged = true;
     return n;
 }
 
-FileNode *FileNode::createRootNode() {
-    FileNode *n = new FileNode(NULL, "", ROOT_NODE_INDEX);
-    if (n == NULL) {
-        return NULL;
-    }
+FileNode *FileNode::createRootNode(NodeArena *arena) {
+    FileNode *n = new (arena) FileNode(NULL, "", ROOT_NODE_INDEX, arena);
     n->is_dir = true;
     n->state = NEW_DIR;
     n->m_mtime = n->m_atime = n->m_ctime = n->cretime = time(NULL);
     n->has_cretime = true;
     n->m_size = 0;
-    n->name = n->full_name.c_str();
     n->m_mode = S_IFDIR | 0775;
     return n;
 }
 
 FileNode *FileNode::createNodeForZipEntry(struct zip *zip,
-        const char *fname, zip_int64_t id) {
-    FileNode *n = new FileNode(zip, fname, id);
-    if (n == NULL) {
-        return NULL;
+        const char *fname, zip_int64_t id, NodeArena *arena) {
+    EntryRecord rec;
+    memset(&rec, 0, sizeof(rec));
+    rec.id = id;
+    // directory entry names end with slash
+    size_t len = strlen(fname);
+    if (len > 0 && fname[len - 1] == '/') {
+        rec.flags |= EntryRecord::IS_DIR;
     }
-    n->is_dir = false;
-    n->open_count = 0;
-    n->state = CLOSED;
 
     struct zip_stat stat;
     zip_stat_index(zip, id, 0, &stat);
@@ -147,63 +188,177 @@ FileNode *FileNode::createNodeForZipEntry(struct zip *zip,
     // required fields are always valid for existing items or newly added
     // directories (see zip_stat_index.c from libzip)
     assert((stat.valid & needValid) == needValid);
-    n->m_mtime = n->m_atime = n->m_ctime = stat.mtime;
-    n->has_cretime = false;
-    n->m_size = stat.size;
+    rec.mtime = rec.atime = rec.ctime = stat.mtime;
+    rec.size = stat.size;
+    if ((stat.valid & ZIP_STAT_ENCRYPTION_METHOD) &&
+            stat.encryption_method != ZIP_EM_NONE) {
+        rec.flags |= EntryRecord::ENCRYPTED;
+    }
+
+    zip_uint8_t opsys;
+    zip_uint32_t attr;
+    zip_file_get_external_attributes(zip, id, 0, &opsys, &attr);
+    processExternalAttributes(opsys, attr, rec);
+
+    ExtraFieldsState state;
+    zip_int16_t count = zip_file_extra_fields_count (zip, id, ZIP_FL_LOCAL);
+    for (zip_int16_t i = 0; i < count; ++i) {
+        zip_uint16_t type, len;
+        const zip_uint8_t *field = zip_file_extra_field_get (zip,
+                id, i, &type, &len, ZIP_FL_LOCAL);
+        processExtraField(type, len, field, state, rec);
+    }
 
-    n->parse_name();
+    return createNodeFromRecord(zip, fname, rec, arena);
+}
+
+void FileNode::readRecord(const CentralDirectory::Entry &entry,
+        EntryRecord &rec) {
+    rec.size = entry.size;
+    rec.mtime = rec.atime = rec.ctime = entry.mtime;
+    rec.flags &= ~(EntryRecord::HAS_CRETIME | EntryRecord::ENCRYPTED);
+    // bit 0 of general purpose flag
+    if (entry.flags & 1) {
+        rec.flags |= EntryRecord::ENCRYPTED;
+    }
+    rec.uid = rec.gid = 0;
+    processExternalAttributes(entry.versionMadeBy >> 8,
+            entry.externalAttributes, rec);
+
+    // libzip is queried for local header extra fields, so do the same
+    ExtraFieldsState state;
+    const zip_uint8_t *ef = entry.localExtra;
+    const zip_uint8_t *end = ef + entry.localExtraLength;
+    zip_uint16_t type, len;
+    const zip_uint8_t *field;
+    while (CentralDirectory::nextExtraField(ef, end, type, len, field)) {
+        processExtraField(type, len, field, state, rec);
+    }
+}
 
-    n->processExternalAttributes();
-    n->processExtraFields();
+FileNode *FileNode::createNodeFromRecord(struct zip *zip,
+        const char *fname, const EntryRecord &rec, NodeArena *arena) {
+    FileNode *n = new (arena) FileNode(zip, fname, rec.id, arena);
+    if (rec.flags & EntryRecord::IS_DIR) {
+        n->is_dir = true;
+    }
+    n->open_count = 0;
+    n->state = CLOSED;
+    n->m_size = rec.size;
+    n->m_mode = rec.mode;
+    n->m_uid = rec.uid;
+    n->m_gid = rec.gid;
+    n->m_mtime = rec.mtime;
+    n->m_atime = rec.atime;
+    n->m_ctime = rec.ctime;
+    n->has_cretime = (rec.flags & EntryRecord::HAS_CRETIME) != 0;
+    n->cretime = rec.cretime;
+    n->encrypted = (rec.flags & EntryRecord::ENCRYPTED) != 0;
     return n;
 }
 
+void FileNode::fillRecord (EntryRecord &rec) const {
+    rec.id = id;
+    rec.size = m_size;
+    rec.mode = m_mode;
+    rec.uid = m_uid;
+    rec.gid = m_gid;
+    rec.mtime = m_mtime;
+    rec.atime = m_atime;
+    rec.ctime = m_ctime;
+    rec.cretime = has_cretime ? cretime : 0;
+    rec.flags = 0;
+    if (is_dir) {
+        rec.flags |= EntryRecord::IS_DIR;
+    }
+    if (has_cretime) {
+        rec.flags |= EntryRecord::HAS_CRETIME;
+    }
+    if (encrypted) {
+        rec.flags |= EntryRecord::ENCRYPTED;
+    }
+}
+
 FileNode::~FileNode() {
+    if (isChanged()) {
+        Statistics::global.dirtyChanged(-1);
+    }
+    releaseBuffer();
+    freeName();
+}
+
+void FileNode::releaseBuffer() {
     if (state == OPENED || state == CHANGED || state == NEW) {
         delete buffer;
+        buffer = NULL;
     }
 }
 
 /**
  * Get short name of a file. If last char is '/' then node is a directory
  */
-void FileNode::parse_name() {
-    assert(!full_name.empty());
-
-    const char *lsl = full_name.c_str();
-    while (*lsl++) {}
-    lsl--;
-    while (lsl > full_name.c_str() && *lsl != '/') {
-        lsl--;
-    }
+void FileNode::parse_name(const char *fname) {
+    const char *end = fname + strlen(fname);
     // If the last symbol in file name is '/' then it is a directory
-    if (*lsl == '/' && *(lsl+1) == '\0') {
-        // It will produce two \0s at the end of file name. I think that
-        // it is not a problem
-        full_name[full_name.size() - 1] = 0;
+    if (end > fname && *(end - 1) == '/') {
+        --end;
         this->is_dir = true;
-        while (lsl > full_name.c_str() && *lsl != '/') {
-            lsl--;
-        }
     }
-    // Setting short name of node
-    if (*lsl == '/') {
-        lsl++;
+    const char *lsl = end;
+    while (lsl > fname && *(lsl - 1) != '/') {
+        lsl--;
+    }
+    setName(lsl, end - lsl);
+}
+
+void FileNode::setName(const char *name, size_t len) {
+    NodeArena *a = arena();
+    char *p;
+    if (a == NULL) {
+        p = new char[len + 1];
+    } else {
+        p = (char *)a->allocate(len + 1);
+    }
+    memcpy(p, name, len);
+    p[len] = '\0';
+    freeName();
+    m_name = p;
+}
+
+void FileNode::freeName() {
+    if (m_name == NULL) {
+        return;
+    }
+    NodeArena *a = arena();
+    if (a == NULL) {
+        delete[] m_name;
+    } else {
+        a->release(m_name, strlen(m_name) + 1);
+    }
+    m_name = NULL;
+}
+
+std::string FileNode::fullName() const {
+    if (parent == NULL || parent->parent == NULL) {
+        return m_name;
     }
-    this->name = lsl;
+    std::string res = parent->fullName();
+    res.push_back('/');
+    res.append(m_name);
+    return res;
 }
 
 void FileNode::appendChild (FileNode *child) {
-    childs.push_back (child);
+    assert(childs.find(child->name()) == childs.end());
+    childs[child->name()] = child;
 }
 
 void FileNode::detachChild (FileNode *child) {
-    childs.remove (child);
+    childs.erase (child->name());
 }
 
 void FileNode::rename(const char *new_name) {
-    full_name = new_name;
-    parse_name();
+    setName(new_name, strlen(new_name));
 }
 
 int FileNode::open() {
@@ -219,17 +374,28 @@ int FileNode::open() {
     }
     if (state == CLOSED) {
         open_count = 1;
-        try {
-            assert (zip != NULL);
-            buffer = new BigBuffer(zip, id, m_size);
-            state = OPENED;
-        }
-        catch (std::bad_alloc) {
-            return -ENOMEM;
-        }
-        catch (std::exception) {
-            return -EIO;
-        }
+        state = OPENED;
+    }
+    return 0;
+}
+
+int FileNode::load() {
+    if (!isUnloaded()) {
+        return 0;
+    }
+    // do not inflate data that would be dropped half-way
+    if (!BigBuffer::fits(m_size)) {
+        return -ENOMEM;
+    }
+    try {
+        assert (zip != NULL);
+        buffer = new BigBuffer(zip, id, m_size, encrypted);
+    }
+    catch (std::bad_alloc) {
+        return -ENOMEM;
+    }
+    catch (std::exception) {
+        return -EIO;
     }
     return 0;
 }
@@ -239,19 +405,57 @@ int FileNode::read(char *buf, size_t sz, zip_uint64_t offset) {
     return buffer->read(buf, sz, offset);
 }
 
+int FileNode::readStream(ZipStream &stream, char *buf, size_t sz,
+        zip_uint64_t offset) {
+    assert(isUnloaded());
+    m_atime = time(NULL);
+    if (offset >= m_size) {
+        return 0;
+    }
+    if (sz > m_size - offset) {
+        sz = m_size - offset;
+    }
+    return stream.read(buf, sz, offset);
+}
+
+int FileNode::readStored(IOEngine &io, off_t dataOffset, char *buf,
+        size_t sz, zip_uint64_t offset) {
+    assert(isUnloaded());
+    m_atime = time(NULL);
+    if (offset >= m_size) {
+        return 0;
+    }
+    if (sz > m_size - offset) {
+        sz = m_size - offset;
+    }
+    return io.read(buf, sz, dataOffset + offset);
+}
+
 int FileNode::write(const char *buf, size_t sz, zip_uint64_t offset) {
+    int res;
+    try {
+        res = buffer->write(buf, sz, offset);
+    }
+    catch (const std::bad_alloc &) {
+        // file is not marked as changed by failed write
+        return -ENOMEM;
+    }
     if (state == OPENED) {
         state = CHANGED;
+        Statistics::global.dirtyChanged(1);
     }
     m_mtime = time(NULL);
     metadataChanged = true;
-    return buffer->write(buf, sz, offset);
+    return res;
 }
 
 int FileNode::close() {
-    m_size = buffer->len;
+    if (buffer != NULL) {
+        m_size = buffer->len;
+    }
     if (state == OPENED && --open_count == 0) {
         delete buffer;
+        buffer = NULL;
         state = CLOSED;
     }
     return 0;
@@ -261,8 +465,12 @@ int FileNode::save() {
     assert (!is_dir);
     // index is modified if state == NEW
     assert (zip != NULL);
-    return buffer->saveToZip(m_mtime, zip, full_name.c_str(),
+    int res = buffer->saveToZip(m_mtime, zip, fullName().c_str(),
             state == NEW, id);
+    if (res == 0) {
+        encrypted = BigBuffer::passwd != NULL;
+    }
+    return res;
 }
 
 int FileNode::saveMetadata() const {
@@ -272,25 +480,26 @@ int FileNode::saveMetadata() const {
 
 int FileNode::truncate(zip_uint64_t offset) {
     if (state != CLOSED) {
-        if (state != NEW) {
+        if (state == OPENED) {
             state = CHANGED;
+            Statistics::global.dirtyChanged(1);
         }
         try {
             buffer->truncate(offset);
-            return 0;
         }
         catch (const std::bad_alloc &) {
             return EIO;
         }
         m_mtime = time(NULL);
         metadataChanged = true;
+        return 0;
     } else {
         return EBADF;
     }
 }
 
 zip_uint64_t FileNode::size() const {
-    if (state == NEW || state == OPENED || state == CHANGED) {
+    if (buffer != NULL) {
         return buffer->len;
     } else {
         return m_size;
@@ -300,20 +509,17 @@ zip_uint64_t FileNode::size() const {
 /**
  * Get file mode from external attributes.
  */
-void FileNode::processExternalAttributes () {
-    zip_uint8_t opsys;
-    zip_uint32_t attr;
-    assert(id >= 0);
-    assert (zip != NULL);
-    zip_file_get_external_attributes(zip, id, 0, &opsys, &attr);
+void FileNode::processExternalAttributes (zip_uint8_t opsys,
+        zip_uint32_t attr, EntryRecord &rec) {
+    bool is_dir = (rec.flags & EntryRecord::IS_DIR) != 0;
     switch (opsys) {
         case ZIP_OPSYS_UNIX: {
-            m_mode = attr >> 16;
+            rec.mode = attr >> 16;
             // force is_dir value
             if (is_dir) {
-                m_mode = (m_mode & ~S_IFMT) | S_IFDIR;
+                rec.mode = (rec.mode & ~S_IFMT) | S_IFDIR;
             } else {
-                m_mode = m_mode & ~S_IFDIR;
+                rec.mode = rec.mode & ~S_IFDIR;
             }
             break;
         }
@@ -324,95 +530,82 @@ void FileNode::processExternalAttributes () {
              * Both WINDOWS_NTFS and OPSYS_MVS used here because of
              * difference in constant assignment by PKWARE and Info-ZIP
              */
-            m_mode = 0444;
+            rec.mode = 0444;
             // http://msdn.microsoft.com/en-us/library/windows/desktop/gg258117%28v=vs.85%29.aspx
             // http://en.wikipedia.org/wiki/File_Allocation_Table#attributes
             // FILE_ATTRIBUTE_READONLY
             if ((attr & 1) == 0) {
-                m_mode |= 0220;
+                rec.mode |= 0220;
             }
             // directory
             if (is_dir) {
-                m_mode |= S_IFDIR | 0111;
+                rec.mode |= S_IFDIR | 0111;
             } else {
-                m_mode |= S_IFREG;
+                rec.mode |= S_IFREG;
             }
 
             break;
         }
         default: {
             if (is_dir) {
-                m_mode = S_IFDIR | 0775;
+                rec.mode = S_IFDIR | 0775;
             } else {
-                m_mode = S_IFREG | 0664;
+                rec.mode = S_IFREG | 0664;
             }
         }
     }
 }
 
 /**
- * Get timestamp information from extra fields.
+ * Get timestamp information from extra field.
  * Get owner and group information.
  */
-void FileNode::processExtraFields () {
-    zip_int16_t count;
-    // times from timestamp have precedence
-    bool mtimeFromTimestamp = false, atimeFromTimestamp = false;
-    // UIDs and GIDs from UNIX extra fields with bigger type IDs have
-    // precedence
-    int lastProcessedUnixField = 0;
-
-    assert (id >= 0);
-    assert (zip != NULL);
-    count = zip_file_extra_fields_count (zip, id, ZIP_FL_LOCAL);
-    for (zip_int16_t i = 0; i < count; ++i) {
-        bool has_mtime, has_atime, has_cretime;
-        time_t mt, at, cret;
-        zip_uint16_t type, len;
-        const zip_uint8_t *field = zip_file_extra_field_get (zip,
-                id, i, &type, &len, ZIP_FL_LOCAL);
-
-        switch (type) {
-            case FZ_EF_TIMESTAMP: {
-                if (ExtraField::parseExtTimeStamp (len, field, has_mtime, mt,
-                            has_atime, at, has_cretime, cret)) {
-                    if (has_mtime) {
-                        m_mtime = mt;
-                        mtimeFromTimestamp = true;
-                    }
-                    if (has_atime) {
-                        m_atime = at;
-                        atimeFromTimestamp = true;
-                    }
-                    if (has_cretime) {
-                        cretime = cret;
-                        this->has_cretime = true;
-                    }
+void FileNode::processExtraField (zip_uint16_t type, zip_uint16_t len,
+        const zip_uint8_t *field, ExtraFieldsState &state,
+        EntryRecord &rec) {
+    bool has_mtime, has_atime, has_cretime;
+    time_t mt, at, cret;
+
+    switch (type) {
+        case FZ_EF_TIMESTAMP: {
+            if (ExtraField::parseExtTimeStamp (len, field, has_mtime, mt,
+                        has_atime, at, has_cretime, cret)) {
+                if (has_mtime) {
+                    rec.mtime = mt;
+                    state.mtimeFromTimestamp = true;
+                }
+                if (has_atime) {
+                    rec.atime = at;
+                    state.atimeFromTimestamp = true;
+                }
+                if (has_cretime) {
+                    rec.cretime = cret;
+                    rec.flags |= EntryRecord::HAS_CRETIME;
                 }
-                break;
             }
-            case FZ_EF_PKWARE_UNIX:
-            case FZ_EF_INFOZIP_UNIX1:
-            case FZ_EF_INFOZIP_UNIX2:
-            case FZ_EF_INFOZIP_UNIXN: {
-                uid_t uid;
-                gid_t gid;
-                if (ExtraField::parseSimpleUnixField (type, len, field,
-                            uid, gid, has_mtime, mt, has_atime, at)) {
-                    if (type >= lastProcessedUnixField) {
-                        m_uid = uid;
-                        m_gid = gid;
-                        lastProcessedUnixField = type;
-                    }
-                    if (has_mtime && !mtimeFromTimestamp) {
-                        m_mtime = mt;
-                    }
-                    if (has_atime && !atimeFromTimestamp) {
-                        m_atime = at;
-                    }
+            break;
+        }
+        case FZ_EF_PKWARE_UNIX:
+        case FZ_EF_INFOZIP_UNIX1:
+        case FZ_EF_INFOZIP_UNIX2:
+        case FZ_EF_INFOZIP_UNIXN: {
+            uid_t uid;
+            gid_t gid;
+            if (ExtraField::parseSimpleUnixField (type, len, field,
+                        uid, gid, has_mtime, mt, has_atime, at)) {
+                if (type >= state.lastProcessedUnixField) {
+                    rec.uid = uid;
+                    rec.gid = gid;
+                    state.lastProcessedUnixField = type;
+                }
+                if (has_mtime && !state.mtimeFromTimestamp) {
+                    rec.mtime = mt;
+                }
+                if (has_atime && !state.atimeFromTimestamp) {
+                    rec.atime = at;
                 }
-                break;
             }
+            break;
         }
     }
 }
@@ -500,7 +693,7 @@ int FileNode::updateExternalAttributes() const {
         // FILE_ATTRIBUTE_DIRECTORY
         mode |= 0x10;
     }
-    if (name[0] == '.') {
+    if (m_name[0] == '.') {
         // FILE_ATTRIBUTE_HIDDEN
         mode |= 2;
     }
@@ -13,6 +13,10 @@
 
 #include "types.h"
 #include "bigBuffer.h"
+#include "entryRecord.h"
+#include "centralDirectory.h"
+#include "zipStream.h"
+#include "ioEngine.h"
 
 class FileNode {
 friend class VmasFSData;
@@ -36,66 +40,184 @@ private:
 
     zip_uint64_t m_size;
     bool has_cretime, metadataChanged;
+    // node is renamed, but ZIP entries of node and its descendants are
+    // not yet renamed (it is done in one batch on save)
+    bool renamed;
+    // false if directory children are not yet created from name index
+    bool childsLoaded;
+    // data of archive entry is encrypted
+    bool encrypted;
     mode_t m_mode;
     time_t m_mtime, m_atime, m_ctime, cretime;
     uid_t m_uid;
     gid_t m_gid;
 
-    void parse_name();
-    void processExtraFields();
-    void processExternalAttributes();
+    /**
+     * Extra fields processing state: times from timestamp have
+     * precedence, UIDs and GIDs from UNIX extra fields with bigger type
+     * IDs have precedence
+     */
+    struct ExtraFieldsState {
+        bool mtimeFromTimestamp, atimeFromTimestamp;
+        int lastProcessedUnixField;
+
+        ExtraFieldsState(): mtimeFromTimestamp(false),
+            atimeFromTimestamp(false), lastProcessedUnixField(0) {}
+    };
+
+    // short name of node, allocated from arena
+    char *m_name;
+
+    void parse_name(const char *fname);
+    void setName(const char *name, size_t len);
+    void freeName();
+
+    /**
+     * Arena that node is allocated from (NULL if node is allocated by
+     * global operator new). It is stored in front of node object.
+     */
+    NodeArena *arena() const;
+    static void processExternalAttributes(zip_uint8_t opsys,
+            zip_uint32_t attr, EntryRecord &rec);
+    static void processExtraField(zip_uint16_t type, zip_uint16_t len,
+            const zip_uint8_t *field, ExtraFieldsState &state,
+            EntryRecord &rec);
     int updateExtraFields() const;
     int updateExternalAttributes() const;
 
     static const zip_int64_t ROOT_NODE_INDEX, NEW_NODE_INDEX;
-    FileNode(struct zip *zip, const char *fname, zip_int64_t id);
+    FileNode(struct zip *zip, const char *fname, zip_int64_t id,
+            NodeArena *arena);
+
+    static void *operator new (size_t size, NodeArena *arena);
+    static void operator delete (void *p, NodeArena *arena);
 
 protected:
-    static FileNode *createIntermediateDir(struct zip *zip, const char *fname);
+    static FileNode *createIntermediateDir(struct zip *zip, const char *fname,
+            NodeArena *arena = NULL);
 
 public:
+    // nodes created with non-NULL arena are allocated from it together
+    // with their names and child maps. All factories throw
+    // std::bad_alloc if there is no memory.
+
     /**
      * Create new regular file
      */
     static FileNode *createFile(struct zip *zip, const char *fname,
-            uid_t owner, gid_t group, mode_t mode);
+            uid_t owner, gid_t group, mode_t mode, NodeArena *arena = NULL);
     /**
      * Create new symbolic link
      */
-    static FileNode *createSymlink(struct zip *zip, const char *fname);
+    static FileNode *createSymlink(struct zip *zip, const char *fname,
+            NodeArena *arena = NULL);
     /**
-     * Create new directory for ZIP file entry
+     * Create new directory. ZIP entry for it is added on save.
      */
     static FileNode *createDir(struct zip *zip, const char *fname,
-            zip_int64_t id, uid_t owner, gid_t group, mode_t mode);
+            uid_t owner, gid_t group, mode_t mode, NodeArena *arena = NULL);
     /**
      * Create root pseudo-node for file system
      */
-    static FileNode *createRootNode();
+    static FileNode *createRootNode(NodeArena *arena = NULL);
     /**
      * Create node for existing ZIP file entry
      */
     static FileNode *createNodeForZipEntry(struct zip *zip,
-            const char *fname, zip_int64_t id);
+            const char *fname, zip_int64_t id, NodeArena *arena = NULL);
+    /**
+     * Create node for existing ZIP file entry using attributes from
+     * record instead of querying libzip
+     */
+    static FileNode *createNodeFromRecord(struct zip *zip,
+            const char *fname, const EntryRecord &rec,
+            NodeArena *arena = NULL);
+    /**
+     * Fill entry attributes from central directory entry parsed without
+     * libzip. IS_DIR flag must be set in record before call.
+     */
+    static void readRecord(const CentralDirectory::Entry &entry,
+            EntryRecord &rec);
     ~FileNode();
-    
+
+    /**
+     * Return node memory to arena (or to heap)
+     */
+    static void operator delete (void *p);
+
+    /**
+     * Check if node was allocated from arena
+     */
+    inline bool isFromArena(const NodeArena *a) const {
+        return arena() == a;
+    }
+
+    /**
+     * Free data buffer of node. Used instead of destructor when the
+     * whole arena is released.
+     */
+    void releaseBuffer();
+
     /**
-     * add child node to list
+     * add child node to map. Name must be unique.
      */
     void appendChild (FileNode *child);
 
     /**
-     * remove child node from list
+     * remove child node from map
      */
     void detachChild (FileNode *child);
 
     /**
-     * Rename file without reparenting
+     * Change short name of node detached from parent
      */
     void rename (const char *new_name);
 
+    /**
+     * Find child by short name
+     * @return child or NULL
+     */
+    inline FileNode *findChild (const char *name) const {
+        filemap_t::const_iterator i = childs.find(name);
+        return (i == childs.end()) ? NULL : i->second;
+    }
+
+    /**
+     * Open file. Data of archive entry is not read until load() is called,
+     * so opening of file which content is cached by kernel is cheap.
+     */
     int open();
+    /**
+     * Read data of opened archive entry if not yet read. Must be called
+     * before read(), write() or truncate().
+     *
+     * @return 0 or negative error code (-ENOMEM if data does not fit into
+     *      buffer memory limit)
+     */
+    int load();
     int read(char *buf, size_t size, zip_uint64_t offset);
+    /**
+     * Read data of unloaded node (see isUnloaded) directly from archive
+     * without loading it. Caller must hold ZIP lock.
+     *
+     * @return number of bytes read or negative error code
+     */
+    int readStream(ZipStream &stream, char *buf, size_t size,
+            zip_uint64_t offset);
+    /**
+     * Read data of unloaded node stored without compression directly from
+     * archive file at 'dataOffset'.
+     *
+     * @return number of bytes read or negative error code
+     */
+    int readStored(IOEngine &io, off_t dataOffset, char *buf, size_t size,
+            zip_uint64_t offset);
+    /**
+     * Write data to loaded node.
+     *
+     * @return number of bytes written or negative error code (-ENOMEM if
+     *      buffer memory limit is reached)
+     */
     int write(const char *buf, size_t size, zip_uint64_t offset);
     int close();
 
@@ -107,6 +229,12 @@ public:
      */
     int save();
 
+    /**
+     * Fill record with attributes of unmodified ZIP file entry.
+     * Name offset and data offset are not touched.
+     */
+    void fillRecord (EntryRecord &rec) const;
+
     /**
      * Save file metadata to ZIP
      * @return libzip error code or 0 on success
@@ -124,6 +252,20 @@ public:
      */
     int truncate(zip_uint64_t offset);
 
+    /**
+     * Node is opened, but its data is not yet read from archive
+     */
+    inline bool isUnloaded() const {
+        return state == OPENED && buffer == NULL;
+    }
+
+    /**
+     * Archive entry data is encrypted (password is needed to open it)
+     */
+    inline bool isEncrypted() const {
+        return encrypted;
+    }
+
     inline bool isChanged() const {
         return state == CHANGED || state == NEW;
     }
@@ -162,17 +304,17 @@ public:
     }
 
     /**
-     * Get parent name
+     * Short name of node
      */
-    //TODO: rewrite without memory allocation
-    inline std::string getParentName () const {
-        if (name > full_name.c_str()) {
-            return std::string (full_name, 0, name - full_name.c_str() - 1);
-        } else {
-            return "";
-        }
+    inline const char *name () const {
+        return m_name;
     }
 
+    /**
+     * Full name of node derived from names of its parents
+     */
+    std::string fullName () const;
+
     /**
      * owner and group
      */
@@ -187,11 +329,15 @@ public:
 
     zip_uint64_t size() const;
 
-    const char *name;
-    std::string full_name;
     bool is_dir;
     zip_int64_t id;
-    nodelist_t childs;
+    // inode number, unique and stable during mount (0 if not assigned)
+    zip_uint64_t ino;
+    // number of lookups of node by kernel not yet forgotten (low-level
+    // frontend only, modified atomically)
+    zip_uint64_t nlookup;
+    // children by short name
+    filemap_t childs;
     FileNode *parent;
 };
 #endif
@@ -0,0 +1,216 @@
+////////////////////////////////////////////////////////////////////////////
+//  Copyright (C) 2021 by V+ Publicidad SpA                               //
+//  http://www.vmaspublicidad.com                                         //
+//                                                                        //
+////////////////////////////////////////////////////////////////////////////
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <syslog.h>
+
+#include <cerrno>
+#include <cstring>
+#include <new>
+
+#include "ioEngine.h"
+#include "lock.h"
+#include "statistics.h"
+
+const size_t IOEngine::CHUNK_SIZE;
+
+IOEngine::IOEngine (): m_fd(-1), m_head(NULL), m_tail(NULL),
+        m_stopping(false), m_inFlight(0) {
+    pthread_mutex_init(&m_lock, NULL);
+    pthread_cond_init(&m_queued, NULL);
+    pthread_cond_init(&m_done, NULL);
+    memset(&m_stats, 0, sizeof(m_stats));
+}
+
+IOEngine::~IOEngine () {
+    stop();
+    pthread_cond_destroy(&m_done);
+    pthread_cond_destroy(&m_queued);
+    pthread_mutex_destroy(&m_lock);
+}
+
+bool IOEngine::open (const char *fileName) {
+    m_fd = ::open(fileName, O_RDONLY | O_CLOEXEC);
+    if (m_fd == -1) {
+        syslog(LOG_WARNING, "unable to open %s for reading: %s", fileName,
+                strerror(errno));
+        return false;
+    }
+    return true;
+}
+
+void IOEngine::start (unsigned int depth) {
+    m_stopping = false;
+    for (unsigned int i = 0; i < depth; ++i) {
+        pthread_t thread;
+        int err = pthread_create(&thread, NULL, workerMain, this);
+        if (err != 0) {
+            // the rest of requests is executed by callers
+            syslog(LOG_WARNING, "unable to start I/O thread: %s",
+                    strerror(err));
+            break;
+        }
+        m_workers.push_back(thread);
+    }
+}
+
+void IOEngine::stop () {
+    {
+        MutexLock lock(m_lock);
+        m_stopping = true;
+        pthread_cond_broadcast(&m_queued);
+    }
+    for (std::vector<pthread_t>::iterator i = m_workers.begin();
+            i != m_workers.end(); ++i) {
+        pthread_join(*i, NULL);
+    }
+    m_workers.clear();
+    if (m_fd != -1) {
+        ::close(m_fd);
+        m_fd = -1;
+    }
+}
+
+void *IOEngine::workerMain (void *engine) {
+    ((IOEngine *)engine)->work();
+    return NULL;
+}
+
+void IOEngine::work () {
+    MutexLock lock(m_lock);
+    while (true) {
+        while (m_head == NULL && !m_stopping) {
+            pthread_cond_wait(&m_queued, &m_lock);
+        }
+        if (m_head == NULL) {
+            return;
+        }
+        Request *req = m_head;
+        m_head = req->next;
+        if (m_head == NULL) {
+            m_tail = NULL;
+        }
+        pthread_mutex_unlock(&m_lock);
+        execute(*req);
+        pthread_mutex_lock(&m_lock);
+        if (--req->batch->pending == 0) {
+            pthread_cond_broadcast(&m_done);
+        }
+    }
+}
+
+void IOEngine::execute (Request &req) {
+    uint64_t started = TraceLog::global.isEnabled() ? Statistics::now() : 0;
+    {
+        MutexLock lock(m_lock);
+        if (++m_inFlight > m_stats.maxInFlight) {
+            m_stats.maxInFlight = m_inFlight;
+        }
+    }
+    size_t done = 0;
+    req.res = 0;
+    while (done < req.size) {
+        ssize_t nr = pread(m_fd, req.buf + done, req.size - done,
+                req.offset + done);
+        if (nr < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            req.res = -errno;
+            break;
+        }
+        if (nr == 0) {
+            break;
+        }
+        done += nr;
+    }
+    if (started != 0) {
+        TraceLog::global.complete("io", "pread", started,
+                Statistics::now() - started, done);
+    }
+    MutexLock lock(m_lock);
+    --m_inFlight;
+    ++m_stats.requests;
+    if (req.res < 0) {
+        ++m_stats.errors;
+    } else {
+        req.res = done;
+        m_stats.bytes += done;
+    }
+}
+
+int IOEngine::read (char *buf, size_t size, off_t offset) {
+    {
+        MutexLock lock(m_lock);
+        ++m_stats.reads;
+    }
+    size_t count = (size + CHUNK_SIZE - 1) / CHUNK_SIZE;
+    Request single;
+    Batch batch;
+    std::vector<Request> reqs;
+    Request *first = &single;
+    if (count > 1 && !m_workers.empty()) {
+        try {
+            reqs.resize(count);
+        }
+        catch (std::bad_alloc) {
+            return -ENOMEM;
+        }
+        first = &reqs[0];
+    } else {
+        count = 1;
+    }
+    for (size_t i = 0; i < count; ++i) {
+        Request &req = first[i];
+        req.buf = buf + i * CHUNK_SIZE;
+        req.offset = offset + i * CHUNK_SIZE;
+        req.size = (i + 1 < count) ? CHUNK_SIZE : size - i * CHUNK_SIZE;
+        req.batch = &batch;
+        req.next = (i + 1 < count) ? &first[i + 1] : NULL;
+    }
+    batch.pending = count;
+
+    if (count == 1) {
+        // nothing to do in parallel
+        execute(single);
+    } else {
+        MutexLock lock(m_lock);
+        if (m_tail == NULL) {
+            m_head = first;
+        } else {
+            m_tail->next = first;
+        }
+        m_tail = &first[count - 1];
+        pthread_cond_broadcast(&m_queued);
+        while (batch.pending != 0) {
+            pthread_cond_wait(&m_done, &m_lock);
+        }
+    }
+
+    // data after short read is not valid
+    size_t res = 0;
+    for (size_t i = 0; i < count; ++i) {
+        if (first[i].res < 0) {
+            return first[i].res;
+        }
+        res += first[i].res;
+        if ((size_t)first[i].res < first[i].size) {
+            break;
+        }
+    }
+    return res;
+}
+
+void IOEngine::prefetch (off_t offset, size_t size) {
+    // only a hint, errors are not interesting
+    posix_fadvise(m_fd, offset, size, POSIX_FADV_WILLNEED);
+}
+
+IOEngine::Stats IOEngine::stats () {
+    MutexLock lock(m_lock);
+    return m_stats;
+}
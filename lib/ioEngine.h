@@ -0,0 +1,127 @@
+////////////////////////////////////////////////////////////////////////////
+//  Copyright (C) 2021 by V+ Publicidad SpA                               //
+//  http://www.vmaspublicidad.com                                         //
+//                                                                        //
+////////////////////////////////////////////////////////////////////////////
+
+#ifndef IO_ENGINE_H
+#define IO_ENGINE_H
+
+#include <pthread.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#include <vector>
+
+/**
+ * Reader of archive file data bypassing libzip (used for entries stored
+ * without compression). Archive is read with pread() from a pool of
+ * worker threads, so reads from many files are not serialized by ZIP lock
+ * and big read is split into chunks that are read in parallel. Queue
+ * depth is the number of worker threads.
+ *
+ * File is opened by open() before process is daemonized (archive path
+ * may be relative to initial working directory), threads are started by
+ * start() after that (fork() does not copy threads). Without threads
+ * requests are executed by callers.
+ */
+class IOEngine {
+public:
+    /**
+     * Counters of engine activity since start
+     */
+    struct Stats {
+        // read() calls
+        uint64_t reads;
+        // pread() requests (chunks)
+        uint64_t requests;
+        uint64_t bytes;
+        uint64_t errors;
+        // max number of requests in flight at once
+        unsigned int maxInFlight;
+    };
+
+    // big reads are split into chunks of this size
+    static const size_t CHUNK_SIZE = 128 * 1024;
+
+private:
+    // must not be defined
+    IOEngine (const IOEngine &);
+    IOEngine &operator= (const IOEngine &);
+
+    struct Batch {
+        size_t pending;
+    };
+
+    struct Request {
+        char *buf;
+        size_t size;
+        off_t offset;
+        // bytes read or negative error code
+        ssize_t res;
+        Batch *batch;
+        Request *next;
+    };
+
+    int m_fd;
+    pthread_mutex_t m_lock;
+    // signalled when request is queued or engine is stopping
+    pthread_cond_t m_queued;
+    // signalled when request is done
+    pthread_cond_t m_done;
+    Request *m_head, *m_tail;
+    bool m_stopping;
+    std::vector<pthread_t> m_workers;
+    unsigned int m_inFlight;
+    Stats m_stats;
+
+    static void *workerMain (void *engine);
+    void work ();
+
+    /**
+     * Execute request and update counters (without lock)
+     */
+    void execute (Request &req);
+
+public:
+    IOEngine ();
+    ~IOEngine ();
+
+    /**
+     * Open file for reading
+     * @return false if file can not be opened
+     */
+    bool open (const char *fileName);
+
+    /**
+     * Start 'depth' worker threads
+     */
+    void start (unsigned int depth);
+
+    /**
+     * Stop workers and close file. No reads may be in progress.
+     */
+    void stop ();
+
+    inline bool isOpen () const {
+        return m_fd != -1;
+    }
+
+    /**
+     * Read up to 'size' bytes from 'offset' of file. Data is read by
+     * workers in chunks, caller waits for all of them.
+     * @return number of bytes read (less than size only at end of file)
+     * or negative error code
+     */
+    int read (char *buf, size_t size, off_t offset);
+
+    /**
+     * Advise kernel that 'size' bytes from 'offset' will be read soon, so
+     * they are read into page cache in background
+     */
+    void prefetch (off_t offset, size_t size);
+
+    Stats stats ();
+};
+
+#endif
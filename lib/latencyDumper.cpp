@@ -0,0 +1,135 @@
+////////////////////////////////////////////////////////////////////////////
+//  Copyright (C) 2021 by V+ Publicidad SpA                               //
+//  http://www.vmaspublicidad.com                                         //
+//                                                                        //
+////////////////////////////////////////////////////////////////////////////
+
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <syslog.h>
+
+#include <cerrno>
+#include <cstring>
+
+#include "latencyDumper.h"
+#include "statistics.h"
+
+const int LatencyDumper::DUMP_SIGNAL = SIGUSR1;
+const int LatencyDumper::TOGGLE_SIGNAL = SIGUSR2;
+
+LatencyDumper::LatencyDumper (): m_started(false), m_stopping(false) {
+}
+
+LatencyDumper::~LatencyDumper () {
+    stop();
+}
+
+void LatencyDumper::blockSignals () {
+    sigset_t set;
+    sigemptyset(&set);
+    sigaddset(&set, DUMP_SIGNAL);
+    sigaddset(&set, TOGGLE_SIGNAL);
+    pthread_sigmask(SIG_BLOCK, &set, NULL);
+}
+
+void LatencyDumper::start () {
+    m_stopping = false;
+    int err = pthread_create(&m_thread, NULL, threadMain, this);
+    if (err != 0) {
+        syslog(LOG_WARNING, "unable to start signal thread: %s",
+                strerror(err));
+        return;
+    }
+    m_started = true;
+}
+
+void LatencyDumper::stop () {
+    if (!m_started) {
+        return;
+    }
+    __atomic_store_n(&m_stopping, true, __ATOMIC_RELAXED);
+    // wake up thread waiting for signal
+    pthread_kill(m_thread, DUMP_SIGNAL);
+    pthread_join(m_thread, NULL);
+    m_started = false;
+}
+
+void *LatencyDumper::threadMain (void *dumper) {
+    ((LatencyDumper *)dumper)->wait();
+    return NULL;
+}
+
+void LatencyDumper::wait () {
+    sigset_t set;
+    sigemptyset(&set);
+    sigaddset(&set, DUMP_SIGNAL);
+    sigaddset(&set, TOGGLE_SIGNAL);
+    while (true) {
+        int sig;
+        if (sigwait(&set, &sig) != 0) {
+            continue;
+        }
+        if (__atomic_load_n(&m_stopping, __ATOMIC_RELAXED)) {
+            return;
+        }
+        if (sig == DUMP_SIGNAL) {
+            uint64_t started = Statistics::now();
+            dump();
+            TraceLog::global.complete("background", "latency_dump", started,
+                    Statistics::now() - started);
+        } else {
+            bool timing = !Statistics::global.timing();
+            Statistics::global.setTiming(timing);
+            syslog(LOG_INFO, "timing of operations %s",
+                    timing ? "enabled" : "disabled");
+        }
+    }
+}
+
+bool LatencyDumper::dump () {
+    std::string out;
+    Statistics::global.printLatency(out);
+    if (out.empty()) {
+        syslog(LOG_INFO, "latency: no timed operations");
+    }
+    for (size_t start = 0; start < out.size(); ) {
+        size_t end = out.find('\n', start);
+        syslog(LOG_INFO, "latency: %.*s", (int)(end - start),
+                out.c_str() + start);
+        start = end + 1;
+    }
+
+    if (m_fileName.empty()) {
+        return true;
+    }
+    const std::string &fileName = m_fileName;
+    int fd = open(fileName.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,
+            0644);
+    if (fd == -1) {
+        syslog(LOG_WARNING, "unable to open %s for writing: %s",
+                fileName.c_str(), strerror(errno));
+        return false;
+    }
+    out.insert(0, Statistics::global.timing() ?
+            "# latency in ns, timing enabled\n" :
+            "# latency in ns, timing disabled\n");
+    const char *p = out.c_str();
+    size_t left = out.size();
+    while (left > 0) {
+        ssize_t nw = write(fd, p, left);
+        if (nw < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            syslog(LOG_WARNING, "unable to write %s: %s", fileName.c_str(),
+                    strerror(errno));
+            close(fd);
+            return false;
+        }
+        p += nw;
+        left -= nw;
+    }
+    close(fd);
+    return true;
+}
@@ -0,0 +1,78 @@
+////////////////////////////////////////////////////////////////////////////
+//  Copyright (C) 2021 by V+ Publicidad SpA                               //
+//  http://www.vmaspublicidad.com                                         //
+//                                                                        //
+////////////////////////////////////////////////////////////////////////////
+
+#ifndef LATENCY_DUMPER_H
+#define LATENCY_DUMPER_H
+
+#include <pthread.h>
+
+#include <string>
+
+/**
+ * Thread waiting for signals controlling latency statistics:
+ * DUMP_SIGNAL writes operation latency percentiles (see
+ * Statistics::printLatency) to syslog and to file if it is set,
+ * TOGGLE_SIGNAL enables
+ * or disables timing of operations.
+ *
+ * Signals are accepted by sigwait(), so they must be blocked in all
+ * threads of process: blockSignals() must be called before any thread is
+ * started (threads inherit signal mask). Thread is started by start()
+ * after process is daemonized.
+ */
+class LatencyDumper {
+private:
+    // must not be defined
+    LatencyDumper (const LatencyDumper &);
+    LatencyDumper &operator= (const LatencyDumper &);
+
+    std::string m_fileName;
+    pthread_t m_thread;
+    bool m_started;
+    bool m_stopping;
+
+    static void *threadMain (void *dumper);
+    void wait ();
+
+public:
+    static const int DUMP_SIGNAL;
+    static const int TOGGLE_SIGNAL;
+
+    LatencyDumper ();
+    ~LatencyDumper ();
+
+    /**
+     * Block DUMP_SIGNAL and TOGGLE_SIGNAL in calling thread
+     */
+    static void blockSignals ();
+
+    /**
+     * Set absolute name of file to write latencies to (empty string means
+     * syslog only). File is created or truncated on every dump.
+     */
+    inline void setFileName (const std::string &fileName) {
+        m_fileName = fileName;
+    }
+
+    /**
+     * Start signal thread. Errors are only logged.
+     */
+    void start ();
+
+    /**
+     * Stop signal thread if it is started
+     */
+    void stop ();
+
+    /**
+     * Write latency percentiles to syslog and replace contents of file
+     * (if set)
+     * @return false if file can not be written
+     */
+    bool dump ();
+};
+
+#endif
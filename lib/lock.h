@@ -0,0 +1,69 @@
+////////////////////////////////////////////////////////////////////////////
+//  Copyright (C) 2021 by V+ Publicidad SpA                               //
+//  http://www.vmaspublicidad.com                                         //
+//                                                                        //
+////////////////////////////////////////////////////////////////////////////
+
+#ifndef VMASFS_LOCK_H
+#define VMASFS_LOCK_H
+
+#include <pthread.h>
+
+/**
+ * Scoped lock of mutex
+ */
+class MutexLock {
+private:
+    // must not be defined
+    MutexLock (const MutexLock &);
+    MutexLock &operator= (const MutexLock &);
+
+    pthread_mutex_t &m_mutex;
+public:
+    explicit MutexLock (pthread_mutex_t &mutex): m_mutex(mutex) {
+        pthread_mutex_lock(&m_mutex);
+    }
+    ~MutexLock () {
+        pthread_mutex_unlock(&m_mutex);
+    }
+};
+
+/**
+ * Scoped shared lock of reader-writer lock
+ */
+class ReadLock {
+private:
+    // must not be defined
+    ReadLock (const ReadLock &);
+    ReadLock &operator= (const ReadLock &);
+
+    pthread_rwlock_t &m_lock;
+public:
+    explicit ReadLock (pthread_rwlock_t &lock): m_lock(lock) {
+        pthread_rwlock_rdlock(&m_lock);
+    }
+    ~ReadLock () {
+        pthread_rwlock_unlock(&m_lock);
+    }
+};
+
+/**
+ * Scoped exclusive lock of reader-writer lock
+ */
+class WriteLock {
+private:
+    // must not be defined
+    WriteLock (const WriteLock &);
+    WriteLock &operator= (const WriteLock &);
+
+    pthread_rwlock_t &m_lock;
+public:
+    explicit WriteLock (pthread_rwlock_t &lock): m_lock(lock) {
+        pthread_rwlock_wrlock(&m_lock);
+    }
+    ~WriteLock () {
+        pthread_rwlock_unlock(&m_lock);
+    }
+};
+
+#endif
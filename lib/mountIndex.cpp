@@ -0,0 +1,161 @@
+////////////////////////////////////////////////////////////////////////////
+//  Copyright (C) 2021 by V+ Publicidad SpA                               //
+//  http://www.vmaspublicidad.com                                         //
+//                                                                        //
+////////////////////////////////////////////////////////////////////////////
+
+#include <fcntl.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <cstdio>
+#include <cstring>
+
+#include "mountIndex.h"
+#include "centralDirectory.h"
+
+#define INDEX_MAGIC "VMFSIDX"
+#define INDEX_VERSION (2)
+#define INDEX_SUFFIX ".vmidx"
+
+struct MountIndex::Header {
+    char magic[8];
+    zip_uint32_t version;
+    // sizeof(EntryRecord), protects from reading index of other build
+    zip_uint32_t recordSize;
+    Key key;
+    zip_uint64_t count;
+    zip_uint64_t namesSize;
+};
+
+MountIndex::MountIndex(): m_map(NULL), m_mapSize(0), m_records(NULL),
+        m_names(NULL), m_count(0) {
+}
+
+MountIndex::~MountIndex() {
+    if (m_map != NULL) {
+        munmap(m_map, m_mapSize);
+    }
+}
+
+void MountIndex::makeKey(const CentralDirectory &cd, bool readonly, Key &key) {
+    memset(&key, 0, sizeof(key));
+    key.archiveSize = cd.archiveSize();
+    key.archiveMTime = cd.archiveMTime();
+    key.cdHash = cd.hash();
+    key.flags = readonly ? READONLY : 0;
+}
+
+std::string MountIndex::path(const char *archiveName, const char *indexDir) {
+    if (indexDir[0] == '\0') {
+        return std::string(archiveName) + INDEX_SUFFIX;
+    }
+    // archives with the same base name can live in different directories
+    char absolute[PATH_MAX];
+    if (realpath(archiveName, absolute) == NULL) {
+        strncpy(absolute, archiveName, PATH_MAX - 1);
+        absolute[PATH_MAX - 1] = '\0';
+    }
+    zip_uint64_t h = 0xcbf29ce484222325ULL;
+    for (const char *p = absolute; *p; ++p) {
+        h ^= (unsigned char)*p;
+        h *= 0x100000001b3ULL;
+    }
+    const char *base = strrchr(absolute, '/');
+    base = (base == NULL) ? absolute : base + 1;
+    char suffix[32];
+    snprintf(suffix, sizeof(suffix), "-%016llx", (unsigned long long)h);
+    return std::string(indexDir) + "/" + base + suffix + INDEX_SUFFIX;
+}
+
+bool MountIndex::load(const char *fileName, const Key &key) {
+    int fd = open(fileName, O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(Header)) {
+        close(fd);
+        return false;
+    }
+    void *p = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED) {
+        return false;
+    }
+    m_map = p;
+    m_mapSize = st.st_size;
+
+    const Header *h = (const Header *)m_map;
+    if (memcmp(h->magic, INDEX_MAGIC, sizeof(h->magic)) != 0 ||
+            h->version != INDEX_VERSION ||
+            h->recordSize != sizeof(EntryRecord) ||
+            memcmp(&h->key, &key, sizeof(Key)) != 0 ||
+            h->count > (m_mapSize - sizeof(Header)) / sizeof(EntryRecord) ||
+            sizeof(Header) + h->count * sizeof(EntryRecord) + h->namesSize
+                != m_mapSize) {
+        return false;
+    }
+    m_count = h->count;
+    m_records = (const EntryRecord *)((const char *)m_map + sizeof(Header));
+    m_names = (const char *)(m_records + m_count);
+    // names table must be zero-terminated to be used as C strings
+    if (h->namesSize == 0 || m_names[h->namesSize - 1] != '\0') {
+        m_count = 0;
+        return false;
+    }
+    for (zip_uint64_t i = 0; i < m_count; ++i) {
+        if (m_records[i].nameOffset >= h->namesSize) {
+            m_count = 0;
+            return false;
+        }
+    }
+    return true;
+}
+
+bool MountIndex::save(const char *fileName, const Key &key,
+        const std::vector<EntryRecord> &records,
+        const std::vector<char> &names) {
+    Header h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, INDEX_MAGIC, sizeof(h.magic));
+    h.version = INDEX_VERSION;
+    h.recordSize = sizeof(EntryRecord);
+    memcpy(&h.key, &key, sizeof(Key));
+    h.count = records.size();
+    h.namesSize = names.size();
+
+    std::string tmpName = std::string(fileName) + ".XXXXXX";
+    int fd = mkstemp(&tmpName[0]);
+    if (fd < 0) {
+        return false;
+    }
+    fchmod(fd, 0644);
+    FILE *f = fdopen(fd, "wb");
+    if (f == NULL) {
+        close(fd);
+        unlink(tmpName.c_str());
+        return false;
+    }
+    bool ok = fwrite(&h, sizeof(h), 1, f) == 1;
+    if (ok && !records.empty()) {
+        ok = fwrite(&records[0], sizeof(EntryRecord), records.size(), f)
+            == records.size();
+    }
+    if (ok && !names.empty()) {
+        ok = fwrite(&names[0], 1, names.size(), f) == names.size();
+    }
+    if (fclose(f) != 0) {
+        ok = false;
+    }
+    if (ok) {
+        ok = rename(tmpName.c_str(), fileName) == 0;
+    }
+    if (!ok) {
+        unlink(tmpName.c_str());
+    }
+    return ok;
+}
@@ -0,0 +1,111 @@
+////////////////////////////////////////////////////////////////////////////
+//  Copyright (C) 2021 by V+ Publicidad SpA                               //
+//  http://www.vmaspublicidad.com                                         //
+//                                                                        //
+////////////////////////////////////////////////////////////////////////////
+
+#ifndef MOUNT_INDEX_H
+#define MOUNT_INDEX_H
+
+#include <zip.h>
+
+#include <string>
+#include <vector>
+
+#include "entryRecord.h"
+
+class CentralDirectory;
+
+/**
+ * Persistent mount index (sidecar file). Keeps converted names and
+ * attributes of all archive entries sorted by name, so the tree can be
+ * built on the next mount without querying libzip for every entry.
+ *
+ * File layout: header, array of EntryRecord, table of zero-terminated
+ * names. File is mapped into memory and used in place.
+ */
+class MountIndex {
+public:
+    /**
+     * Index is valid only for archive with the same key
+     */
+    struct Key {
+        zip_uint64_t archiveSize;
+        zip_int64_t archiveMTime;
+        zip_uint64_t cdHash;
+        zip_uint32_t flags;
+    };
+
+    enum {
+        // names are converted for read-only mode
+        READONLY = 1
+    };
+
+private:
+    // must not be defined
+    MountIndex (const MountIndex &);
+    MountIndex &operator= (const MountIndex &);
+
+    struct Header;
+
+    void *m_map;
+    size_t m_mapSize;
+    const EntryRecord *m_records;
+    const char *m_names;
+    zip_uint64_t m_count;
+
+public:
+    MountIndex();
+    ~MountIndex();
+
+    /**
+     * Build index key from archive central directory
+     */
+    static void makeKey(const CentralDirectory &cd, bool readonly, Key &key);
+
+    /**
+     * Get index file name for archive.
+     * @param archiveName archive file name
+     * @param indexDir directory to keep index in. If empty, index is
+     * placed next to archive.
+     */
+    static std::string path(const char *archiveName, const char *indexDir);
+
+    /**
+     * Map index file and check that it matches key.
+     * @return false if index is absent, damaged or stale
+     */
+    bool load(const char *fileName, const Key &key);
+
+    /**
+     * Write index file atomically (via temporary file and rename).
+     * @param records entry records sorted by name
+     * @param names table of zero-terminated names referenced by records
+     * @return false on error
+     */
+    static bool save(const char *fileName, const Key &key,
+            const std::vector<EntryRecord> &records,
+            const std::vector<char> &names);
+
+    inline zip_uint64_t count() const {
+        return m_count;
+    }
+
+    inline const EntryRecord *records() const {
+        return m_records;
+    }
+
+    inline const char *names() const {
+        return m_names;
+    }
+
+    inline const EntryRecord &record(zip_uint64_t i) const {
+        return m_records[i];
+    }
+
+    inline const char *name(const EntryRecord &rec) const {
+        return m_names + rec.nameOffset;
+    }
+};
+
+#endif
@@ -0,0 +1,66 @@
+////////////////////////////////////////////////////////////////////////////
+//  Copyright (C) 2021 by V+ Publicidad SpA                               //
+//  http://www.vmaspublicidad.com                                         //
+//                                                                        //
+////////////////////////////////////////////////////////////////////////////
+
+#include <cstdlib>
+#include <cstring>
+
+#include "nodeArena.h"
+
+NodeArena::NodeArena(): m_blocksSize(0), m_cur(NULL), m_end(NULL) {
+    memset(m_free, 0, sizeof(m_free));
+}
+
+NodeArena::~NodeArena() {
+    for (std::vector<char *>::iterator i = m_blocks.begin();
+            i != m_blocks.end(); ++i) {
+        free(*i);
+    }
+}
+
+void *NodeArena::allocate(size_t size) {
+    size = roundSize(size == 0 ? 1 : size);
+    if (size <= MAX_SMALL) {
+        FreeChunk *chunk = m_free[size / ALIGN];
+        if (chunk != NULL) {
+            m_free[size / ALIGN] = chunk->next;
+            return chunk;
+        }
+    }
+    if ((size_t)(m_end - m_cur) < size) {
+        // tail of previous block is wasted
+        size_t blockSize = (size > BLOCK_SIZE) ? size : BLOCK_SIZE;
+        // malloc() result is aligned for any type
+        char *block = (char *)malloc(blockSize);
+        if (block == NULL) {
+            throw std::bad_alloc();
+        }
+        try {
+            m_blocks.push_back(block);
+        }
+        catch (...) {
+            free(block);
+            throw;
+        }
+        m_blocksSize += blockSize;
+        m_cur = block;
+        m_end = block + blockSize;
+    }
+    void *res = m_cur;
+    m_cur += size;
+    return res;
+}
+
+void NodeArena::release(void *p, size_t size) {
+    if (p == NULL) {
+        return;
+    }
+    size = roundSize(size == 0 ? 1 : size);
+    if (size <= MAX_SMALL) {
+        FreeChunk *chunk = (FreeChunk *)p;
+        chunk->next = m_free[size / ALIGN];
+        m_free[size / ALIGN] = chunk;
+    }
+}
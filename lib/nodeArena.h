@@ -0,0 +1,140 @@
+////////////////////////////////////////////////////////////////////////////
+//  Copyright (C) 2021 by V+ Publicidad SpA                               //
+//  http://www.vmaspublicidad.com                                         //
+//                                                                        //
+////////////////////////////////////////////////////////////////////////////
+
+#ifndef NODE_ARENA_H
+#define NODE_ARENA_H
+
+#include <cstddef>
+#include <new>
+#include <vector>
+
+/**
+ * Mount-lifetime memory pool for file nodes, their names and child maps.
+ * Memory is taken from big blocks and returned to system only when arena
+ * is destroyed, so tree of millions nodes is freed at once instead of
+ * node-by-node. Small chunks released while mounted (nodes removed or
+ * renamed by user) are kept in free lists by size and reused.
+ */
+class NodeArena {
+private:
+    // must not be defined
+    NodeArena (const NodeArena &);
+    NodeArena &operator= (const NodeArena &);
+
+    static const size_t BLOCK_SIZE = 1024 * 1024;
+    static const size_t ALIGN = 16;
+    // bigger chunks are not reused until arena is destroyed
+    static const size_t MAX_SMALL = 512;
+
+    struct FreeChunk {
+        FreeChunk *next;
+    };
+
+    std::vector<char *> m_blocks;
+    size_t m_blocksSize;
+    char *m_cur, *m_end;
+    // free lists by chunk size divided by ALIGN
+    FreeChunk *m_free[MAX_SMALL / ALIGN + 1];
+
+    static inline size_t roundSize(size_t size) {
+        return (size + ALIGN - 1) & ~(ALIGN - 1);
+    }
+
+public:
+    NodeArena();
+    ~NodeArena();
+
+    /**
+     * Allocate memory aligned for any type
+     * @throws std::bad_alloc
+     */
+    void *allocate(size_t size);
+
+    /**
+     * Return chunk to arena for reuse. Size must be the same as passed
+     * to allocate().
+     */
+    void release(void *p, size_t size);
+
+    /**
+     * Total size of memory blocks obtained from system
+     */
+    inline size_t blocksSize() const {
+        return m_blocksSize;
+    }
+};
+
+/**
+ * STL allocator taking memory from NodeArena. Allocator without arena
+ * uses global operator new.
+ */
+template <class T>
+class ArenaAllocator {
+public:
+    typedef T value_type;
+    typedef T *pointer;
+    typedef const T *const_pointer;
+    typedef T &reference;
+    typedef const T &const_reference;
+    typedef size_t size_type;
+    typedef ptrdiff_t difference_type;
+
+    template <class U>
+    struct rebind {
+        typedef ArenaAllocator<U> other;
+    };
+
+    NodeArena *arena;
+
+    ArenaAllocator(NodeArena *a = NULL): arena(a) {}
+    template <class U>
+    ArenaAllocator(const ArenaAllocator<U> &other): arena(other.arena) {}
+
+    pointer address(reference x) const {
+        return &x;
+    }
+    const_pointer address(const_reference x) const {
+        return &x;
+    }
+
+    pointer allocate(size_type n, const void * = 0) {
+        if (arena == NULL) {
+            return (pointer)::operator new(n * sizeof(T));
+        }
+        return (pointer)arena->allocate(n * sizeof(T));
+    }
+
+    void deallocate(pointer p, size_type n) {
+        if (arena == NULL) {
+            ::operator delete(p);
+        } else {
+            arena->release(p, n * sizeof(T));
+        }
+    }
+
+    size_type max_size() const {
+        return size_t(-1) / sizeof(T);
+    }
+
+    void construct(pointer p, const T &val) {
+        new ((void *)p) T(val);
+    }
+    void destroy(pointer p) {
+        p->~T();
+    }
+};
+
+template <class T, class U>
+inline bool operator== (const ArenaAllocator<T> &a, const ArenaAllocator<U> &b) {
+    return a.arena == b.arena;
+}
+
+template <class T, class U>
+inline bool operator!= (const ArenaAllocator<T> &a, const ArenaAllocator<U> &b) {
+    return a.arena != b.arena;
+}
+
+#endif
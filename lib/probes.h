@@ -0,0 +1,42 @@
+////////////////////////////////////////////////////////////////////////////
+//  Copyright (C) 2021 by V+ Publicidad SpA                               //
+//  http://www.vmaspublicidad.com                                         //
+//                                                                        //
+////////////////////////////////////////////////////////////////////////////
+
+#ifndef PROBES_H
+#define PROBES_H
+
+/**
+ * USDT (user-level statically defined tracing) probes of provider
+ * "vmasfs" for perf, bpftrace and SystemTap. Probe is a single nop
+ * instruction unless tracer is attached to it. Probes are compiled out if
+ * <sys/sdt.h> is not available (or VMASFS_NO_USDT is defined).
+ *
+ * Probes and their arguments:
+ *  op__entry, op__return (op, name)  FUSE operation (Statistics::Op)
+ *  buffer__load__start (index, size) archive entry inflated into buffer
+ *  buffer__load__done (index, size)
+ *  chunk__alloc (size, total)        buffer chunk allocated, total is
+ *                                    memory of all buffers
+ *  save__read (buffer, offset, size) libzip reads buffer data on save
+ *  save__node__start (name, size)    changed file is passed to libzip
+ *  save__node__done (name, result)
+ */
+
+#if !defined(VMASFS_NO_USDT) && defined(__has_include)
+#if __has_include(<sys/sdt.h>)
+#include <sys/sdt.h>
+#define VMASFS_USDT
+#endif
+#endif
+
+#ifdef VMASFS_USDT
+#define VMASFS_PROBE2(name, a1, a2) DTRACE_PROBE2(vmasfs, name, a1, a2)
+#define VMASFS_PROBE3(name, a1, a2, a3) DTRACE_PROBE3(vmasfs, name, a1, a2, a3)
+#else
+#define VMASFS_PROBE2(name, a1, a2) do {} while (0)
+#define VMASFS_PROBE3(name, a1, a2, a3) do {} while (0)
+#endif
+
+#endif
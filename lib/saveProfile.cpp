@@ -0,0 +1,73 @@
+////////////////////////////////////////////////////////////////////////////
+//  Copyright (C) 2021 by V+ Publicidad SpA                               //
+//  http://www.vmaspublicidad.com                                         //
+//                                                                        //
+////////////////////////////////////////////////////////////////////////////
+
+#include <syslog.h>
+
+#include <algorithm>
+#include <map>
+
+#include "saveProfile.h"
+
+SaveProfile::SaveProfile () {
+}
+
+void SaveProfile::entrySaved (const std::string &name, zip_uint64_t bytesIn,
+        uint64_t time) {
+    Entry entry;
+    entry.name = name;
+    entry.bytesIn = bytesIn;
+    entry.bytesOut = 0;
+    entry.time = time;
+    m_entries.push_back(entry);
+}
+
+void SaveProfile::readSizes (const CentralDirectory &cd) {
+    std::map<std::string, size_t> byName;
+    for (size_t i = 0; i < m_entries.size(); ++i) {
+        byName[m_entries[i].name] = i;
+    }
+    zip_uint64_t pos = 0;
+    CentralDirectory::Entry entry;
+    while (!cd.atEnd(pos) && cd.readEntry(pos, entry)) {
+        std::map<std::string, size_t>::const_iterator i =
+            byName.find(std::string(entry.name, entry.nameLength));
+        if (i != byName.end()) {
+            m_entries[i->second].bytesOut = entry.compSize;
+        }
+    }
+}
+
+bool SaveProfile::slower (const Entry &a, const Entry &b) {
+    return a.time > b.time;
+}
+
+void SaveProfile::report (uint64_t elapsed, size_t count) {
+    if (m_entries.empty()) {
+        return;
+    }
+    zip_uint64_t bytesIn = 0, bytesOut = 0;
+    for (std::vector<Entry>::const_iterator i = m_entries.begin();
+            i != m_entries.end(); ++i) {
+        bytesIn += i->bytesIn;
+        bytesOut += i->bytesOut;
+    }
+    // bytes per microsecond are megabytes per second
+    syslog(LOG_INFO, "saved %lu files: %llu bytes in, %llu bytes out, %.1f MB/s",
+            (unsigned long)m_entries.size(), (unsigned long long)bytesIn,
+            (unsigned long long)bytesOut,
+            (elapsed == 0) ? 0.0 : bytesIn * 1000.0 / elapsed);
+
+    count = std::min(count, m_entries.size());
+    std::partial_sort(m_entries.begin(), m_entries.begin() + count,
+            m_entries.end(), slower);
+    for (size_t i = 0; i < count; ++i) {
+        const Entry &e = m_entries[i];
+        syslog(LOG_INFO, "slow save: %s: %llu ms, %llu bytes in, %llu bytes out",
+                e.name.c_str(), (unsigned long long)(e.time / 1000000),
+                (unsigned long long)e.bytesIn,
+                (unsigned long long)e.bytesOut);
+    }
+}
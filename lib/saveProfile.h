@@ -0,0 +1,71 @@
+////////////////////////////////////////////////////////////////////////////
+//  Copyright (C) 2021 by V+ Publicidad SpA                               //
+//  http://www.vmaspublicidad.com                                         //
+//                                                                        //
+////////////////////////////////////////////////////////////////////////////
+
+#ifndef SAVE_PROFILE_H
+#define SAVE_PROFILE_H
+
+#include <zip.h>
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+#include "centralDirectory.h"
+
+/**
+ * Timing of entries written by libzip when archive is closed. Data of
+ * entry is compressed and written while libzip reads it from buffer (see
+ * BigBuffer::saveToZip), so time from opening to closing of entry source
+ * is time of compression and writing of entry. Compressed sizes are not
+ * known to sources, they are read from central directory of saved
+ * archive.
+ */
+class SaveProfile {
+public:
+    struct Entry {
+        std::string name;
+        zip_uint64_t bytesIn;
+        // 0 if not known
+        zip_uint64_t bytesOut;
+        // in nanoseconds
+        uint64_t time;
+    };
+
+private:
+    // must not be defined
+    SaveProfile (const SaveProfile &);
+    SaveProfile &operator= (const SaveProfile &);
+
+    std::vector<Entry> m_entries;
+
+    static bool slower (const Entry &a, const Entry &b);
+
+public:
+    SaveProfile ();
+
+    /**
+     * Record entry written in 'time' ns from 'bytesIn' bytes of data
+     */
+    void entrySaved (const std::string &name, zip_uint64_t bytesIn,
+            uint64_t time);
+
+    inline const std::vector<Entry> &entries () const {
+        return m_entries;
+    }
+
+    /**
+     * Fill compressed sizes of recorded entries from central directory
+     */
+    void readSizes (const CentralDirectory &cd);
+
+    /**
+     * Log totals and throughput of save that took 'elapsed' ns and
+     * 'count' slowest entries to syslog
+     */
+    void report (uint64_t elapsed, size_t count);
+};
+
+#endif
@@ -0,0 +1,138 @@
+////////////////////////////////////////////////////////////////////////////
+//  Copyright (C) 2021 by V+ Publicidad SpA                               //
+//  http://www.vmaspublicidad.com                                         //
+//                                                                        //
+////////////////////////////////////////////////////////////////////////////
+
+#include <unistd.h>
+#include <syslog.h>
+#include <sys/mman.h>
+
+#include <cerrno>
+#include <cstring>
+
+#include "secureCache.h"
+#include "lock.h"
+
+/**
+ * Fill memory with zeros in a way that compiler can not optimize out
+ */
+static void wipe(char *data, size_t size) {
+    volatile char *p = data;
+    while (size-- > 0) {
+        *p++ = 0;
+    }
+}
+
+SecureCache::SecureCache (): m_capacity(0), m_maxItem(0), m_used(0),
+        m_hits(0), m_misses(0), m_lockFailed(false) {
+    pthread_mutex_init(&m_lock, NULL);
+}
+
+SecureCache::~SecureCache () {
+    clear();
+    pthread_mutex_destroy(&m_lock);
+}
+
+void SecureCache::setLimits (size_t capacity, size_t maxItem) {
+    MutexLock lock(m_lock);
+    m_capacity = capacity;
+    m_maxItem = maxItem;
+    makeRoom(0);
+}
+
+void SecureCache::release (Item &item) {
+    wipe(item.data, item.size);
+    munlock(item.data, item.mapped);
+    munmap(item.data, item.mapped);
+}
+
+void SecureCache::makeRoom (size_t size) {
+    while (!m_items.empty() && m_used + size > m_capacity) {
+        Item &item = m_items.back();
+        m_used -= item.mapped;
+        m_index.erase(item.key);
+        release(item);
+        m_items.pop_back();
+    }
+}
+
+bool SecureCache::get (uint64_t key, char *buf, size_t size) {
+    MutexLock lock(m_lock);
+    index_t::iterator i = m_index.find(key);
+    if (i == m_index.end() || i->second->size != size) {
+        ++m_misses;
+        return false;
+    }
+    ++m_hits;
+    memcpy(buf, i->second->data, size);
+    m_items.splice(m_items.begin(), m_items, i->second);
+    return true;
+}
+
+void SecureCache::put (uint64_t key, const char *data, size_t size) {
+    MutexLock lock(m_lock);
+    if (size == 0 || size > m_maxItem || m_index.find(key) != m_index.end()) {
+        return;
+    }
+    size_t page = sysconf(_SC_PAGESIZE);
+    size_t mapped = (size + page - 1) / page * page;
+    if (mapped > m_capacity) {
+        return;
+    }
+    makeRoom(mapped);
+
+    Item item;
+    item.key = key;
+    item.size = size;
+    item.mapped = mapped;
+    item.data = (char *)mmap(NULL, mapped, PROT_READ | PROT_WRITE,
+            MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (item.data == MAP_FAILED) {
+        return;
+    }
+    if (mlock(item.data, mapped) != 0) {
+        if (!m_lockFailed) {
+            syslog(LOG_WARNING, "unable to lock memory for decrypted data cache: %s",
+                    strerror(errno));
+            m_lockFailed = true;
+        }
+        munmap(item.data, mapped);
+        return;
+    }
+#ifdef MADV_DONTDUMP
+    madvise(item.data, mapped, MADV_DONTDUMP);
+#endif
+    memcpy(item.data, data, size);
+    try {
+        m_items.push_front(item);
+        try {
+            m_index[key] = m_items.begin();
+        }
+        catch (...) {
+            m_items.pop_front();
+            throw;
+        }
+    }
+    catch (...) {
+        release(item);
+        return;
+    }
+    m_used += mapped;
+}
+
+void SecureCache::clear () {
+    MutexLock lock(m_lock);
+    for (lru_t::iterator i = m_items.begin(); i != m_items.end(); ++i) {
+        release(*i);
+    }
+    m_items.clear();
+    m_index.clear();
+    m_used = 0;
+}
+
+void SecureCache::stats (uint64_t &hits, uint64_t &misses) {
+    MutexLock lock(m_lock);
+    hits = m_hits;
+    misses = m_misses;
+}
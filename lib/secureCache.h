@@ -0,0 +1,100 @@
+////////////////////////////////////////////////////////////////////////////
+//  Copyright (C) 2021 by V+ Publicidad SpA                               //
+//  http://www.vmaspublicidad.com                                         //
+//                                                                        //
+////////////////////////////////////////////////////////////////////////////
+
+#ifndef SECURE_CACHE_H
+#define SECURE_CACHE_H
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <list>
+#include <map>
+
+/**
+ * LRU cache of small secret data blocks (decrypted data of encrypted
+ * entries) by key. Every block is kept in its own locked (never swapped
+ * out, excluded from core dumps) memory mapping and is wiped when
+ * evicted or when cache is destroyed. Blocks that can not be locked (see
+ * RLIMIT_MEMLOCK) are not cached. Copies returned by get are not
+ * protected, caller is responsible for them.
+ *
+ * Cache is thread-safe.
+ */
+class SecureCache {
+private:
+    // must not be defined
+    SecureCache (const SecureCache &);
+    SecureCache &operator= (const SecureCache &);
+
+    struct Item {
+        uint64_t key;
+        char *data;
+        size_t size;
+        // size of mapping (rounded up to page size)
+        size_t mapped;
+    };
+    // most recently used items first
+    typedef std::list<Item> lru_t;
+    typedef std::map<uint64_t, lru_t::iterator> index_t;
+
+    pthread_mutex_t m_lock;
+    lru_t m_items;
+    index_t m_index;
+    size_t m_capacity, m_maxItem;
+    // total size of mappings
+    size_t m_used;
+    uint64_t m_hits, m_misses;
+    bool m_lockFailed;
+
+    /**
+     * Wipe, unlock and unmap item data (without lock)
+     */
+    static void release (Item &item);
+
+    /**
+     * Remove least recently used items until 'size' more bytes fit
+     */
+    void makeRoom (size_t size);
+
+public:
+    SecureCache ();
+    ~SecureCache ();
+
+    /**
+     * Set total size of cached blocks (in bytes, 0 disables cache) and
+     * maximal size of one block
+     */
+    void setLimits (size_t capacity, size_t maxItem);
+
+    inline bool isEnabled () const {
+        return m_capacity != 0;
+    }
+
+    /**
+     * Copy cached block of exactly 'size' bytes to 'buf'
+     * @return false if block is not cached
+     */
+    bool get (uint64_t key, char *buf, size_t size);
+
+    /**
+     * Cache copy of data block (ignored if it is bigger than block size
+     * limit or memory can not be locked)
+     */
+    void put (uint64_t key, const char *data, size_t size);
+
+    /**
+     * Wipe and remove all blocks
+     */
+    void clear ();
+
+    /**
+     * Number of cache hits and misses
+     */
+    void stats (uint64_t &hits, uint64_t &misses);
+};
+
+#endif
@@ -0,0 +1,147 @@
+////////////////////////////////////////////////////////////////////////////
+//  Copyright (C) 2021 by V+ Publicidad SpA                               //
+//  http://www.vmaspublicidad.com                                         //
+//                                                                        //
+////////////////////////////////////////////////////////////////////////////
+
+#include <time.h>
+
+#include <cstdio>
+#include <cstring>
+
+#include "statistics.h"
+
+Statistics Statistics::global;
+
+const char *const Statistics::OP_NAMES[OP_COUNT] = {
+    "lookup",
+    "getattr",
+    "setattr",
+    "readlink",
+    "mkdir",
+    "unlink",
+    "rmdir",
+    "symlink",
+    "rename",
+    "open",
+    "read",
+    "write",
+    "release",
+    "opendir",
+    "readdir",
+    "statfs",
+    "create"
+};
+
+const int Statistics::LATENCY_BUCKETS;
+
+Statistics::Statistics (): m_timing(false) {
+    memset(m_ops, 0, sizeof(m_ops));
+    m_inflateBytes = m_inflateTime = 0;
+    m_deflateBytes = m_deflateTime = 0;
+    m_bufferBytes = m_bufferPeak = 0;
+    m_dirtyNodes = 0;
+}
+
+uint64_t Statistics::now () {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+void Statistics::timed (Op op, uint64_t time) {
+    OpCounters &c = m_ops[op];
+    // index of the highest bit set
+    int bucket = (time == 0) ? 0 : 63 - __builtin_clzll(time);
+    add(c.latency[bucket], 1);
+    add(c.totalTime, time);
+    uint64_t max = load(c.maxTime);
+    while (time > max && !__atomic_compare_exchange_n(&c.maxTime, &max,
+                time, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+    }
+}
+
+uint64_t Statistics::percentile (Op op, double fraction) const {
+    const OpCounters &c = m_ops[op];
+    uint64_t counts[LATENCY_BUCKETS];
+    uint64_t total = 0;
+    for (int i = 0; i < LATENCY_BUCKETS; ++i) {
+        counts[i] = load(c.latency[i]);
+        total += counts[i];
+    }
+    if (total == 0) {
+        return 0;
+    }
+    // number of calls that must complete within returned latency
+    uint64_t need = (uint64_t)(fraction * total);
+    if (need == 0) {
+        need = 1;
+    }
+    uint64_t seen = 0;
+    for (int i = 0; i < LATENCY_BUCKETS; ++i) {
+        seen += counts[i];
+        if (seen >= need) {
+            // the longest call is more precise than the bucket bound
+            uint64_t bound = (i == LATENCY_BUCKETS - 1) ?
+                ~(uint64_t)0 : ((uint64_t)2 << i) - 1;
+            uint64_t max = load(c.maxTime);
+            return (max < bound) ? max : bound;
+        }
+    }
+    return load(c.maxTime);
+}
+
+void Statistics::printLatency (std::string &out) const {
+    static const double FRACTIONS[] = { 0.5, 0.9, 0.99, 0.999 };
+    static const char *const NAMES[] = { "p50", "p90", "p99", "p999" };
+    char line[256];
+    for (int op = 0; op < OP_COUNT; ++op) {
+        const OpCounters &c = m_ops[op];
+        uint64_t timed = 0;
+        for (int i = 0; i < LATENCY_BUCKETS; ++i) {
+            timed += load(c.latency[i]);
+        }
+        if (timed == 0) {
+            continue;
+        }
+        int len = snprintf(line, sizeof(line), "%-8s n=%llu avg=%llu",
+                OP_NAMES[op], (unsigned long long)timed,
+                (unsigned long long)(load(c.totalTime) / timed));
+        for (int i = 0; i < 4; ++i) {
+            len += snprintf(line + len, sizeof(line) - len, " %s=%llu",
+                    NAMES[i], (unsigned long long)
+                    percentile((Op)op, FRACTIONS[i]));
+        }
+        snprintf(line + len, sizeof(line) - len, " max=%llu ns\n",
+                (unsigned long long)load(c.maxTime));
+        out.append(line);
+    }
+}
+
+void Statistics::printValue (std::string &out, const char *name,
+        unsigned long long value) {
+    char line[128];
+    snprintf(line, sizeof(line), "%s %llu\n", name, value);
+    out.append(line);
+}
+
+void Statistics::print (std::string &out) const {
+    char name[64];
+    for (int op = 0; op < OP_COUNT; ++op) {
+        snprintf(name, sizeof(name), "op.%s.calls", OP_NAMES[op]);
+        printValue(out, name, load(m_ops[op].calls));
+        if (op == READ || op == WRITE) {
+            snprintf(name, sizeof(name), "op.%s.bytes", OP_NAMES[op]);
+            printValue(out, name, load(m_ops[op].bytes));
+        }
+    }
+    printValue(out, "inflate.bytes", load(m_inflateBytes));
+    printValue(out, "inflate.usec", load(m_inflateTime) / 1000);
+    printValue(out, "deflate.bytes", load(m_deflateBytes));
+    printValue(out, "deflate.usec", load(m_deflateTime) / 1000);
+    int64_t buffers = load(m_bufferBytes);
+    printValue(out, "buffer.bytes", buffers < 0 ? 0 : buffers);
+    printValue(out, "buffer.peak_bytes", load(m_bufferPeak));
+    int64_t dirty = load(m_dirtyNodes);
+    printValue(out, "nodes.dirty", dirty < 0 ? 0 : dirty);
+}
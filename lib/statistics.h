@@ -0,0 +1,275 @@
+////////////////////////////////////////////////////////////////////////////
+//  Copyright (C) 2021 by V+ Publicidad SpA                               //
+//  http://www.vmaspublicidad.com                                         //
+//                                                                        //
+////////////////////////////////////////////////////////////////////////////
+
+#ifndef STATISTICS_H
+#define STATISTICS_H
+
+#include <stdint.h>
+
+#include <string>
+
+#include "probes.h"
+#include "traceLog.h"
+
+/**
+ * Process-wide activity counters shown in statistics pseudo-file (see
+ * VmasFSData::enableStats). Counters are updated with relaxed atomic
+ * operations without locks; counters of every operation are kept in
+ * their own cache lines, so threads executing different operations do
+ * not contend. Values read while operations are in progress are not
+ * necessarily consistent with each other.
+ *
+ * If timing is enabled, latencies of operations (see OpTimer) are counted
+ * in histograms with power-of-two buckets: bucket N holds latencies from
+ * 2^N to 2^(N+1)-1 nanoseconds.
+ */
+class Statistics {
+public:
+    /**
+     * File system operations (the same for both frontends)
+     */
+    enum Op {
+        LOOKUP,
+        GETATTR,
+        SETATTR,
+        READLINK,
+        MKDIR,
+        UNLINK,
+        RMDIR,
+        SYMLINK,
+        RENAME,
+        OPEN,
+        READ,
+        WRITE,
+        RELEASE,
+        OPENDIR,
+        READDIR,
+        STATFS,
+        CREATE,
+        OP_COUNT
+    };
+
+    static Statistics global;
+
+    static const int LATENCY_BUCKETS = 64;
+
+private:
+    // must not be defined
+    Statistics (const Statistics &);
+    Statistics &operator= (const Statistics &);
+
+    static const char *const OP_NAMES[OP_COUNT];
+
+    struct OpCounters {
+        uint64_t calls;
+        uint64_t bytes;
+        // the longest and total time of timed calls (in ns)
+        uint64_t maxTime;
+        uint64_t totalTime;
+        uint64_t latency[LATENCY_BUCKETS];
+    } __attribute__((aligned(64)));
+
+    bool m_timing;
+
+    OpCounters m_ops[OP_COUNT];
+    // data read from archive via libzip (decompressed and decrypted)
+    uint64_t m_inflateBytes __attribute__((aligned(64)));
+    uint64_t m_inflateTime;
+    // data passed to libzip while archive is written
+    uint64_t m_deflateBytes __attribute__((aligned(64)));
+    uint64_t m_deflateTime;
+    // memory of BigBuffer chunks and its highest value
+    int64_t m_bufferBytes __attribute__((aligned(64)));
+    int64_t m_bufferPeak;
+    // nodes with data not yet saved to archive
+    int64_t m_dirtyNodes __attribute__((aligned(64)));
+
+    static inline void add (uint64_t &counter, uint64_t value) {
+        __atomic_add_fetch(&counter, value, __ATOMIC_RELAXED);
+    }
+    static inline void add (int64_t &counter, int64_t value) {
+        __atomic_add_fetch(&counter, value, __ATOMIC_RELAXED);
+    }
+    template <typename T>
+    static inline T load (const T &counter) {
+        return __atomic_load_n(&counter, __ATOMIC_RELAXED);
+    }
+
+public:
+    Statistics ();
+
+    /**
+     * Name of operation shown in statistics
+     */
+    static inline const char *opName (Op op) {
+        return OP_NAMES[op];
+    }
+
+    /**
+     * Monotonic time in nanoseconds
+     */
+    static uint64_t now ();
+
+    /**
+     * Count call of operation transferring 'bytes' bytes
+     */
+    inline void count (Op op, uint64_t bytes = 0) {
+        add(m_ops[op].calls, 1);
+        transferred(op, bytes);
+    }
+
+    /**
+     * Count 'bytes' bytes transferred by operation already counted
+     */
+    inline void transferred (Op op, uint64_t bytes) {
+        if (bytes != 0) {
+            add(m_ops[op].bytes, bytes);
+        }
+    }
+
+    /**
+     * Enable or disable timing of operations (may be changed while
+     * operations are in progress)
+     */
+    inline void setTiming (bool enabled) {
+        __atomic_store_n(&m_timing, enabled, __ATOMIC_RELAXED);
+    }
+
+    inline bool timing () const {
+        return __atomic_load_n(&m_timing, __ATOMIC_RELAXED);
+    }
+
+    /**
+     * Count operation latency in histogram
+     */
+    void timed (Op op, uint64_t time);
+
+    /**
+     * Append latency percentiles of timed operations to 'out', one line
+     * per operation: name, number of timed calls, average, p50, p90, p99,
+     * p99.9 and max latency in nanoseconds. Percentiles are upper bounds
+     * of histogram buckets (or max latency if it is less).
+     */
+    void printLatency (std::string &out) const;
+
+    /**
+     * Count 'bytes' bytes of entry data read via libzip in 'time' ns
+     */
+    inline void inflated (uint64_t bytes, uint64_t time) {
+        add(m_inflateBytes, bytes);
+        add(m_inflateTime, time);
+    }
+
+    /**
+     * Count 'bytes' bytes of entry data written to archive in 'time' ns
+     */
+    inline void deflated (uint64_t bytes, uint64_t time) {
+        add(m_deflateBytes, bytes);
+        add(m_deflateTime, time);
+    }
+
+    /**
+     * Account allocated (positive) or freed (negative) buffer memory
+     * @return buffer memory after change
+     */
+    inline int64_t bufferAllocated (int64_t bytes) {
+        int64_t total = __atomic_add_fetch(&m_bufferBytes, bytes,
+                __ATOMIC_RELAXED);
+        if (bytes > 0) {
+            int64_t peak = load(m_bufferPeak);
+            while (total > peak && !__atomic_compare_exchange_n(&m_bufferPeak,
+                        &peak, total, true, __ATOMIC_RELAXED,
+                        __ATOMIC_RELAXED)) {
+            }
+        }
+        return total;
+    }
+
+    inline int64_t bufferBytes () const {
+        return load(m_bufferBytes);
+    }
+
+    /**
+     * Account nodes becoming dirty (positive) or clean or deleted
+     * (negative)
+     */
+    inline void dirtyChanged (int64_t count) {
+        add(m_dirtyNodes, count);
+    }
+
+    inline uint64_t calls (Op op) const {
+        return load(m_ops[op].calls);
+    }
+
+    /**
+     * Upper bound of latency (in ns) below which 'fraction' of timed
+     * calls of operation completed, 0 if there were no timed calls
+     */
+    uint64_t percentile (Op op, double fraction) const;
+
+    inline int64_t dirtyNodes () const {
+        return load(m_dirtyNodes);
+    }
+
+    /**
+     * Append counters in "name value" lines to 'out'
+     */
+    void print (std::string &out) const;
+
+    /**
+     * Append "name value" line to 'out'
+     */
+    static void printValue (std::string &out, const char *name,
+            unsigned long long value);
+};
+
+/**
+ * Counts operation call in global statistics and measures its duration
+ * (from construction to destruction) if timing or tracing is enabled
+ */
+class OpTimer {
+private:
+    // must not be defined
+    OpTimer (const OpTimer &);
+    OpTimer &operator= (const OpTimer &);
+
+    Statistics::Op m_op;
+    // 0 if operation is not timed
+    uint64_t m_started;
+    uint64_t m_bytes;
+
+public:
+    explicit OpTimer (Statistics::Op op): m_op(op),
+            m_started((Statistics::global.timing() ||
+                        TraceLog::global.isEnabled()) ? Statistics::now() : 0),
+            m_bytes(0) {
+        VMASFS_PROBE2(op__entry, (int)op, Statistics::opName(op));
+        Statistics::global.count(op);
+    }
+
+    ~OpTimer () {
+        VMASFS_PROBE2(op__return, (int)m_op, Statistics::opName(m_op));
+        if (m_started == 0) {
+            return;
+        }
+        uint64_t elapsed = Statistics::now() - m_started;
+        if (Statistics::global.timing()) {
+            Statistics::global.timed(m_op, elapsed);
+        }
+        TraceLog::global.complete("fuse", Statistics::opName(m_op),
+                m_started, elapsed, m_bytes);
+    }
+
+    /**
+     * Count bytes read or written by operation
+     */
+    inline void transferred (uint64_t bytes) {
+        Statistics::global.transferred(m_op, bytes);
+        m_bytes += bytes;
+    }
+};
+
+#endif
@@ -0,0 +1,239 @@
+////////////////////////////////////////////////////////////////////////////
+//  Copyright (C) 2021 by V+ Publicidad SpA                               //
+//  http://www.vmaspublicidad.com                                         //
+//                                                                        //
+////////////////////////////////////////////////////////////////////////////
+
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <syslog.h>
+#include <sys/syscall.h>
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <new>
+
+#include "traceLog.h"
+#include "lock.h"
+
+TraceLog TraceLog::global;
+
+const unsigned int TraceLog::RING_SIZE;
+const unsigned int TraceLog::FLUSH_INTERVAL;
+
+TraceLog::TraceLog (): m_enabled(false), m_fd(-1), m_rings(NULL),
+        m_dropped(0), m_started(false), m_stopping(false) {
+    pthread_mutex_init(&m_lock, NULL);
+    pthread_cond_init(&m_stop, NULL);
+}
+
+TraceLog::~TraceLog () {
+    stop();
+    while (m_rings != NULL) {
+        Ring *r = m_rings;
+        m_rings = r->next;
+        delete r;
+    }
+    pthread_cond_destroy(&m_stop);
+    pthread_mutex_destroy(&m_lock);
+}
+
+bool TraceLog::open (const char *fileName) {
+    m_fd = ::open(fileName, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (m_fd == -1) {
+        syslog(LOG_ERR, "unable to open trace file %s: %s", fileName,
+                strerror(errno));
+        return false;
+    }
+    int err = pthread_key_create(&m_key, releaseRing);
+    if (err != 0) {
+        syslog(LOG_ERR, "unable to create thread key: %s", strerror(err));
+        ::close(m_fd);
+        m_fd = -1;
+        return false;
+    }
+    write("[\n", 2);
+    m_enabled = true;
+    return true;
+}
+
+void TraceLog::start () {
+    if (!m_enabled) {
+        return;
+    }
+    m_stopping = false;
+    int err = pthread_create(&m_thread, NULL, threadMain, this);
+    if (err != 0) {
+        syslog(LOG_WARNING, "unable to start trace thread: %s",
+                strerror(err));
+        return;
+    }
+    m_started = true;
+}
+
+void TraceLog::stop () {
+    if (!m_enabled) {
+        return;
+    }
+    if (m_started) {
+        {
+            MutexLock lock(m_lock);
+            m_stopping = true;
+            pthread_cond_signal(&m_stop);
+        }
+        pthread_join(m_thread, NULL);
+        m_started = false;
+    }
+    m_enabled = false;
+    flush();
+    // array is closed by event without trailing comma
+    char footer[128];
+    int len = snprintf(footer, sizeof(footer),
+            "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":0,"
+            "\"args\":{\"name\":\"vmas-fs\"}}\n]\n", (int)getpid());
+    write(footer, len);
+    if (m_fd != -1) {
+        ::close(m_fd);
+        m_fd = -1;
+    }
+    pthread_key_delete(m_key);
+    uint64_t dropped = __atomic_load_n(&m_dropped, __ATOMIC_RELAXED);
+    if (dropped != 0) {
+        syslog(LOG_WARNING, "trace: %llu events dropped",
+                (unsigned long long)dropped);
+    }
+}
+
+TraceLog::Ring *TraceLog::ring () {
+    Ring *r = (Ring *)pthread_getspecific(m_key);
+    if (r != NULL) {
+        return r;
+    }
+    // reuse ring of exited thread
+    for (r = __atomic_load_n(&m_rings, __ATOMIC_ACQUIRE); r != NULL;
+            r = r->next) {
+        bool owned = false;
+        if (__atomic_compare_exchange_n(&r->owned, &owned, true, false,
+                    __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+            break;
+        }
+    }
+    if (r == NULL) {
+        r = new (std::nothrow) Ring;
+        if (r == NULL) {
+            return NULL;
+        }
+        r->head = r->tail = 0;
+        r->owned = true;
+        r->next = __atomic_load_n(&m_rings, __ATOMIC_RELAXED);
+        while (!__atomic_compare_exchange_n(&m_rings, &r->next, r, true,
+                    __ATOMIC_RELEASE, __ATOMIC_RELAXED)) {
+        }
+    }
+    r->tid = syscall(SYS_gettid);
+    pthread_setspecific(m_key, r);
+    return r;
+}
+
+void TraceLog::releaseRing (void *ring) {
+    __atomic_store_n(&((Ring *)ring)->owned, false, __ATOMIC_RELEASE);
+}
+
+void TraceLog::complete (const char *category, const char *name,
+        uint64_t start, uint64_t duration, uint64_t bytes) {
+    if (!m_enabled) {
+        return;
+    }
+    Ring *r = ring();
+    uint64_t head = (r == NULL) ? 0 : r->head;
+    if (r == NULL ||
+            head - __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE) >= RING_SIZE) {
+        __atomic_add_fetch(&m_dropped, 1, __ATOMIC_RELAXED);
+        return;
+    }
+    Event &e = r->events[head % RING_SIZE];
+    e.category = category;
+    e.name = name;
+    e.start = start;
+    e.duration = duration;
+    e.bytes = bytes;
+    e.tid = r->tid;
+    __atomic_store_n(&r->head, head + 1, __ATOMIC_RELEASE);
+}
+
+void *TraceLog::threadMain (void *log) {
+    ((TraceLog *)log)->work();
+    return NULL;
+}
+
+void TraceLog::work () {
+    MutexLock lock(m_lock);
+    while (!m_stopping) {
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_nsec += FLUSH_INTERVAL * 1000000L;
+        deadline.tv_sec += deadline.tv_nsec / 1000000000L;
+        deadline.tv_nsec %= 1000000000L;
+        pthread_cond_timedwait(&m_stop, &m_lock, &deadline);
+        pthread_mutex_unlock(&m_lock);
+        flush();
+        pthread_mutex_lock(&m_lock);
+    }
+}
+
+void TraceLog::flush () {
+    char line[256];
+    int pid = getpid();
+    for (Ring *r = __atomic_load_n(&m_rings, __ATOMIC_ACQUIRE); r != NULL;
+            r = r->next) {
+        uint64_t head = __atomic_load_n(&r->head, __ATOMIC_ACQUIRE);
+        uint64_t tail = r->tail;
+        for (; tail != head; ++tail) {
+            const Event &e = r->events[tail % RING_SIZE];
+            // timestamps and durations are in microseconds
+            int len = snprintf(line, sizeof(line),
+                    "{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\","
+                    "\"pid\":%d,\"tid\":%d,\"ts\":%llu.%03u,"
+                    "\"dur\":%llu.%03u", e.name, e.category, pid, e.tid,
+                    (unsigned long long)(e.start / 1000),
+                    (unsigned int)(e.start % 1000),
+                    (unsigned long long)(e.duration / 1000),
+                    (unsigned int)(e.duration % 1000));
+            if (e.bytes != 0) {
+                len += snprintf(line + len, sizeof(line) - len,
+                        ",\"args\":{\"bytes\":%llu}",
+                        (unsigned long long)e.bytes);
+            }
+            snprintf(line + len, sizeof(line) - len, "},\n");
+            try {
+                m_text.append(line);
+            }
+            catch (const std::bad_alloc &) {
+                __atomic_add_fetch(&m_dropped, 1, __ATOMIC_RELAXED);
+            }
+        }
+        __atomic_store_n(&r->tail, tail, __ATOMIC_RELEASE);
+    }
+    write(m_text.data(), m_text.size());
+    m_text.clear();
+}
+
+void TraceLog::write (const char *data, size_t size) {
+    while (size > 0 && m_fd != -1) {
+        ssize_t nw = ::write(m_fd, data, size);
+        if (nw < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            syslog(LOG_ERR, "unable to write trace file: %s",
+                    strerror(errno));
+            ::close(m_fd);
+            m_fd = -1;
+            return;
+        }
+        data += nw;
+        size -= nw;
+    }
+}
@@ -0,0 +1,131 @@
+////////////////////////////////////////////////////////////////////////////
+//  Copyright (C) 2021 by V+ Publicidad SpA                               //
+//  http://www.vmaspublicidad.com                                         //
+//                                                                        //
+////////////////////////////////////////////////////////////////////////////
+
+#ifndef TRACE_LOG_H
+#define TRACE_LOG_H
+
+#include <pthread.h>
+#include <stdint.h>
+
+#include <string>
+
+/**
+ * Log of file system activity in Chrome trace event format (JSON array of
+ * complete events), it can be loaded into Perfetto or chrome://tracing.
+ *
+ * Every thread records events into its own ring buffer without locks:
+ * only the owning thread writes events and only flusher thread reads
+ * them. Flusher thread periodically writes events to file. If ring is
+ * full, event is dropped and counted. Rings of exited threads are reused
+ * by new threads.
+ *
+ * File is opened by open() before process is daemonized, flusher thread
+ * is started by start() after that and stopped by stop() when everything
+ * (including archive save) is done.
+ */
+class TraceLog {
+private:
+    // must not be defined
+    TraceLog (const TraceLog &);
+    TraceLog &operator= (const TraceLog &);
+
+    struct Event {
+        // static strings
+        const char *category;
+        const char *name;
+        // monotonic time in ns
+        uint64_t start;
+        uint64_t duration;
+        // bytes processed, not shown if 0
+        uint64_t bytes;
+        int tid;
+    };
+
+    static const unsigned int RING_SIZE = 4096;
+    // flush period in milliseconds
+    static const unsigned int FLUSH_INTERVAL = 200;
+
+    struct Ring {
+        Event events[RING_SIZE];
+        // written by owning thread, read by flusher
+        uint64_t head;
+        // written by flusher, read by owning thread
+        uint64_t tail;
+        // ring belongs to running thread
+        bool owned;
+        // owner thread ID
+        int tid;
+        Ring *next;
+    };
+
+    bool m_enabled;
+    int m_fd;
+    // list of rings, new rings are pushed to front
+    Ring *m_rings;
+    pthread_key_t m_key;
+    uint64_t m_dropped;
+    // JSON text of events not yet written (used by flusher only)
+    std::string m_text;
+
+    pthread_t m_thread;
+    bool m_started;
+    pthread_mutex_t m_lock;
+    pthread_cond_t m_stop;
+    bool m_stopping;
+
+    /**
+     * Ring of calling thread, NULL if there is no memory for it
+     */
+    Ring *ring ();
+    static void releaseRing (void *ring);
+
+    static void *threadMain (void *log);
+    void work ();
+
+    /**
+     * Write events from all rings to file
+     */
+    void flush ();
+    void write (const char *data, size_t size);
+
+public:
+    static TraceLog global;
+
+    TraceLog ();
+    ~TraceLog ();
+
+    /**
+     * Create (or truncate) trace file and enable recording of events.
+     * Errors are logged to syslog.
+     * @return false if file can not be created
+     */
+    bool open (const char *fileName);
+
+    inline bool isEnabled () const {
+        return m_enabled;
+    }
+
+    /**
+     * Start flusher thread. Errors are only logged, events are written
+     * by stop() then.
+     */
+    void start ();
+
+    /**
+     * Stop flusher thread, write remaining events and close file
+     */
+    void stop ();
+
+    /**
+     * Record complete event of calling thread that started at 'start'
+     * (see Statistics::now()) and lasted 'duration' ns. 'category' and
+     * 'name' must be static strings without characters escaped in JSON.
+     */
+    void complete (const char *category, const char *name, uint64_t start,
+            uint64_t duration, uint64_t bytes = 0);
+};
+
+#endif
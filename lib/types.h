@@ -11,9 +11,10 @@
 
 #include <cstring>
 #include <cstdlib>
-#include <list>
 #include <map>
 
+#include "nodeArena.h"
+
 class FileNode;
 class VmasFSData;
 
@@ -23,8 +24,9 @@ struct ltstr {
     }
 };
 
-typedef std::list <FileNode*> nodelist_t;
-typedef std::map <const char*, FileNode*, ltstr> filemap_t;
+// child nodes by short name, map nodes are allocated from arena of parent
+typedef std::map <const char*, FileNode*, ltstr,
+        ArenaAllocator<std::pair<const char* const, FileNode*> > > filemap_t;
 
 #endif
 
@@ -0,0 +1,868 @@
+////////////////////////////////////////////////////////////////////////////
+//  Copyright (C) 2021 by V+ Publicidad SpA                               //
+//  http://www.vmaspublicidad.com                                         //
+//                                                                        //
+////////////////////////////////////////////////////////////////////////////
+
+#include "../config.h"
+
+#include <fuse_lowlevel.h>
+#include <zip.h>
+#include <unistd.h>
+#include <syslog.h>
+#include <sys/types.h>
+#include <sys/statvfs.h>
+#include <fcntl.h>
+
+#include <cerrno>
+#include <cstring>
+#include <cstdlib>
+#include <ctime>
+#include <new>
+#include <stdexcept>
+#include <string>
+
+#include "vmas-fs-ll.h"
+#include "types.h"
+#include "fileNode.h"
+#include "vmasFSData.h"
+#include "dirCursor.h"
+#include "fileHandle.h"
+#include "statistics.h"
+#include "traceLog.h"
+
+#ifndef RENAME_NOREPLACE
+#define RENAME_NOREPLACE (1 << 0)
+#endif
+
+static inline VmasFSData *get_data(fuse_req_t req) {
+    return (VmasFSData*)fuse_req_userdata(req);
+}
+
+/**
+ * Get node by inode number. Inode number is node address except root
+ * that has fixed number.
+ */
+static inline FileNode *get_node(fuse_req_t req, fuse_ino_t ino) {
+    if (ino == FUSE_ROOT_ID) {
+        return get_data(req)->root();
+    }
+    return (FileNode*)ino;
+}
+
+/**
+ * Fill entry for node. Caller must hold tree lock.
+ */
+static void fill_entry(VmasFSData *data, FileNode *node,
+        struct fuse_entry_param *e) {
+    memset(e, 0, sizeof(struct fuse_entry_param));
+    e->ino = (fuse_ino_t)node;
+    e->generation = data->generation();
+    data->getAttr(node, &e->attr);
+    e->attr_timeout = data->m_attrTimeout;
+    e->entry_timeout = data->m_entryTimeout;
+}
+
+/**
+ * Fill entry for node and count lookup. Caller must hold tree lock.
+ */
+static void make_entry(VmasFSData *data, FileNode *node,
+        struct fuse_entry_param *e) {
+    fill_entry(data, node, e);
+    __atomic_add_fetch(&node->nlookup, 1, __ATOMIC_ACQ_REL);
+}
+
+/**
+ * Find child of directory. Caller must hold tree lock.
+ * @return 0 or error code
+ */
+static int find_child(VmasFSData *data, FileNode *dir, const char *name,
+        FileNode *&node) {
+    if (!dir->is_dir) {
+        return ENOTDIR;
+    }
+    data->loadChilds(dir);
+    node = data->findChild(dir, name);
+    return (node == NULL) ? ENOENT : 0;
+}
+
+/**
+ * Check that there is no child with name in directory. Caller must hold
+ * tree lock.
+ * @return 0 or error code
+ */
+static int check_new_child(VmasFSData *data, FileNode *dir,
+        const char *name) {
+    if (data->isVirtual(dir)) {
+        return EACCES;
+    }
+    FileNode *node;
+    int res = find_child(data, dir, name, node);
+    if (res == 0) {
+        return EEXIST;
+    }
+    return (res == ENOENT) ? 0 : res;
+}
+
+void vmasfs_ll_init(void *userdata, struct fuse_conn_info *conn) {
+    VmasFSData *data = (VmasFSData*)userdata;
+#if FUSE_USE_VERSION >= 30
+    // kernel keeps written data and file size until pages are written back
+    if (data->m_writebackCache && (conn->capable & FUSE_CAP_WRITEBACK_CACHE)) {
+        conn->want |= FUSE_CAP_WRITEBACK_CACHE;
+    }
+    // must be the same as max_read mount option
+    conn->max_read = data->m_maxRead;
+#elif FUSE_VERSION >= 28
+    // without big writes kernel sends data by pages
+    if (conn->capable & FUSE_CAP_BIG_WRITES) {
+        conn->want |= FUSE_CAP_BIG_WRITES;
+    }
+#endif
+    // library proposes the largest sizes it and kernel support, they
+    // can be only reduced
+    if (data->m_maxWrite != 0 && data->m_maxWrite < conn->max_write) {
+        conn->max_write = data->m_maxWrite;
+    }
+    if (data->m_maxReadahead != 0 && data->m_maxReadahead < conn->max_readahead) {
+        conn->max_readahead = data->m_maxReadahead;
+    }
+    // process is already daemonized, so threads can be started
+    data->startIO();
+    data->startLatencyDumper();
+    TraceLog::global.start();
+    syslog(LOG_INFO, "Mounting file system on %s (cwd=%s)", data->m_archiveName, data->m_cwd.c_str());
+}
+
+void vmasfs_ll_destroy(void *userdata) {
+    VmasFSData *data = (VmasFSData*)userdata;
+    data->save ();
+    delete data;
+    // archive save is traced too
+    TraceLog::global.stop();
+    syslog(LOG_INFO, "File system unmounted");
+}
+
+void vmasfs_ll_lookup(fuse_req_t req, fuse_ino_t parent, const char *name) {
+    OpTimer timer(Statistics::LOOKUP);
+    VmasFSData *data = get_data(req);
+    ReadLock lock(data->treeLock());
+    FileNode *node;
+    int res = find_child(data, get_node(req, parent), name, node);
+    if (res != 0) {
+        fuse_reply_err(req, res);
+        return;
+    }
+    struct fuse_entry_param e;
+    make_entry(data, node, &e);
+    fuse_reply_entry(req, &e);
+}
+
+/**
+ * Drop kernel references to node and delete node if it is orphan
+ */
+static void forget_node(VmasFSData *data, fuse_ino_t ino, uint64_t nlookup) {
+    if (ino == FUSE_ROOT_ID) {
+        return;
+    }
+    FileNode *node = (FileNode*)ino;
+    bool orphan;
+    {
+        // node can't become orphan while tree lock is held, and only
+        // one thread sees lookup count of orphan dropped to zero
+        ReadLock lock(data->treeLock());
+        orphan = __atomic_sub_fetch(&node->nlookup, nlookup,
+                __ATOMIC_ACQ_REL) == 0 && data->isOrphan(node);
+    }
+    if (orphan) {
+        WriteLock lock(data->treeLock());
+        data->deleteOrphan(node);
+    }
+}
+
+void vmasfs_ll_forget(fuse_req_t req, fuse_ino_t ino, unsigned long nlookup) {
+    forget_node(get_data(req), ino, nlookup);
+    fuse_reply_none(req);
+}
+
+#if FUSE_VERSION >= 29
+void vmasfs_ll_forget_multi(fuse_req_t req, size_t count,
+        struct fuse_forget_data *forgets) {
+    for (size_t i = 0; i < count; ++i) {
+        forget_node(get_data(req), forgets[i].ino, forgets[i].nlookup);
+    }
+    fuse_reply_none(req);
+}
+#endif
+
+void vmasfs_ll_getattr(fuse_req_t req, fuse_ino_t ino,
+        struct fuse_file_info *fi) {
+    (void) fi;
+    OpTimer timer(Statistics::GETATTR);
+    VmasFSData *data = get_data(req);
+    struct stat st;
+    {
+        ReadLock lock(data->treeLock());
+        data->getAttr(get_node(req, ino), &st);
+    }
+    fuse_reply_attr(req, &st, data->m_attrTimeout);
+}
+
+/**
+ * Change file size. Caller must hold node lock.
+ * @param opened file is opened by caller
+ * @return 0 or error code
+ */
+static int truncate_node(VmasFSData *data, FileNode *node, off_t size,
+        bool opened) {
+    if (node->is_dir) {
+        return EISDIR;
+    }
+    int res;
+    if (opened) {
+        if ((res = data->loadNode(node)) != 0) {
+            return -res;
+        }
+        return node->truncate(size);
+    }
+    if ((res = node->open()) != 0) {
+        return -res;
+    }
+    if ((res = data->loadNode(node)) != 0) {
+        node->close();
+        return -res;
+    }
+    if ((res = node->truncate(size)) != 0) {
+        node->close();
+        return res;
+    }
+    return -node->close();
+}
+
+void vmasfs_ll_setattr(fuse_req_t req, fuse_ino_t ino, struct stat *attr,
+        int to_set, struct fuse_file_info *fi) {
+    OpTimer timer(Statistics::SETATTR);
+    VmasFSData *data = get_data(req);
+    FileNode *node = get_node(req, ino);
+    if (data->isVirtual(node)) {
+        fuse_reply_err(req, EACCES);
+        return;
+    }
+    // file data may be read from archive, so tree is not locked
+    if (to_set & FUSE_SET_ATTR_SIZE) {
+        MutexLock nodeLock(data->nodeLock(node));
+        int res = truncate_node(data, node, attr->st_size, fi != NULL);
+        if (res != 0) {
+            fuse_reply_err(req, res);
+            return;
+        }
+    }
+    WriteLock lock(data->treeLock());
+    {
+        MutexLock nodeLock(data->nodeLock(node));
+        if (to_set & FUSE_SET_ATTR_MODE) {
+            node->chmod(attr->st_mode);
+        }
+        if (to_set & FUSE_SET_ATTR_UID) {
+            node->setUid(attr->st_uid);
+        }
+        if (to_set & FUSE_SET_ATTR_GID) {
+            node->setGid(attr->st_gid);
+        }
+        if (to_set & (FUSE_SET_ATTR_ATIME | FUSE_SET_ATTR_MTIME |
+                    FUSE_SET_ATTR_ATIME_NOW | FUSE_SET_ATTR_MTIME_NOW)) {
+            time_t now = time(NULL);
+            time_t atime = node->atime();
+            time_t mtime = node->mtime();
+            if (to_set & FUSE_SET_ATTR_ATIME_NOW) {
+                atime = now;
+            } else if (to_set & FUSE_SET_ATTR_ATIME) {
+                atime = attr->st_atime;
+            }
+            if (to_set & FUSE_SET_ATTR_MTIME_NOW) {
+                mtime = now;
+            } else if (to_set & FUSE_SET_ATTR_MTIME) {
+                mtime = attr->st_mtime;
+            }
+            node->setTimes(atime, mtime);
+        }
+    }
+    struct stat st;
+    data->getAttr(node, &st);
+    fuse_reply_attr(req, &st, data->m_attrTimeout);
+}
+
+void vmasfs_ll_readlink(fuse_req_t req, fuse_ino_t ino) {
+    OpTimer timer(Statistics::READLINK);
+    VmasFSData *data = get_data(req);
+    FileNode *node = get_node(req, ino);
+    MutexLock nodeLock(data->nodeLock(node));
+    if (!S_ISLNK(node->mode())) {
+        fuse_reply_err(req, EINVAL);
+        return;
+    }
+    int res;
+    if ((res = node->open()) != 0) {
+        fuse_reply_err(req, (res == -EMFILE) ? ENOMEM : -res);
+        return;
+    }
+    if ((res = data->loadNode(node)) != 0) {
+        node->close();
+        fuse_reply_err(req, -res);
+        return;
+    }
+    std::string link(node->size(), '\0');
+    int count = node->read(&link[0], link.size(), 0);
+    node->close();
+    link.resize(count);
+    fuse_reply_readlink(req, link.c_str());
+}
+
+void vmasfs_ll_mkdir(fuse_req_t req, fuse_ino_t parent, const char *name,
+        mode_t mode) {
+    OpTimer timer(Statistics::MKDIR);
+    VmasFSData *data = get_data(req);
+    WriteLock lock(data->treeLock());
+    FileNode *dir = get_node(req, parent);
+    int res = check_new_child(data, dir, name);
+    if (res != 0) {
+        fuse_reply_err(req, res);
+        return;
+    }
+    const struct fuse_ctx *ctx = fuse_req_ctx(req);
+    FileNode *node = NULL;
+    try {
+        node = FileNode::createDir(data->m_zip, name, ctx->uid, ctx->gid,
+                mode, data->arena());
+        data->insertNode (dir, node);
+    }
+    catch (const std::bad_alloc &) {
+        delete node;
+        fuse_reply_err(req, ENOMEM);
+        return;
+    }
+    struct fuse_entry_param e;
+    make_entry(data, node, &e);
+    fuse_reply_entry(req, &e);
+}
+
+void vmasfs_ll_unlink(fuse_req_t req, fuse_ino_t parent, const char *name) {
+    OpTimer timer(Statistics::UNLINK);
+    VmasFSData *data = get_data(req);
+    WriteLock lock(data->treeLock());
+    FileNode *node;
+    int res = find_child(data, get_node(req, parent), name, node);
+    if (res == 0 && data->isVirtual(node)) {
+        res = EACCES;
+    } else if (res == 0 && node->is_dir) {
+        res = EISDIR;
+    }
+    if (res == 0) {
+        res = data->unlinkNode(node);
+    }
+    fuse_reply_err(req, res);
+}
+
+void vmasfs_ll_rmdir(fuse_req_t req, fuse_ino_t parent, const char *name) {
+    OpTimer timer(Statistics::RMDIR);
+    VmasFSData *data = get_data(req);
+    WriteLock lock(data->treeLock());
+    FileNode *node;
+    int res = find_child(data, get_node(req, parent), name, node);
+    if (res == 0 && data->isVirtual(node)) {
+        res = EACCES;
+    } else if (res == 0 && !node->is_dir) {
+        res = ENOTDIR;
+    }
+    if (res == 0) {
+        data->loadChilds(node);
+        if (!node->childs.empty()) {
+            res = ENOTEMPTY;
+        }
+    }
+    if (res == 0) {
+        res = data->unlinkNode(node);
+    }
+    fuse_reply_err(req, res);
+}
+
+void vmasfs_ll_symlink(fuse_req_t req, const char *link, fuse_ino_t parent,
+        const char *name) {
+    OpTimer timer(Statistics::SYMLINK);
+    VmasFSData *data = get_data(req);
+    WriteLock lock(data->treeLock());
+    FileNode *dir = get_node(req, parent);
+    int res = check_new_child(data, dir, name);
+    if (res != 0) {
+        fuse_reply_err(req, res);
+        return;
+    }
+    FileNode *node = NULL;
+    try {
+        node = FileNode::createSymlink(data->m_zip, name, data->arena());
+        data->insertNode (dir, node);
+    }
+    catch (const std::bad_alloc &) {
+        delete node;
+        fuse_reply_err(req, ENOMEM);
+        return;
+    }
+    {
+        MutexLock nodeLock(data->nodeLock(node));
+        if ((res = node->open()) == 0) {
+            res = node->write(link, strlen(link), 0);
+            node->close();
+        }
+    }
+    if (res < 0) {
+        // half-created link must not be saved
+        data->removeNode(node);
+        fuse_reply_err(req, (res == -EMFILE) ? ENOMEM : -res);
+        return;
+    }
+    struct fuse_entry_param e;
+    make_entry(data, node, &e);
+    fuse_reply_entry(req, &e);
+}
+
+#if FUSE_USE_VERSION >= 30
+void vmasfs_ll_rename(fuse_req_t req, fuse_ino_t parent, const char *name,
+        fuse_ino_t newparent, const char *newname, unsigned int flags) {
+    if ((flags & ~RENAME_NOREPLACE) != 0) {
+        fuse_reply_err(req, EINVAL);
+        return;
+    }
+#else
+void vmasfs_ll_rename(fuse_req_t req, fuse_ino_t parent, const char *name,
+        fuse_ino_t newparent, const char *newname) {
+    unsigned int flags = 0;
+#endif
+    OpTimer timer(Statistics::RENAME);
+    VmasFSData *data = get_data(req);
+    WriteLock lock(data->treeLock());
+    FileNode *node, *target;
+    FileNode *newDir = get_node(req, newparent);
+    int res = find_child(data, get_node(req, parent), name, node);
+    if (res == 0 && (data->isVirtual(node) || data->isVirtual(newDir))) {
+        res = EACCES;
+    }
+    if (res != 0) {
+        fuse_reply_err(req, res);
+        return;
+    }
+    res = find_child(data, newDir, newname, target);
+    if (res == 0 && data->isVirtual(target)) {
+        res = EACCES;
+    } else if (res == 0 && (flags & RENAME_NOREPLACE)) {
+        res = EEXIST;
+    } else if (res == 0) {
+        if (target == node) {
+            fuse_reply_err(req, 0);
+            return;
+        }
+        if (target->is_dir) {
+            data->loadChilds(target);
+            if (!node->is_dir) {
+                res = EISDIR;
+            } else if (!target->childs.empty()) {
+                res = ENOTEMPTY;
+            }
+        } else if (node->is_dir) {
+            res = ENOTDIR;
+        }
+        if (res == 0) {
+            res = data->unlinkNode(target);
+        }
+    } else if (res == ENOENT) {
+        res = 0;
+    }
+    if (res != 0) {
+        fuse_reply_err(req, res);
+        return;
+    }
+
+    try {
+        // names of not yet created nodes are derived from old name of
+        // directory, so create them before renaming
+        if (node->is_dir) {
+            data->loadTree(node);
+        }
+        data->renameNode (node, newDir, newname);
+        fuse_reply_err(req, 0);
+    }
+    catch (...) {
+        fuse_reply_err(req, EIO);
+    }
+}
+
+void vmasfs_ll_open(fuse_req_t req, fuse_ino_t ino,
+        struct fuse_file_info *fi) {
+    OpTimer timer(Statistics::OPEN);
+    VmasFSData *data = get_data(req);
+    FileNode *node = get_node(req, ino);
+    if (node->is_dir) {
+        fuse_reply_err(req, EISDIR);
+        return;
+    }
+    if (data->isVirtual(node) && (fi->flags & O_ACCMODE) != O_RDONLY) {
+        fuse_reply_err(req, EACCES);
+        return;
+    }
+    FileHandle *handle;
+    try {
+        handle = data->handles().allocate(node, fi->flags);
+    }
+    catch (std::bad_alloc) {
+        fuse_reply_err(req, ENOMEM);
+        return;
+    }
+    int res;
+    {
+        MutexLock nodeLock(data->nodeLock(node));
+        res = data->checkBufferMemory(node, fi->flags);
+        if (res == 0) {
+            res = node->open();
+        }
+        if (res == 0 && data->openData(handle)) {
+            // huge file is streamed bypassing page cache
+            fi->direct_io = 1;
+        } else {
+            // pages of unmodified file cached by kernel are still valid,
+            // cache of modified file is dropped
+            fi->keep_cache = !node->isChanged();
+        }
+    }
+    if (res != 0) {
+        data->releaseHandle(handle);
+        fuse_reply_err(req, -res);
+        return;
+    }
+    fi->fh = (uint64_t)handle;
+    fuse_reply_open(req, fi);
+}
+
+void vmasfs_ll_read(fuse_req_t req, fuse_ino_t ino, size_t size, off_t off,
+        struct fuse_file_info *fi) {
+    (void) ino;
+    OpTimer timer(Statistics::READ);
+    VmasFSData *data = get_data(req);
+    FileHandle *handle = (FileHandle*)fi->fh;
+    char *buf = (char*)malloc(size);
+    if (buf == NULL) {
+        fuse_reply_err(req, ENOMEM);
+        return;
+    }
+    int res;
+    {
+        MutexLock nodeLock(data->nodeLock(handle->node));
+        res = data->readFile(handle, buf, size, off);
+    }
+    if (res < 0) {
+        fuse_reply_err(req, -res);
+    } else {
+        timer.transferred(res);
+        fuse_reply_buf(req, buf, res);
+    }
+    free(buf);
+}
+
+void vmasfs_ll_write(fuse_req_t req, fuse_ino_t ino, const char *buf,
+        size_t size, off_t off, struct fuse_file_info *fi) {
+    (void) ino;
+    OpTimer timer(Statistics::WRITE);
+    VmasFSData *data = get_data(req);
+    FileHandle *handle = (FileHandle*)fi->fh;
+    FileNode *node = handle->node;
+    int res;
+    {
+        MutexLock nodeLock(data->nodeLock(node));
+        if ((res = data->loadNode(node)) == 0) {
+            res = node->write(buf, size, off);
+        }
+    }
+    if (res < 0) {
+        fuse_reply_err(req, -res);
+    } else {
+        timer.transferred(res);
+        fuse_reply_write(req, res);
+    }
+}
+
+void vmasfs_ll_flush(fuse_req_t req, fuse_ino_t, struct fuse_file_info *) {
+    fuse_reply_err(req, 0);
+}
+
+void vmasfs_ll_release(fuse_req_t req, fuse_ino_t ino,
+        struct fuse_file_info *fi) {
+    (void) ino;
+    OpTimer timer(Statistics::RELEASE);
+    VmasFSData *data = get_data(req);
+    FileHandle *handle = (FileHandle*)fi->fh;
+    FileNode *node = handle->node;
+    int res;
+    {
+        MutexLock nodeLock(data->nodeLock(node));
+        res = node->close();
+    }
+    data->releaseHandle(handle);
+    fuse_reply_err(req, -res);
+}
+
+void vmasfs_ll_fsync(fuse_req_t req, fuse_ino_t, int,
+        struct fuse_file_info *) {
+    fuse_reply_err(req, 0);
+}
+
+void vmasfs_ll_opendir(fuse_req_t req, fuse_ino_t ino,
+        struct fuse_file_info *fi) {
+    OpTimer timer(Statistics::OPENDIR);
+    FileNode *dir = get_node(req, ino);
+    if (!dir->is_dir) {
+        fuse_reply_err(req, ENOTDIR);
+        return;
+    }
+    DirCursor *cursor = new (std::nothrow) DirCursor();
+    if (cursor == NULL) {
+        fuse_reply_err(req, ENOMEM);
+        return;
+    }
+    fi->fh = (uint64_t)cursor;
+    fuse_reply_open(req, fi);
+}
+
+/**
+ * Add directory entry to buffer.
+ * @return entry size, entry is not added if it is greater than bufsize
+ */
+static size_t add_direntry(fuse_req_t req, char *buf, size_t bufsize,
+        const char *name, const FileNode *node, off_t off) {
+    // inode and type are used for directory entries
+    struct stat st;
+    memset(&st, 0, sizeof(st));
+    st.st_ino = node->ino;
+    st.st_mode = node->mode();
+    return fuse_add_direntry(req, buf, bufsize, name, &st, off);
+}
+
+#if FUSE_USE_VERSION >= 30
+/**
+ * Add directory entry with attributes to buffer and count lookup if it
+ * fits. Caller must hold tree lock.
+ * @return entry size, entry is not added if it is greater than bufsize
+ */
+static size_t add_direntry_plus(VmasFSData *data, fuse_req_t req, char *buf,
+        size_t bufsize, const char *name, FileNode *node, off_t off) {
+    struct fuse_entry_param e;
+    // kernel does not look up "." and ".."
+    bool dots = strcmp(name, ".") == 0 || strcmp(name, "..") == 0;
+    if (dots) {
+        memset(&e, 0, sizeof(e));
+        e.attr.st_ino = node->ino;
+        e.attr.st_mode = node->mode();
+    } else {
+        fill_entry(data, node, &e);
+    }
+    size_t len = fuse_add_direntry_plus(req, buf, bufsize, name, &e, off);
+    if (len <= bufsize && !dots) {
+        __atomic_add_fetch(&node->nlookup, 1, __ATOMIC_ACQ_REL);
+    }
+    return len;
+}
+#endif
+
+/**
+ * Add directory entry to buffer, with attributes if 'plus' is set.
+ * Caller must hold tree lock.
+ * @return entry size, entry is not added if it is greater than bufsize
+ */
+static size_t add_entry(VmasFSData *data, fuse_req_t req, char *buf,
+        size_t bufsize, const char *name, FileNode *node, off_t off,
+        bool plus) {
+#if FUSE_USE_VERSION >= 30
+    if (plus) {
+        return add_direntry_plus(data, req, buf, bufsize, name, node, off);
+    }
+#else
+    (void) data;
+    (void) plus;
+#endif
+    return add_direntry(req, buf, bufsize, name, node, off);
+}
+
+/**
+ * Reply with part of directory listing after entry with given offset.
+ * With 'plus' entries with attributes are returned.
+ */
+static void read_dir(fuse_req_t req, fuse_ino_t ino, size_t size,
+        off_t off, struct fuse_file_info *fi, bool plus) {
+    OpTimer timer(Statistics::READDIR);
+    VmasFSData *data = get_data(req);
+    FileNode *dir = get_node(req, ino);
+    DirCursor *cursor = (DirCursor*)fi->fh;
+    if (off >= DirCursor::TAIL_OFFSET) {
+        fuse_reply_buf(req, NULL, 0);
+        return;
+    }
+    char *buf = (char*)malloc(size);
+    if (buf == NULL) {
+        fuse_reply_err(req, ENOMEM);
+        return;
+    }
+    size_t pos = 0;
+    {
+        ReadLock lock(data->treeLock());
+        data->loadChilds(dir);
+        const char *dotNames[DirCursor::DOTS_END] = { ".", ".." };
+        FileNode *dots[DirCursor::DOTS_END] = {
+            dir, (dir->parent != NULL) ? dir->parent : dir
+        };
+        bool full = false;
+        off_t next = off;
+        for (; next < DirCursor::DOTS_END && !full; ++next) {
+            size_t len = add_entry(data, req, buf + pos, size - pos,
+                    dotNames[next], dots[next], next + 1, plus);
+            full = len > size - pos;
+            if (!full) {
+                pos += len;
+            }
+        }
+        filemap_t::const_iterator i = cursor->seek(dir, off);
+        for (; i != dir->childs.end() && !full; ++i) {
+            size_t len = add_entry(data, req, buf + pos, size - pos,
+                    i->first, i->second, next + 1, plus);
+            full = len > size - pos;
+            if (!full) {
+                pos += len;
+                cursor->returned(i->first, ++next);
+            }
+        }
+        FileNode *tail = data->listedVirtualDir(dir);
+        if (!full && tail != NULL) {
+            size_t len = add_entry(data, req, buf + pos, size - pos,
+                    tail->name(), tail, DirCursor::TAIL_OFFSET, plus);
+            if (len <= size - pos) {
+                pos += len;
+            }
+        }
+    }
+    fuse_reply_buf(req, buf, pos);
+    free(buf);
+}
+
+void vmasfs_ll_readdir(fuse_req_t req, fuse_ino_t ino, size_t size,
+        off_t off, struct fuse_file_info *fi) {
+    read_dir(req, ino, size, off, fi, false);
+}
+
+#if FUSE_USE_VERSION >= 30
+void vmasfs_ll_readdirplus(fuse_req_t req, fuse_ino_t ino, size_t size,
+        off_t off, struct fuse_file_info *fi) {
+    read_dir(req, ino, size, off, fi, true);
+}
+#endif
+
+void vmasfs_ll_releasedir(fuse_req_t req, fuse_ino_t ino,
+        struct fuse_file_info *fi) {
+    (void) ino;
+    delete (DirCursor*)fi->fh;
+    fuse_reply_err(req, 0);
+}
+
+void vmasfs_ll_fsyncdir(fuse_req_t req, fuse_ino_t, int,
+        struct fuse_file_info *) {
+    fuse_reply_err(req, 0);
+}
+
+void vmasfs_ll_statfs(fuse_req_t req, fuse_ino_t ino) {
+    (void) ino;
+    OpTimer timer(Statistics::STATFS);
+    VmasFSData *data = get_data(req);
+
+    // Getting amount of free space in directory with archive
+    struct statvfs st, buf;
+    if (statvfs(data->m_cwd.c_str(), &st) != 0) {
+        fuse_reply_err(req, errno);
+        return;
+    }
+    memset(&buf, 0, sizeof(buf));
+    buf.f_bavail = buf.f_bfree = st.f_frsize * st.f_bavail;
+    buf.f_bsize = 1;
+    buf.f_blocks = buf.f_bavail + 0;
+    buf.f_ffree = 0;
+    buf.f_favail = 0;
+    {
+        ReadLock lock(data->treeLock());
+        buf.f_files = data->numFiles();
+    }
+    buf.f_namemax = 255;
+    fuse_reply_statfs(req, &buf);
+}
+
+void vmasfs_ll_setxattr(fuse_req_t req, fuse_ino_t, const char *,
+        const char *, size_t, int) {
+    fuse_reply_err(req, ENOTSUP);
+}
+
+void vmasfs_ll_getxattr(fuse_req_t req, fuse_ino_t, const char *, size_t) {
+    fuse_reply_err(req, ENOTSUP);
+}
+
+void vmasfs_ll_listxattr(fuse_req_t req, fuse_ino_t, size_t) {
+    fuse_reply_err(req, ENOTSUP);
+}
+
+void vmasfs_ll_removexattr(fuse_req_t req, fuse_ino_t, const char *) {
+    fuse_reply_err(req, ENOTSUP);
+}
+
+void vmasfs_ll_access(fuse_req_t req, fuse_ino_t, int) {
+    fuse_reply_err(req, 0);
+}
+
+void vmasfs_ll_create(fuse_req_t req, fuse_ino_t parent, const char *name,
+        mode_t mode, struct fuse_file_info *fi) {
+    OpTimer timer(Statistics::CREATE);
+    VmasFSData *data = get_data(req);
+    WriteLock lock(data->treeLock());
+    FileNode *dir = get_node(req, parent);
+    int res = check_new_child(data, dir, name);
+    if (res != 0) {
+        fuse_reply_err(req, res);
+        return;
+    }
+    const struct fuse_ctx *ctx = fuse_req_ctx(req);
+    FileNode *node = NULL;
+    try {
+        node = FileNode::createFile(data->m_zip, name, ctx->uid, ctx->gid,
+                mode, data->arena());
+        data->insertNode (dir, node);
+    }
+    catch (const std::bad_alloc &) {
+        delete node;
+        fuse_reply_err(req, ENOMEM);
+        return;
+    }
+    FileHandle *handle;
+    try {
+        handle = data->handles().allocate(node, fi->flags);
+    }
+    catch (std::bad_alloc) {
+        data->removeNode(node);
+        fuse_reply_err(req, ENOMEM);
+        return;
+    }
+    {
+        MutexLock nodeLock(data->nodeLock(node));
+        res = node->open();
+    }
+    if (res != 0) {
+        data->releaseHandle(handle);
+        data->removeNode(node);
+        fuse_reply_err(req, -res);
+        return;
+    }
+    fi->fh = (uint64_t)handle;
+    struct fuse_entry_param e;
+    make_entry(data, node, &e);
+    fuse_reply_create(req, &e, fi);
+}
@@ -0,0 +1,134 @@
+////////////////////////////////////////////////////////////////////////////
+//  Copyright (C) 2021 by V+ Publicidad SpA                               //
+//  http://www.vmaspublicidad.com                                         //
+//                                                                        //
+////////////////////////////////////////////////////////////////////////////
+
+#ifndef VMAS_FS_LL_H
+#define VMAS_FS_LL_H
+
+/**
+ * Low-level (inode-based) frontend of vmas-fs file system (to be called
+ * by FUSE low-level library).
+ *
+ * Nodes are identified by their addresses, so no path lookups are made
+ * except lookup of single name in parent directory. Kernel lookup counts
+ * are kept in FileNode::nlookup, removed nodes that are still known to
+ * kernel are kept as orphans until they are forgotten.
+ *
+ * Session user data is VmasFSData structure created by initVmasFS().
+ */
+
+extern "C" {
+
+/**
+ * Negotiate I/O request sizes with kernel, start archive I/O threads,
+ * report current working dir and archive file name to syslog.
+ */
+void vmasfs_ll_init(void *userdata, struct fuse_conn_info *conn);
+
+/**
+ * Save all modified data back to ZIP archive, free file system data and
+ * report to syslog about completion.
+ */
+void vmasfs_ll_destroy(void *userdata);
+
+void vmasfs_ll_lookup(fuse_req_t req, fuse_ino_t parent, const char *name);
+
+void vmasfs_ll_forget(fuse_req_t req, fuse_ino_t ino, unsigned long nlookup);
+
+#if FUSE_VERSION >= 29
+void vmasfs_ll_forget_multi(fuse_req_t req, size_t count,
+        struct fuse_forget_data *forgets);
+#endif
+
+void vmasfs_ll_getattr(fuse_req_t req, fuse_ino_t ino,
+        struct fuse_file_info *fi);
+
+void vmasfs_ll_setattr(fuse_req_t req, fuse_ino_t ino, struct stat *attr,
+        int to_set, struct fuse_file_info *fi);
+
+void vmasfs_ll_readlink(fuse_req_t req, fuse_ino_t ino);
+
+void vmasfs_ll_mkdir(fuse_req_t req, fuse_ino_t parent, const char *name,
+        mode_t mode);
+
+void vmasfs_ll_unlink(fuse_req_t req, fuse_ino_t parent, const char *name);
+
+void vmasfs_ll_rmdir(fuse_req_t req, fuse_ino_t parent, const char *name);
+
+void vmasfs_ll_symlink(fuse_req_t req, const char *link, fuse_ino_t parent,
+        const char *name);
+
+#if FUSE_USE_VERSION >= 30
+void vmasfs_ll_rename(fuse_req_t req, fuse_ino_t parent, const char *name,
+        fuse_ino_t newparent, const char *newname, unsigned int flags);
+#else
+void vmasfs_ll_rename(fuse_req_t req, fuse_ino_t parent, const char *name,
+        fuse_ino_t newparent, const char *newname);
+#endif
+
+void vmasfs_ll_open(fuse_req_t req, fuse_ino_t ino,
+        struct fuse_file_info *fi);
+
+void vmasfs_ll_read(fuse_req_t req, fuse_ino_t ino, size_t size, off_t off,
+        struct fuse_file_info *fi);
+
+void vmasfs_ll_write(fuse_req_t req, fuse_ino_t ino, const char *buf,
+        size_t size, off_t off, struct fuse_file_info *fi);
+
+void vmasfs_ll_flush(fuse_req_t req, fuse_ino_t ino,
+        struct fuse_file_info *fi);
+
+void vmasfs_ll_release(fuse_req_t req, fuse_ino_t ino,
+        struct fuse_file_info *fi);
+
+void vmasfs_ll_fsync(fuse_req_t req, fuse_ino_t ino, int datasync,
+        struct fuse_file_info *fi);
+
+/**
+ * Directory handle keeps position in listing (DirCursor), entries are
+ * returned by parts in readdir and readdirplus
+ */
+void vmasfs_ll_opendir(fuse_req_t req, fuse_ino_t ino,
+        struct fuse_file_info *fi);
+
+void vmasfs_ll_readdir(fuse_req_t req, fuse_ino_t ino, size_t size,
+        off_t off, struct fuse_file_info *fi);
+
+#if FUSE_USE_VERSION >= 30
+/**
+ * The same as readdir, but with attributes of entries so 'ls -l' needs no
+ * separate lookups
+ */
+void vmasfs_ll_readdirplus(fuse_req_t req, fuse_ino_t ino, size_t size,
+        off_t off, struct fuse_file_info *fi);
+#endif
+
+void vmasfs_ll_releasedir(fuse_req_t req, fuse_ino_t ino,
+        struct fuse_file_info *fi);
+
+void vmasfs_ll_fsyncdir(fuse_req_t req, fuse_ino_t ino, int datasync,
+        struct fuse_file_info *fi);
+
+void vmasfs_ll_statfs(fuse_req_t req, fuse_ino_t ino);
+
+void vmasfs_ll_setxattr(fuse_req_t req, fuse_ino_t ino, const char *name,
+        const char *value, size_t size, int flags);
+
+void vmasfs_ll_getxattr(fuse_req_t req, fuse_ino_t ino, const char *name,
+        size_t size);
+
+void vmasfs_ll_listxattr(fuse_req_t req, fuse_ino_t ino, size_t size);
+
+void vmasfs_ll_removexattr(fuse_req_t req, fuse_ino_t ino,
+        const char *name);
+
+void vmasfs_ll_access(fuse_req_t req, fuse_ino_t ino, int mask);
+
+void vmasfs_ll_create(fuse_req_t req, fuse_ino_t parent, const char *name,
+        mode_t mode, struct fuse_file_info *fi);
+
+}
+
+#endif
@@ -4,7 +4,6 @@
 //                                                                        //
 ////////////////////////////////////////////////////////////////////////////
 
-#define STANDARD_BLOCK_SIZE (512)
 #define ERROR_STR_BUF_LEN 0x100
 
 #include "../config.h"
@@ -16,22 +15,33 @@
 #include <syslog.h>
 #include <sys/types.h>
 #include <sys/statvfs.h>
+#include <fcntl.h>
 
 #include <cerrno>
 #include <cstring>
 #include <cstdlib>
-#include <queue>
+#include <ctime>
+#include <new>
 
 #include "vmas-fs.h"
 #include "types.h"
 #include "fileNode.h"
 #include "vmasFSData.h"
+#include "mountIndex.h"
+#include "dirCursor.h"
+#include "fileHandle.h"
+#include "statistics.h"
+#include "traceLog.h"
+
+#ifndef RENAME_NOREPLACE
+#define RENAME_NOREPLACE (1 << 0)
+#endif
 
 using namespace std;
 
 //TODO: Move printf-s out this function
 VmasFSData *initVmasFS(const char *program, const char *fileName,
-        bool readonly) {
+        bool readonly, bool lazy, const char *indexDir) {
     VmasFSData *data = NULL;
     int err;
     struct zip *zip_file;
@@ -60,7 +70,12 @@ VmasFSData *initVmasFS(const char *program, const char *fileName,
             throw std::bad_alloc();
         }
         try {
-            data->build_tree(readonly);
+            if (indexDir != NULL) {
+                std::string indexPath = MountIndex::path(fileName, indexDir);
+                data->build_tree(readonly, lazy, indexPath.c_str());
+            } else {
+                data->build_tree(readonly, lazy);
+            }
         }
         catch (...) {
             delete data;
@@ -80,9 +95,41 @@ VmasFSData *initVmasFS(const char *program, const char *fileName,
     return data;
 }
 
+#if FUSE_USE_VERSION >= 30
+void *vmasfs_init(struct fuse_conn_info *conn, struct fuse_config *cfg) {
+    VmasFSData *data = (VmasFSData*)fuse_get_context()->private_data;
+    // inode numbers are unique and stable during mount
+    cfg->use_ino = 1;
+    cfg->nullpath_ok = 0;
+    cfg->entry_timeout = data->m_entryTimeout;
+    cfg->attr_timeout = data->m_attrTimeout;
+    if (data->m_writebackCache && (conn->capable & FUSE_CAP_WRITEBACK_CACHE)) {
+        conn->want |= FUSE_CAP_WRITEBACK_CACHE;
+    }
+    // must be the same as max_read mount option
+    conn->max_read = data->m_maxRead;
+#else
 void *vmasfs_init(struct fuse_conn_info *conn) {
-    (void) conn;
     VmasFSData *data = (VmasFSData*)fuse_get_context()->private_data;
+#if FUSE_VERSION >= 28
+    // without big writes kernel sends data by pages
+    if (conn->capable & FUSE_CAP_BIG_WRITES) {
+        conn->want |= FUSE_CAP_BIG_WRITES;
+    }
+#endif
+#endif
+    // library proposes the largest sizes it and kernel support, they
+    // can be only reduced
+    if (data->m_maxWrite != 0 && data->m_maxWrite < conn->max_write) {
+        conn->max_write = data->m_maxWrite;
+    }
+    if (data->m_maxReadahead != 0 && data->m_maxReadahead < conn->max_readahead) {
+        conn->max_readahead = data->m_maxReadahead;
+    }
+    // process is already daemonized, so threads can be started
+    data->startIO();
+    data->startLatencyDumper();
+    TraceLog::global.start();
     syslog(LOG_INFO, "Mounting file system on %s (cwd=%s)", data->m_archiveName, data->m_cwd.c_str());
     return data;
 }
@@ -99,6 +146,8 @@ void vmasfs_destroy(void *data) {
     VmasFSData *d = (VmasFSData*)data;
     d->save ();
     delete d;
+    // archive save is traced too
+    TraceLog::global.stop();
     syslog(LOG_INFO, "File system unmounted");
 }
 
@@ -106,49 +155,106 @@ FileNode *get_file_node(const char *fname) {
     return get_data()->find (fname);
 }
 
+/**
+ * Find node under shared tree lock. Node is not removed after lock is
+ * released because FUSE does not allow to remove file while operation on
+ * it is in progress.
+ */
+static FileNode *lookup_node(const char *fname) {
+    ReadLock lock(get_data()->treeLock());
+    return get_file_node(fname);
+}
+
+#if FUSE_USE_VERSION >= 30
+int vmasfs_getattr(const char *path, struct stat *stbuf, struct fuse_file_info *) {
+#else
 int vmasfs_getattr(const char *path, struct stat *stbuf) {
+#endif
+    OpTimer timer(Statistics::GETATTR);
     memset(stbuf, 0, sizeof(struct stat));
     if (*path == '\0') {
         return -ENOENT;
     }
+    ReadLock lock(get_data()->treeLock());
     FileNode *node = get_file_node(path + 1);
     if (node == NULL) {
         return -ENOENT;
     }
-    if (node->is_dir) {
-        stbuf->st_nlink = 2 + node->childs.size();
-    } else {
-        stbuf->st_nlink = 1;
-    }
-    stbuf->st_mode = node->mode();
-    stbuf->st_blksize = STANDARD_BLOCK_SIZE;
-    stbuf->st_ino = node->id;
-    stbuf->st_blocks = (node->size() + STANDARD_BLOCK_SIZE - 1) / STANDARD_BLOCK_SIZE;
-    stbuf->st_size = node->size();
-    stbuf->st_atime = node->atime();
-    stbuf->st_mtime = node->mtime();
-    stbuf->st_ctime = node->ctime();
-    stbuf->st_uid = node->uid();
-    stbuf->st_gid = node->gid();
-
+    get_data()->getAttr(node, stbuf);
     return 0;
 }
 
-int vmasfs_readdir(const char *path, void *buf, fuse_fill_dir_t filler, off_t offset, struct fuse_file_info *fi) {
-    (void) offset;
-    (void) fi;
+/**
+ * Add entry to directory listing. Full attributes are passed only to
+ * readdirplus.
+ * @return true if buffer is full
+ */
+#if FUSE_USE_VERSION >= 30
+static bool fill_dir(void *buf, fuse_fill_dir_t filler, const char *name,
+        const struct stat *st, off_t off, bool plus) {
+    return filler(buf, name, st, off,
+            plus ? FUSE_FILL_DIR_PLUS : (enum fuse_fill_dir_flags)0) != 0;
+}
+#else
+static bool fill_dir(void *buf, fuse_fill_dir_t filler, const char *name,
+        const struct stat *st, off_t off, bool) {
+    return filler(buf, name, st, off) != 0;
+}
+#endif
 
+#if FUSE_USE_VERSION >= 30
+int vmasfs_readdir(const char *path, void *buf, fuse_fill_dir_t filler, off_t offset, struct fuse_file_info *fi, enum fuse_readdir_flags flags) {
+    // full attributes are cached by kernel, so listing with attributes
+    // needs no getattr request for every entry
+    bool plus = (flags & FUSE_READDIR_PLUS) != 0;
+#else
+int vmasfs_readdir(const char *path, void *buf, fuse_fill_dir_t filler, off_t offset, struct fuse_file_info *fi) {
+    bool plus = false;
+#endif
+    OpTimer timer(Statistics::READDIR);
     if (*path == '\0') {
         return -ENOENT;
     }
+    if (offset >= DirCursor::TAIL_OFFSET) {
+        return 0;
+    }
+    DirCursor *cursor = (DirCursor*)fi->fh;
+    ReadLock lock(get_data()->treeLock());
     FileNode *node = get_file_node(path + 1);
     if (node == NULL) {
         return -ENOENT;
     }
-    filler(buf, ".", NULL, 0);
-    filler(buf, "..", NULL, 0);
-    for (nodelist_t::const_iterator i = node->childs.begin(); i != node->childs.end(); ++i) {
-        filler(buf, (*i)->name, NULL, 0);
+    get_data()->loadChilds(node);
+
+    // entries are passed with offsets, so FUSE requests listing by parts
+    // that fit into kernel buffer
+    if (offset < 1 && fill_dir(buf, filler, ".", NULL, 1, false)) {
+        return 0;
+    }
+    if (offset < 2 && fill_dir(buf, filler, "..", NULL, 2, false)) {
+        return 0;
+    }
+    // inode and type are used for directory entries with use_ino option
+    struct stat st;
+    memset(&st, 0, sizeof(st));
+    off_t next = (offset > DirCursor::DOTS_END) ? offset : DirCursor::DOTS_END;
+    for (filemap_t::const_iterator i = cursor->seek(node, offset); i != node->childs.end(); ++i) {
+        if (plus) {
+            get_data()->getAttr(i->second, &st);
+        } else {
+            st.st_ino = i->second->ino;
+            st.st_mode = i->second->mode();
+        }
+        if (fill_dir(buf, filler, i->first, &st, next + 1, plus)) {
+            return 0;
+        }
+        cursor->returned(i->first, ++next);
+    }
+    FileNode *tail = get_data()->listedVirtualDir(node);
+    if (tail != NULL) {
+        get_data()->getAttr(tail, &st);
+        fill_dir(buf, filler, tail->name(), &st, DirCursor::TAIL_OFFSET,
+                plus);
     }
 
     return 0;
@@ -156,6 +262,7 @@ int vmasfs_readdir(const char *path, void *buf, fuse_fill_dir_t filler, off_t of
 
 int vmasfs_statfs(const char *path, struct statvfs *buf) {
     (void) path;
+    OpTimer timer(Statistics::STATFS);
 
     // Getting amount of free space in directory with archive
     struct statvfs st;
@@ -172,6 +279,7 @@ int vmasfs_statfs(const char *path, struct statvfs *buf) {
     buf->f_ffree = 0;
     buf->f_favail = 0;
 
+    ReadLock lock(get_data()->treeLock());
     buf->f_files = get_data()->numFiles();
     buf->f_namemax = 255;
 
@@ -179,20 +287,42 @@ int vmasfs_statfs(const char *path, struct statvfs *buf) {
 }
 
 int vmasfs_open(const char *path, struct fuse_file_info *fi) {
+    OpTimer timer(Statistics::OPEN);
     if (*path == '\0') {
         return -ENOENT;
     }
-    FileNode *node = get_file_node(path + 1);
+    FileNode *node = lookup_node(path + 1);
     if (node == NULL) {
         return -ENOENT;
     }
     if (node->is_dir) {
         return -EISDIR;
     }
-    fi->fh = (uint64_t)node;
+    if (get_data()->isVirtual(node) && (fi->flags & O_ACCMODE) != O_RDONLY) {
+        return -EACCES;
+    }
 
     try {
-        return node->open();
+        FileHandle *handle = get_data()->handles().allocate(node, fi->flags);
+        MutexLock nodeLock(get_data()->nodeLock(node));
+        int res = get_data()->checkBufferMemory(node, fi->flags);
+        if (res == 0) {
+            res = node->open();
+        }
+        if (res != 0) {
+            get_data()->releaseHandle(handle);
+            return res;
+        }
+        if (get_data()->openData(handle)) {
+            // huge file is streamed bypassing page cache
+            fi->direct_io = 1;
+        } else {
+            // pages of unmodified file cached by kernel are still valid,
+            // cache of modified file is dropped
+            fi->keep_cache = !node->isChanged();
+        }
+        fi->fh = (uint64_t)handle;
+        return 0;
     }
     catch (std::bad_alloc) {
         return -ENOMEM;
@@ -203,63 +333,144 @@ int vmasfs_open(const char *path, struct fuse_file_info *fi) {
 }
 
 int vmasfs_create(const char *path, mode_t mode, struct fuse_file_info *fi) {
+    OpTimer timer(Statistics::CREATE);
     if (*path == '\0') {
         return -EACCES;
     }
+    WriteLock lock(get_data()->treeLock());
     FileNode *node = get_file_node(path + 1);
     if (node != NULL) {
         return -EEXIST;
     }
-    node = FileNode::createFile (get_zip(), path + 1,
-            fuse_get_context()->uid, fuse_get_context()->gid, mode);
-    if (node == NULL) {
+    FileNode *parent;
+    int res = get_data()->findParent(path + 1, parent);
+    if (res != 0) {
+        return res;
+    }
+    if (get_data()->isVirtual(parent)) {
+        return -EACCES;
+    }
+    try {
+        node = FileNode::createFile (get_zip(), path + 1,
+                fuse_get_context()->uid, fuse_get_context()->gid, mode,
+                get_data()->arena());
+        get_data()->insertNode (parent, node);
+    }
+    catch (const std::bad_alloc &) {
+        delete node;
         return -ENOMEM;
     }
-    get_data()->insertNode (node);
-    fi->fh = (uint64_t)node;
 
-    return node->open();
+    FileHandle *handle;
+    try {
+        handle = get_data()->handles().allocate(node, fi->flags);
+    }
+    catch (std::bad_alloc) {
+        get_data()->removeNode(node);
+        return -ENOMEM;
+    }
+    res = node->open();
+    if (res != 0) {
+        get_data()->releaseHandle(handle);
+        get_data()->removeNode(node);
+        return res;
+    }
+    fi->fh = (uint64_t)handle;
+    return 0;
 }
 
 int vmasfs_read(const char *path, char *buf, size_t size, off_t offset, struct fuse_file_info *fi) {
     (void) path;
+    OpTimer timer(Statistics::READ);
 
-    return ((FileNode*)fi->fh)->read(buf, size, offset);
+    FileHandle *handle = (FileHandle*)fi->fh;
+    int res;
+    {
+        MutexLock nodeLock(get_data()->nodeLock(handle->node));
+        res = get_data()->readFile(handle, buf, size, offset);
+    }
+    if (res > 0) {
+        timer.transferred(res);
+    }
+    return res;
 }
 
 int vmasfs_write(const char *path, const char *buf, size_t size, off_t offset, struct fuse_file_info *fi) {
     (void) path;
+    OpTimer timer(Statistics::WRITE);
 
-    return ((FileNode*)fi->fh)->write(buf, size, offset);
+    FileHandle *handle = (FileHandle*)fi->fh;
+    FileNode *node = handle->node;
+    MutexLock nodeLock(get_data()->nodeLock(node));
+    int res;
+    if ((res = get_data()->loadNode(node)) != 0) {
+        return res;
+    }
+    if ((res = node->write(buf, size, offset)) >= 0) {
+        timer.transferred(res);
+    }
+    return res;
 }
 
 int vmasfs_release (const char *path, struct fuse_file_info *fi) {
     (void) path;
+    OpTimer timer(Statistics::RELEASE);
 
-    return ((FileNode*)fi->fh)->close();
+    FileHandle *handle = (FileHandle*)fi->fh;
+    FileNode *node = handle->node;
+    int res;
+    {
+        MutexLock nodeLock(get_data()->nodeLock(node));
+        res = node->close();
+    }
+    get_data()->releaseHandle(handle);
+    return res;
 }
 
 int vmasfs_ftruncate(const char *path, off_t offset, struct fuse_file_info *fi) {
     (void) path;
 
-    return -((FileNode*)fi->fh)->truncate(offset);
+    FileNode *node = ((FileHandle*)fi->fh)->node;
+    MutexLock nodeLock(get_data()->nodeLock(node));
+    int res;
+    if ((res = get_data()->loadNode(node)) != 0) {
+        return res;
+    }
+    return -node->truncate(offset);
 }
 
+#if FUSE_USE_VERSION >= 30
+int vmasfs_truncate(const char *path, off_t offset, struct fuse_file_info *fi) {
+    // FUSE 3 has no separate ftruncate operation
+    if (fi != NULL) {
+        return vmasfs_ftruncate(path, offset, fi);
+    }
+#else
 int vmasfs_truncate(const char *path, off_t offset) {
+#endif
+    OpTimer timer(Statistics::SETATTR);
     if (*path == '\0') {
         return -EACCES;
     }
-    FileNode *node = get_file_node(path + 1);
+    FileNode *node = lookup_node(path + 1);
     if (node == NULL) {
         return -ENOENT;
     }
+    if (get_data()->isVirtual(node)) {
+        return -EACCES;
+    }
     if (node->is_dir) {
         return -EISDIR;
     }
+    MutexLock nodeLock(get_data()->nodeLock(node));
     int res;
     if ((res = node->open()) != 0) {
         return res;
     }
+    if ((res = get_data()->loadNode(node)) != 0) {
+        node->close();
+        return res;
+    }
     if ((res = node->truncate(offset)) != 0) {
         node->close();
         return -res;
@@ -268,13 +479,18 @@ int vmasfs_truncate(const char *path, off_t offset) {
 }
 
 int vmasfs_unlink(const char *path) {
+    OpTimer timer(Statistics::UNLINK);
     if (*path == '\0') {
         return -ENOENT;
     }
+    WriteLock lock(get_data()->treeLock());
     FileNode *node = get_file_node(path + 1);
     if (node == NULL) {
         return -ENOENT;
     }
+    if (get_data()->isVirtual(node)) {
+        return -EACCES;
+    }
     if (node->is_dir) {
         return -EISDIR;
     }
@@ -282,16 +498,22 @@ int vmasfs_unlink(const char *path) {
 }
 
 int vmasfs_rmdir(const char *path) {
+    OpTimer timer(Statistics::RMDIR);
     if (*path == '\0') {
         return -ENOENT;
     }
+    WriteLock lock(get_data()->treeLock());
     FileNode *node = get_file_node(path + 1);
     if (node == NULL) {
         return -ENOENT;
     }
+    if (get_data()->isVirtual(node)) {
+        return -EACCES;
+    }
     if (!node->is_dir) {
         return -ENOTDIR;
     }
+    get_data()->loadChilds(node);
     if (!node->childs.empty()) {
         return -ENOTEMPTY;
     }
@@ -299,91 +521,94 @@ int vmasfs_rmdir(const char *path) {
 }
 
 int vmasfs_mkdir(const char *path, mode_t mode) {
+    OpTimer timer(Statistics::MKDIR);
     if (*path == '\0') {
         return -ENOENT;
     }
-    zip_int64_t idx = zip_dir_add(get_zip(), path + 1, ZIP_FL_ENC_UTF_8);
-    if (idx < 0) {
-        return -ENOMEM;
+    WriteLock lock(get_data()->treeLock());
+    FileNode *parent;
+    int res = get_data()->findParent(path + 1, parent);
+    if (res != 0) {
+        return res;
     }
-    FileNode *node = FileNode::createDir(get_zip(), path + 1, idx,
-            fuse_get_context()->uid, fuse_get_context()->gid, mode);
-    if (node == NULL) {
+    if (get_data()->isVirtual(parent)) {
+        return -EACCES;
+    }
+    if (get_data()->findChild(parent, strrchr(path, '/') + 1) != NULL) {
+        return -EEXIST;
+    }
+    FileNode *node = NULL;
+    try {
+        node = FileNode::createDir(get_zip(), path + 1,
+                fuse_get_context()->uid, fuse_get_context()->gid, mode,
+                get_data()->arena());
+        get_data()->insertNode (parent, node);
+    }
+    catch (const std::bad_alloc &) {
+        delete node;
         return -ENOMEM;
     }
-    get_data()->insertNode (node);
     return 0;
 }
 
+#if FUSE_USE_VERSION >= 30
+int vmasfs_rename(const char *path, const char *new_path, unsigned int flags) {
+    if ((flags & ~RENAME_NOREPLACE) != 0) {
+        return -EINVAL;
+    }
+#else
 int vmasfs_rename(const char *path, const char *new_path) {
+    unsigned int flags = 0;
+#endif
+    OpTimer timer(Statistics::RENAME);
     if (*path == '\0') {
         return -ENOENT;
     }
+    WriteLock lock(get_data()->treeLock());
     FileNode *node = get_file_node(path + 1);
     if (node == NULL) {
         return -ENOENT;
     }
+    if (get_data()->isVirtual(node)) {
+        return -EACCES;
+    }
     if (*new_path == '\0') {
         return -EINVAL;
     }
+    FileNode *new_parent;
+    int res = get_data()->findParent(new_path + 1, new_parent);
+    if (res != 0) {
+        return res;
+    }
     FileNode *new_node = get_file_node(new_path + 1);
+    if (get_data()->isVirtual(new_parent) || get_data()->isVirtual(new_node)) {
+        return -EACCES;
+    }
+    if (new_node != NULL && (flags & RENAME_NOREPLACE)) {
+        return -EEXIST;
+    }
     if (new_node != NULL) {
-        int res = get_data()->removeNode(new_node);
+        if (new_node->is_dir) {
+            get_data()->loadChilds(new_node);
+            if (!new_node->childs.empty()) {
+                return -ENOTEMPTY;
+            }
+        }
+        res = get_data()->removeNode(new_node);
         if (res !=0) {
             return -res;
         }
     }
 
-    int len = strlen(new_path);
-    int oldLen = strlen(path + 1) + 1;
-    std::string new_name;
-    if (!node->is_dir) {
-        --len;
-        --oldLen;
-    }
-    new_name.reserve(len + ((node->is_dir) ? 1 : 0));
-    new_name.append(new_path + 1);
-    if (node->is_dir) {
-        new_name.push_back('/');
-    }
-
     try {
-        struct zip *z = get_zip();
-        // Renaming directory and its content recursively
+        // names of not yet created nodes are derived from old name of
+        // directory, so create them before renaming
         if (node->is_dir) {
-            queue<FileNode*> q;
-            q.push(node);
-            while (!q.empty()) {
-                FileNode *n = q.front();
-                q.pop();
-                for (nodelist_t::const_iterator i = n->childs.begin(); i != n->childs.end(); ++i) {
-                    FileNode *nn = *i;
-                    q.push(nn);
-                    char *name = (char*)malloc(len + nn->full_name.size() - oldLen + (nn->is_dir ? 2 : 1));
-                    if (name == NULL) {
-                        //TODO: check that we are have enough memory before entering this loop
-                        return -ENOMEM;
-                    }
-                    strcpy(name, new_name.c_str());
-                    strcpy(name + len, nn->full_name.c_str() + oldLen);
-                    if (nn->is_dir) {
-                        strcat(name, "/");
-                    }
-                    if (nn->id >= 0) {
-                        zip_file_rename(z, nn->id, name, ZIP_FL_ENC_UTF_8);
-                    }
-                    // changing child list may cause loop iterator corruption
-                    get_data()->renameNode (nn, name, false);
-                    
-                    free(name);
-                }
-            }
-        }
-        if (node->id >= 0) {
-            zip_file_rename(z, node->id, new_name.c_str(), ZIP_FL_ENC_UTF_8);
+            get_data()->loadTree(node);
         }
-        get_data()->renameNode (node, new_name.c_str(), true);
-
+        // only node itself is relinked, descendants get new names through
+        // their parents, ZIP entries are renamed on save
+        get_data()->renameNode (node, new_parent, strrchr(new_path, '/') + 1);
         return 0;
     }
     catch (...) {
@@ -391,15 +616,41 @@ int vmasfs_rename(const char *path, const char *new_path) {
     }
 }
 
+/**
+ * Get time to set from utimens() argument that may be UTIME_NOW or
+ * UTIME_OMIT (FUSE 3 passes them as is)
+ */
+static time_t utimens_time(const struct timespec &ts, time_t old, time_t now) {
+    if (ts.tv_nsec == UTIME_NOW) {
+        return now;
+    }
+    if (ts.tv_nsec == UTIME_OMIT) {
+        return old;
+    }
+    return ts.tv_sec;
+}
+
+#if FUSE_USE_VERSION >= 30
+int vmasfs_utimens(const char *path, const struct timespec tv[2], struct fuse_file_info *) {
+#else
 int vmasfs_utimens(const char *path, const struct timespec tv[2]) {
+#endif
+    OpTimer timer(Statistics::SETATTR);
     if (*path == '\0') {
         return -ENOENT;
     }
+    WriteLock lock(get_data()->treeLock());
     FileNode *node = get_file_node(path + 1);
     if (node == NULL) {
         return -ENOENT;
     }
-    node->setTimes (tv[0].tv_sec, tv[1].tv_sec);
+    if (get_data()->isVirtual(node)) {
+        return -EACCES;
+    }
+    MutexLock nodeLock(get_data()->nodeLock(node));
+    time_t now = time(NULL);
+    node->setTimes (utimens_time(tv[0], node->atime(), now),
+            utimens_time(tv[1], node->mtime(), now));
     return 0;
 }
 
@@ -427,26 +678,46 @@ int vmasfs_removexattr(const char *, const char *) {
     return -ENOTSUP;
 }
 
+#if FUSE_USE_VERSION >= 30
+int vmasfs_chmod(const char *path, mode_t mode, struct fuse_file_info *) {
+#else
 int vmasfs_chmod(const char *path, mode_t mode) {
+#endif
+    OpTimer timer(Statistics::SETATTR);
     if (*path == '\0') {
         return -ENOENT;
     }
+    WriteLock lock(get_data()->treeLock());
     FileNode *node = get_file_node(path + 1);
     if (node == NULL) {
         return -ENOENT;
     }
+    if (get_data()->isVirtual(node)) {
+        return -EACCES;
+    }
+    MutexLock nodeLock(get_data()->nodeLock(node));
     node->chmod(mode);
     return 0;
 }
 
+#if FUSE_USE_VERSION >= 30
+int vmasfs_chown(const char *path, uid_t uid, gid_t gid, struct fuse_file_info *) {
+#else
 int vmasfs_chown(const char *path, uid_t uid, gid_t gid) {
+#endif
+    OpTimer timer(Statistics::SETATTR);
     if (*path == '\0') {
         return -ENOENT;
     }
+    WriteLock lock(get_data()->treeLock());
     FileNode *node = get_file_node(path + 1);
     if (node == NULL) {
         return -ENOENT;
     }
+    if (get_data()->isVirtual(node)) {
+        return -EACCES;
+    }
+    MutexLock nodeLock(get_data()->nodeLock(node));
     if (uid != (uid_t) -1) {
         node->setUid (uid);
     }
@@ -468,11 +739,18 @@ int vmasfs_fsyncdir(const char *, int, struct fuse_file_info *) {
     return 0;
 }
 
-int vmasfs_opendir(const char *, struct fuse_file_info *) {
-  return 0;
+int vmasfs_opendir(const char *, struct fuse_file_info *fi) {
+    OpTimer timer(Statistics::OPENDIR);
+    DirCursor *cursor = new (std::nothrow) DirCursor();
+    if (cursor == NULL) {
+        return -ENOMEM;
+    }
+    fi->fh = (uint64_t)cursor;
+    return 0;
 }
 
-int vmasfs_releasedir(const char *, struct fuse_file_info *) {
+int vmasfs_releasedir(const char *, struct fuse_file_info *fi) {
+    delete (DirCursor*)fi->fh;
     return 0;
 }
 
@@ -481,13 +759,15 @@ int vmasfs_access(const char *, int) {
 }
 
 int vmasfs_readlink(const char *path, char *buf, size_t size) {
+    OpTimer timer(Statistics::READLINK);
     if (*path == '\0') {
         return -ENOENT;
     }
-    FileNode *node = get_file_node(path + 1);
+    FileNode *node = lookup_node(path + 1);
     if (node == NULL) {
         return -ENOENT;
     }
+    MutexLock nodeLock(get_data()->nodeLock(node));
     if (!S_ISLNK(node->mode())) {
         return -EINVAL;
     }
@@ -498,6 +778,10 @@ int vmasfs_readlink(const char *path, char *buf, size_t size) {
         }
         return res;
     }
+    if ((res = get_data()->loadNode(node)) != 0) {
+        node->close();
+        return res;
+    }
     int count = node->read(buf, size - 1, 0);
     buf[count] = '\0';
     node->close();
@@ -505,28 +789,42 @@ int vmasfs_readlink(const char *path, char *buf, size_t size) {
 }
 
 int vmasfs_symlink(const char *dest, const char *path) {
+    OpTimer timer(Statistics::SYMLINK);
     if (*path == '\0') {
         return -EACCES;
     }
+    WriteLock lock(get_data()->treeLock());
     FileNode *node = get_file_node(path + 1);
     if (node != NULL) {
         return -EEXIST;
     }
-    node = FileNode::createSymlink (get_zip(), path + 1);
-    if (node == NULL) {
+    FileNode *parent;
+    int res = get_data()->findParent(path + 1, parent);
+    if (res != 0) {
+        return res;
+    }
+    if (get_data()->isVirtual(parent)) {
+        return -EACCES;
+    }
+    try {
+        node = FileNode::createSymlink (get_zip(), path + 1,
+                get_data()->arena());
+        get_data()->insertNode (parent, node);
+    }
+    catch (const std::bad_alloc &) {
+        delete node;
         return -ENOMEM;
     }
-    get_data()->insertNode (node);
 
-    int res;
-    if ((res = node->open()) != 0) {
-        if (res == -EMFILE) {
-            res = -ENOMEM;
-        }
-        return res;
+    if ((res = node->open()) == 0) {
+        res = node->write(dest, strlen(dest), 0);
+        node->close();
     }
-    res = node->write(dest, strlen(dest), 0);
-    node->close();
-    return (res < 0) ? -ENOMEM : 0;
+    if (res < 0) {
+        // half-created link must not be saved
+        get_data()->removeNode(node);
+        return (res == -EMFILE) ? -ENOMEM : res;
+    }
+    return 0;
 }
 
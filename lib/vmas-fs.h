@@ -18,19 +18,29 @@ extern "C" {
  *
  * @param program   Program name
  * @param fileName  ZIP file name
+ * @param readonly  Open archive in read-only mode
+ * @param lazy      Build only name index at mount, create nodes on demand
+ * @param indexDir  Directory for mount index file ("" - next to archive,
+ *                  NULL - do not use mount index)
  * @return NULL if an error occured, otherwise pointer to VmasFSData structure.
  */
 class VmasFSData *initVmasFS(const char *program, const char *fileName,
-        bool readonly);
+        bool readonly, bool lazy, const char *indexDir);
 
 /**
  * Initialize filesystem
  *
- * Report current working dir and archive file name to syslog.
+ * Negotiate I/O request sizes (big writes, max_write, max_read,
+ * max_readahead) with kernel, start archive I/O threads, report current
+ * working dir and archive file name to syslog.
  *
  * @return filesystem-private data
  */
+#if FUSE_USE_VERSION >= 30
+void *vmasfs_init(struct fuse_conn_info *conn, struct fuse_config *cfg);
+#else
 void *vmasfs_init(struct fuse_conn_info *conn);
+#endif
 
 /**
  * Destroy filesystem
@@ -40,9 +50,17 @@ void *vmasfs_init(struct fuse_conn_info *conn);
  */
 void vmasfs_destroy(void *data);
 
+#if FUSE_USE_VERSION >= 30
+int vmasfs_getattr(const char *path, struct stat *stbuf, struct fuse_file_info *fi);
+#else
 int vmasfs_getattr(const char *path, struct stat *stbuf);
+#endif
 
+#if FUSE_USE_VERSION >= 30
+int vmasfs_readdir(const char *path, void *buf, fuse_fill_dir_t filler, off_t offset, struct fuse_file_info *fi, enum fuse_readdir_flags flags);
+#else
 int vmasfs_readdir(const char *path, void *buf, fuse_fill_dir_t filler, off_t offset, struct fuse_file_info *fi);
+#endif
 
 int vmasfs_statfs(const char *path, struct statvfs *buf);
 
@@ -58,7 +76,11 @@ int vmasfs_release (const char *path, struct fuse_file_info *fi);
 
 int vmasfs_ftruncate(const char *path, off_t offset, struct fuse_file_info *fi);
 
+#if FUSE_USE_VERSION >= 30
+int vmasfs_truncate(const char *path, off_t offset, struct fuse_file_info *fi);
+#else
 int vmasfs_truncate(const char *path, off_t offset);
+#endif
 
 int vmasfs_unlink(const char *path);
 
@@ -66,9 +88,17 @@ int vmasfs_rmdir(const char *path);
 
 int vmasfs_mkdir(const char *path, mode_t mode);
 
+#if FUSE_USE_VERSION >= 30
+int vmasfs_rename(const char *path, const char *new_path, unsigned int flags);
+#else
 int vmasfs_rename(const char *path, const char *new_path);
+#endif
 
+#if FUSE_USE_VERSION >= 30
+int vmasfs_utimens(const char *path, const struct timespec tv[2], struct fuse_file_info *fi);
+#else
 int vmasfs_utimens(const char *path, const struct timespec tv[2]);
+#endif
 
 #if ( __APPLE__ )
 int vmasfs_setxattr(const char *, const char *, const char *, size_t, int, uint32_t);
@@ -82,9 +112,14 @@ int vmasfs_listxattr(const char *, char *, size_t);
 
 int vmasfs_removexattr(const char *, const char *);
 
+#if FUSE_USE_VERSION >= 30
+int vmasfs_chmod(const char *, mode_t, struct fuse_file_info *);
+int vmasfs_chown(const char *, uid_t, gid_t, struct fuse_file_info *);
+#else
 int vmasfs_chmod(const char *, mode_t);
 
 int vmasfs_chown(const char *, uid_t, gid_t);
+#endif
 
 int vmasfs_flush(const char *, struct fuse_file_info *);
 
@@ -6,13 +6,37 @@
 
 #include <zip.h>
 #include <syslog.h>
+#include <fcntl.h>
 #include <cerrno>
+#include <cstdio>
+#include <ctime>
 #include <cassert>
 #include <stdexcept>
+#include <algorithm>
+#include <new>
 
 #include "vmasFSData.h"
+#include "centralDirectory.h"
+#include "probes.h"
+#include "saveProfile.h"
 
-VmasFSData::VmasFSData(const char *archiveName, struct zip *z, const char *cwd): m_zip(z), m_archiveName(archiveName), m_cwd(cwd)  {
+#define STANDARD_BLOCK_SIZE (512)
+
+const size_t VmasFSData::DECRYPT_ITEM_SIZE;
+const size_t VmasFSData::SLOWEST_ENTRIES;
+const char VmasFSData::STATS_DIR_NAME[] = ".vmasfs";
+const char VmasFSData::STATS_FILE_NAME[] = "stats";
+const zip_uint64_t VmasFSData::ROOT_INO = 1;
+const zip_uint64_t VmasFSData::FIRST_ENTRY_INO = 2;
+
+VmasFSData::VmasFSData(const char *archiveName, struct zip *z, const char *cwd): m_root(NULL), m_nodeCount(0), m_pendingNodes(0), m_nextIno(FIRST_ENTRY_INO), m_generation(time(NULL)), m_lazy(false), m_ioDepth(0), m_statsDir(NULL), m_statsFile(NULL), m_statsHidden(false), m_lastParent(NULL), m_streamZip(NULL), m_streamZipFailed(false), m_zip(z), m_archiveName(archiveName), m_cwd(cwd), m_entryTimeout(1.0), m_attrTimeout(1.0), m_writebackCache(false), m_maxWrite(0), m_maxRead(0), m_maxReadahead(0), m_streamSize(0), m_decryptItemSize(DECRYPT_ITEM_SIZE), m_progressInterval(0)  {
+    pthread_rwlock_init(&m_treeLock, NULL);
+    pthread_mutex_init(&m_materializeLock, NULL);
+    pthread_mutex_init(&m_zipLock, NULL);
+    pthread_mutex_init(&m_streamLock, NULL);
+    for (size_t i = 0; i < NODE_LOCK_COUNT; ++i) {
+        pthread_mutex_init(&m_nodeLocks[i], NULL);
+    }
 }
 
 VmasFSData::~VmasFSData() {
@@ -23,40 +47,169 @@ VmasFSData::~VmasFSData() {
             chdir("/tmp");
         }
     }
+    m_latencyDumper.stop();
+    m_io.stop();
+    if (m_streamZip != NULL) {
+        zip_discard(m_streamZip);
+    }
+    if (m_io.stats().reads != 0) {
+        IOEngine::Stats st = m_io.stats();
+        syslog(LOG_INFO, "archive reads: %llu calls, %llu requests (max %u in flight), %llu bytes, %llu errors",
+                (unsigned long long)st.reads,
+                (unsigned long long)st.requests, st.maxInFlight,
+                (unsigned long long)st.bytes,
+                (unsigned long long)st.errors);
+    }
+    {
+        uint64_t hits, misses;
+        m_decryptCache.stats(hits, misses);
+        if (hits != 0) {
+            syslog(LOG_INFO, "decrypted data cache: %llu hits, %llu misses",
+                    (unsigned long long)hits, (unsigned long long)misses);
+        }
+        m_decryptCache.clear();
+    }
+    SaveProfile profile;
+    BigBuffer::saveProfile = &profile;
+    if (m_progressInterval != 0) {
+        zip_register_progress_callback_with_state(m_zip, 0.01,
+                saveProgress, NULL, this);
+    }
+    uint64_t started = Statistics::now();
+    m_lastProgress = started;
     int res = zip_close(m_zip);
+    uint64_t elapsed = Statistics::now() - started;
+    TraceLog::global.complete("save", "zip_close", started, elapsed);
+    BigBuffer::saveProfile = NULL;
     if (res != 0) {
         syslog(LOG_ERR, "Error while closing archive: %s", zip_strerror(m_zip));
+    } else {
+        syslog(LOG_INFO, "archive closed in %llu ms",
+                (unsigned long long)elapsed / 1000000);
+        CentralDirectory cd;
+        if (!profile.entries().empty() && cd.open(m_archiveName)) {
+            profile.readSizes(cd);
+        }
+        profile.report(elapsed, SLOWEST_ENTRIES);
+    }
+    if (m_root != NULL) {
+        releaseTree(m_root);
+    }
+    for (std::set<FileNode *>::const_iterator i = m_orphans.begin();
+            i != m_orphans.end(); ++i) {
+        releaseTree(*i);
+    }
+    if (m_statsDir != NULL) {
+        releaseTree(m_statsDir);
+    }
+    // memory of nodes, names and child maps is freed with m_arena
+
+    for (size_t i = 0; i < NODE_LOCK_COUNT; ++i) {
+        pthread_mutex_destroy(&m_nodeLocks[i]);
     }
-    for (filemap_t::iterator i = files.begin(); i != files.end(); ++i) {
-        delete i->second;
+    pthread_mutex_destroy(&m_zipLock);
+    pthread_mutex_destroy(&m_streamLock);
+    pthread_mutex_destroy(&m_materializeLock);
+    pthread_rwlock_destroy(&m_treeLock);
+}
+
+void VmasFSData::releaseTree(FileNode *node) {
+    for (filemap_t::const_iterator i = node->childs.begin();
+            i != node->childs.end(); ++i) {
+        releaseTree(i->second);
+    }
+    if (node->isFromArena(&m_arena)) {
+        node->releaseBuffer();
+    } else {
+        delete node;
     }
 }
 
+zip_int64_t VmasFSData::smallestEncryptedEntry() const {
+    zip_int64_t n = zip_get_num_entries(m_zip, 0);
+    zip_int64_t best = -1;
+    zip_uint64_t bestSize = 0;
+    for (zip_int64_t i = 0; i < n; ++i) {
+        struct zip_stat st;
+        if (zip_stat_index(m_zip, i, 0, &st) != 0 ||
+                !(st.valid & ZIP_STAT_ENCRYPTION_METHOD) ||
+                st.encryption_method == ZIP_EM_NONE) {
+            continue;
+        }
+        zip_uint64_t size = (st.valid & ZIP_STAT_COMP_SIZE) ? st.comp_size : 0;
+        if (best == -1 || size < bestSize) {
+            best = i;
+            bestSize = size;
+        }
+    }
+    return best;
+}
+
 bool VmasFSData::try_passwd(const char *pass) {
-    int zep, try_count;
-    struct zip_file *zf;
+    zip_int64_t best = smallestEncryptedEntry();
+    if (best == -1) {
+        // nothing to decrypt, password is used to encrypt new files
+        syslog(LOG_NOTICE, "archive has no encrypted entries, new and changed files will be encrypted with unverified password");
+        BigBuffer::passwd = pass;
+        return true;
+    }
 
-    try_count = 1;
-just_try:
-    zep = 0;
-    zf = BigBuffer::open(m_zip, 0, &zep);
+    // libzip checks password against encryption header (or password
+    // verifier for AES) when entry is opened, data is not decrypted
+    struct zip_file *zf = zip_fopen_index_encrypted(m_zip, best, 0, pass);
     if (zf == NULL) {
-        if (ZIP_ER_NOPASSWD == zep && try_count--) {
-            BigBuffer::passwd = pass;
-            goto just_try;
+        return false;
+    }
+    zip_fclose(zf);
+    BigBuffer::passwd = pass;
+    return true;
+}
+
+void VmasFSData::build_tree(bool readonly, bool lazy, const char *indexPath) {
+    m_lazy = lazy;
+    m_root = FileNode::createRootNode(&m_arena);
+    m_root->parent = NULL;
+    m_root->childsLoaded = !lazy;
+    m_root->ino = ROOT_INO;
+    // inodes for new nodes are allocated after inodes of ZIP entries
+    zip_int64_t entries = zip_get_num_entries(m_zip, 0);
+    m_nextIno = FIRST_ENTRY_INO + (entries > 0 ? entries : 0);
+
+    CentralDirectory cd;
+    MountIndex::Key key;
+    bool haveCD = (indexPath != NULL || readonly) && cd.open(m_archiveName);
+    bool useIndex = indexPath != NULL && haveCD;
+    if (useIndex) {
+        MountIndex::makeKey(cd, readonly, key);
+        if (m_mountIndex.load(indexPath, key)) {
+            build_from_records(m_mountIndex.records(), m_mountIndex.count(),
+                    m_mountIndex.names());
+            return;
         }
     }
 
-    return zf != NULL;
-}
+    if (readonly && haveCD && read_central_directory(cd)) {
+        if (!m_records.empty()) {
+            build_from_records(&m_records[0], m_records.size(),
+                    &m_indexNames[0]);
+        }
+    } else {
+        build_with_libzip(readonly, lazy);
+    }
+
+    m_lastParent = NULL;
 
-void VmasFSData::build_tree(bool readonly) {
-    m_root = FileNode::createRootNode();
-    if (m_root == NULL) {
-        throw std::bad_alloc();
+    if (useIndex) {
+        save_mount_index(indexPath, key, cd);
     }
-    m_root->parent = NULL;
-    files[m_root->full_name.c_str()] = m_root;
+    if (!lazy) {
+        // nodes keep their own copies of names and attributes
+        std::vector<EntryRecord>().swap(m_records);
+        std::vector<char>().swap(m_indexNames);
+    }
+}
+
+void VmasFSData::build_with_libzip(bool readonly, bool lazy) {
     zip_int64_t n = zip_get_num_entries(m_zip, 0);
     // search for absolute or parent-relative paths
     bool needPrefix = false;
@@ -69,64 +222,786 @@ void VmasFSData::build_tree(bool readonly) {
             }
         }
     }
+    if (lazy) {
+        build_index(n, readonly, needPrefix);
+        return;
+    }
     // add zip entries into tree
     for (zip_int64_t i = 0; i < n; ++i) {
         const char *name = zip_get_name(m_zip, i, ZIP_FL_ENC_RAW);
         std::string converted;
         convertFileName(name, readonly, needPrefix, converted);
         const char *cname = converted.c_str();
-        if (files.find(cname) != files.end()) {
+        FileNode *node = FileNode::createNodeForZipEntry(m_zip, cname, i,
+                &m_arena);
+        connectNodeToTree (node, cname);
+    }
+}
+
+/**
+ * Order entry records by name
+ */
+struct VmasFSData::RecordLess {
+    const char *names;
+
+    RecordLess(const char *n): names(n) {}
+
+    bool operator() (const EntryRecord &r1, const EntryRecord &r2) const {
+        return strcmp(names + r1.nameOffset, names + r2.nameOffset) < 0;
+    }
+};
+
+bool VmasFSData::read_central_directory(const CentralDirectory &cd) {
+    zip_int64_t n = zip_get_num_entries(m_zip, 0);
+    if (n < 0 || (zip_uint64_t)n != cd.count()) {
+        return false;
+    }
+    // search for absolute or parent-relative paths
+    bool needPrefix = false;
+    zip_uint64_t pos = 0;
+    CentralDirectory::Entry entry;
+    while (!cd.atEnd(pos)) {
+        if (!cd.readEntry(pos, entry)) {
+            syslog(LOG_WARNING, "unable to parse central directory, using libzip");
+            return false;
+        }
+        if ((entry.nameLength > 0 && entry.name[0] == '/') ||
+                (entry.nameLength >= 3 && strncmp(entry.name, "../", 3) == 0)) {
+            needPrefix = true;
+        }
+    }
+
+    m_records.reserve(n);
+    pos = 0;
+    std::string name;
+    for (zip_int64_t i = 0; !cd.atEnd(pos); ++i) {
+        if (i == n || !cd.readEntry(pos, entry)) {
+            m_records.clear();
+            m_indexNames.clear();
+            return false;
+        }
+        name.assign(entry.name, entry.nameLength);
+        std::string converted;
+        convertFileName(name.c_str(), true, needPrefix, converted);
+
+        EntryRecord rec;
+        memset(&rec, 0, sizeof(rec));
+        rec.id = i;
+        rec.offset = entry.offset;
+        if (converted.size() > 1 && converted[converted.size() - 1] == '/') {
+            converted.resize(converted.size() - 1);
+            rec.flags |= EntryRecord::IS_DIR;
+        }
+        FileNode::readRecord(entry, rec);
+        rec.nameOffset = m_indexNames.size();
+        m_indexNames.insert(m_indexNames.end(), converted.c_str(),
+                converted.c_str() + converted.size() + 1);
+        m_records.push_back(rec);
+    }
+    if (m_records.size() != (size_t)n) {
+        m_records.clear();
+        m_indexNames.clear();
+        return false;
+    }
+
+    if (m_records.empty()) {
+        return true;
+    }
+    std::sort(m_records.begin(), m_records.end(),
+            RecordLess(&m_indexNames[0]));
+    for (size_t i = 1; i < m_records.size(); ++i) {
+        const char *cname = &m_indexNames[m_records[i].nameOffset];
+        if (strcmp(&m_indexNames[m_records[i - 1].nameOffset], cname) == 0) {
             syslog(LOG_ERR, "duplicated file name: %s", cname);
             throw std::runtime_error("duplicate file names");
         }
-        FileNode *node = FileNode::createNodeForZipEntry(m_zip, cname, i);
-        if (node == NULL) {
-            throw std::bad_alloc();
+    }
+    return true;
+}
+
+void VmasFSData::build_from_records(const EntryRecord *records,
+        zip_uint64_t n, const char *names) {
+    if (m_lazy) {
+        // records are already sorted by name
+        m_index.resize(n);
+        for (zip_uint64_t i = 0; i < n; ++i) {
+            const EntryRecord &rec = records[i];
+            IndexEntry &e = m_index[i];
+            e.name = names + rec.nameOffset;
+            e.id = rec.id;
+            e.record = &rec;
+            e.is_dir = (rec.flags & EntryRecord::IS_DIR) != 0;
         }
-        files[node->full_name.c_str()] = node;
+        check_index();
+        return;
     }
-    // Connect nodes to tree. Missing intermediate nodes created on demand.
-    for (filemap_t::const_iterator i = files.begin(); i != files.end(); ++i)
-    {
-        FileNode *node = i->second;
-        if (node != m_root) {
-            connectNodeToTree (node);
+    for (zip_uint64_t i = 0; i < n; ++i) {
+        const EntryRecord &rec = records[i];
+        FileNode *node = FileNode::createNodeFromRecord(m_zip,
+                names + rec.nameOffset, rec, &m_arena);
+        connectNodeToTree (node, names + rec.nameOffset);
+    }
+}
+
+void VmasFSData::save_mount_index(const char *indexPath,
+        const MountIndex::Key &key, const CentralDirectory &cd) {
+    if (!m_records.empty()) {
+        // records are read from central directory and already complete
+        if (!MountIndex::save(indexPath, key, m_records, m_indexNames)) {
+            syslog(LOG_WARNING, "unable to save mount index %s: %s",
+                    indexPath, strerror(errno));
+        }
+        return;
+    }
+    std::vector<zip_uint64_t> offsets;
+    if (!cd.localHeaderOffsets(offsets) ||
+            offsets.size() != (size_t)zip_get_num_entries(m_zip, 0)) {
+        syslog(LOG_WARNING, "unable to parse central directory, mount index is not saved");
+        return;
+    }
+    std::vector<EntryRecord> records;
+    std::vector<char> names;
+    records.reserve(offsets.size());
+    if (m_lazy) {
+        // nodes are not created yet, so attributes are read from central
+        // directory the same way as in read-only mode
+        std::vector<CentralDirectory::Entry> entries;
+        entries.reserve(offsets.size());
+        zip_uint64_t pos = 0;
+        CentralDirectory::Entry entry;
+        while (!cd.atEnd(pos) && cd.readEntry(pos, entry)) {
+            entries.push_back(entry);
+        }
+        if (entries.size() != offsets.size()) {
+            syslog(LOG_WARNING, "unable to parse central directory, mount index is not saved");
+            return;
+        }
+        // name index is sorted, so records are sorted too
+        for (nameindex_t::const_iterator i = m_index.begin();
+                i != m_index.end(); ++i) {
+            EntryRecord rec;
+            memset(&rec, 0, sizeof(rec));
+            rec.id = i->id;
+            if (i->is_dir) {
+                rec.flags |= EntryRecord::IS_DIR;
+            }
+            FileNode::readRecord(entries[i->id], rec);
+            rec.nameOffset = names.size();
+            names.insert(names.end(), i->name, i->name + strlen(i->name) + 1);
+            records.push_back(rec);
+        }
+    } else {
+        std::string path;
+        collectRecords(m_root, path, records, names);
+        if (!records.empty()) {
+            std::sort(records.begin(), records.end(), RecordLess(&names[0]));
+        }
+    }
+    for (std::vector<EntryRecord>::iterator i = records.begin();
+            i != records.end(); ++i) {
+        i->offset = offsets[i->id];
+    }
+    if (!MountIndex::save(indexPath, key, records, names)) {
+        syslog(LOG_WARNING, "unable to save mount index %s: %s", indexPath,
+                strerror(errno));
+    }
+}
+
+void VmasFSData::collectRecords(const FileNode *dir, std::string &path,
+        std::vector<EntryRecord> &records, std::vector<char> &names) {
+    for (filemap_t::const_iterator i = dir->childs.begin();
+            i != dir->childs.end(); ++i) {
+        const FileNode *node = i->second;
+        size_t len = path.size();
+        if (len != 0) {
+            path.push_back('/');
+        }
+        path.append(node->name());
+        if (node->id >= 0) {
+            EntryRecord rec;
+            node->fillRecord(rec);
+            rec.nameOffset = names.size();
+            names.insert(names.end(), path.c_str(),
+                    path.c_str() + path.size() + 1);
+            records.push_back(rec);
         }
+        if (node->is_dir) {
+            collectRecords(node, path, records, names);
+        }
+        path.resize(len);
     }
 }
 
-void VmasFSData::connectNodeToTree (FileNode *node) {
-    FileNode *parent = findParent(node);
-    if (parent == NULL) {
-        parent = FileNode::createIntermediateDir (m_zip,
-                node->getParentName().c_str());
-        if (parent == NULL) {
-            throw std::bad_alloc();
+void VmasFSData::build_index(zip_int64_t n, bool readonly, bool needPrefix) {
+    // names are stored in one block, offsets are kept in place of
+    // pointers until all names are added
+    std::vector<size_t> offsets(n);
+    m_index.resize(n);
+    for (zip_int64_t i = 0; i < n; ++i) {
+        const char *name = zip_get_name(m_zip, i, ZIP_FL_ENC_RAW);
+        IndexEntry &e = m_index[i];
+        std::string converted;
+        convertFileName(name, readonly, needPrefix, converted);
+        e.id = i;
+        e.record = NULL;
+        e.is_dir = false;
+        if (converted.size() > 1 && converted[converted.size() - 1] == '/') {
+            converted.resize(converted.size() - 1);
+            e.is_dir = true;
+        }
+        offsets[i] = m_indexNames.size();
+        m_indexNames.insert(m_indexNames.end(), converted.c_str(),
+                converted.c_str() + converted.size() + 1);
+    }
+    for (zip_int64_t i = 0; i < n; ++i) {
+        m_index[i].name = &m_indexNames[offsets[i]];
+    }
+    std::sort(m_index.begin(), m_index.end(), IndexEntryLess());
+    for (nameindex_t::size_type i = 1; i < m_index.size(); ++i) {
+        if (strcmp(m_index[i - 1].name, m_index[i].name) == 0) {
+            syslog(LOG_ERR, "duplicated file name: %s", m_index[i].name);
+            throw std::runtime_error("duplicate file names");
+        }
+    }
+    check_index();
+}
+
+void VmasFSData::check_index() {
+    // intermediate directories, created once on materialization
+    std::set<std::string> implicitDirs;
+    std::string dir;
+    for (nameindex_t::const_iterator i = m_index.begin();
+            i != m_index.end(); ++i) {
+        size_t len = strlen(i->name);
+        while (true) {
+            while (len > 0 && i->name[len - 1] != '/') {
+                --len;
+            }
+            if (len == 0) {
+                break;
+            }
+            dir.assign(i->name, --len);
+            nameindex_t::const_iterator parent = std::lower_bound(
+                    m_index.begin(), m_index.end(), dir.c_str(),
+                    IndexEntryLess());
+            if (parent != m_index.end() && dir == parent->name) {
+                if (!parent->is_dir) {
+                    syslog(LOG_ERR, "bad archive structure: %s is not a directory",
+                            dir.c_str());
+                    throw std::runtime_error("bad archive structure");
+                }
+                break;
+            }
+            if (!implicitDirs.insert(dir).second) {
+                // ancestors are already checked
+                break;
+            }
+        }
+    }
+    m_pendingNodes = m_index.size() + implicitDirs.size();
+}
+
+void VmasFSData::materialize (FileNode *dir) {
+    assert(dir->is_dir);
+    // readers holding shared tree lock may materialize directories
+    // concurrently
+    MutexLock lock(m_materializeLock);
+    if (dir->childsLoaded) {
+        return;
+    }
+
+    std::string prefix = dir->fullName();
+    if (!prefix.empty()) {
+        prefix.push_back('/');
+    }
+    nameindex_t::iterator i = std::lower_bound(m_index.begin(),
+            m_index.end(), prefix.c_str(), IndexEntryLess());
+    while (i != m_index.end() &&
+            strncmp(i->name, prefix.c_str(), prefix.size()) == 0) {
+        const char *rest = i->name + prefix.size();
+        const char *slash = strchr(rest, '/');
+        if (slash == NULL) {
+            // direct child. Skip if node is already created in
+            // not-yet-visited directory
+            if (dir->findChild(rest) == NULL) {
+                FileNode *node;
+                if (i->record != NULL) {
+                    node = FileNode::createNodeFromRecord(m_zip, i->name,
+                            *i->record, &m_arena);
+                } else if (i->is_dir) {
+                    MutexLock zipLock(m_zipLock);
+                    node = FileNode::createNodeForZipEntry(m_zip,
+                            (std::string(i->name) + '/').c_str(), i->id,
+                            &m_arena);
+                } else {
+                    MutexLock zipLock(m_zipLock);
+                    node = FileNode::createNodeForZipEntry(m_zip, i->name,
+                            i->id, &m_arena);
+                }
+                node->childsLoaded = !node->is_dir;
+                attachNode (dir, node);
+                __atomic_sub_fetch(&m_pendingNodes, 1, __ATOMIC_RELAXED);
+            }
+            ++i;
+        } else {
+            // entry from subdirectory: make sure that subdirectory node
+            // exists and skip the whole subtree
+            std::string sub(rest, slash - rest);
+            FileNode *child = dir->findChild(sub.c_str());
+            if (child == NULL) {
+                child = FileNode::createIntermediateDir(m_zip, sub.c_str(),
+                        &m_arena);
+                child->childsLoaded = false;
+                attachNode (dir, child);
+                __atomic_sub_fetch(&m_pendingNodes, 1, __ATOMIC_RELAXED);
+            } else if (!child->is_dir) {
+                syslog(LOG_ERR, "bad archive structure: %s is not a directory",
+                        std::string(i->name, slash - i->name).c_str());
+            }
+            // all names started with "sub/" are less than "sub0"
+            std::string next(i->name, slash - i->name);
+            next.push_back('/' + 1);
+            i = std::lower_bound(i, m_index.end(), next.c_str(),
+                    IndexEntryLess());
+        }
+    }
+    // publish complete child map to readers checking the flag without lock
+    __atomic_store_n(&dir->childsLoaded, true, __ATOMIC_RELEASE);
+}
+
+void VmasFSData::loadTree (FileNode *dir) {
+    if (!m_lazy) {
+        return;
+    }
+    loadChilds(dir);
+    for (filemap_t::const_iterator i = dir->childs.begin();
+            i != dir->childs.end(); ++i) {
+        if (i->second->is_dir) {
+            loadTree(i->second);
+        }
+    }
+}
+
+FileNode *VmasFSData::makeParents (const char *fname, size_t len) {
+    FileNode *dir = m_root;
+    std::string component;
+    size_t start = 0;
+    while (start < len) {
+        const char *slash = (const char *)memchr(fname + start, '/',
+                len - start);
+        size_t end = (slash == NULL) ? len : slash - fname;
+        component.assign(fname + start, end - start);
+        FileNode *child = dir->findChild(component.c_str());
+        if (child == NULL) {
+            child = FileNode::createIntermediateDir (m_zip,
+                    component.c_str(), &m_arena);
+            attachNode (dir, child);
+        } else if (!child->is_dir) {
+            throw std::runtime_error ("bad archive structure");
+        }
+        dir = child;
+        start = end + 1;
+    }
+    return dir;
+}
+
+void VmasFSData::connectNodeToTree (FileNode *node, const char *fname) {
+    // parent name is a part of fname before short name
+    size_t len = strlen(fname);
+    if (len > 0 && fname[len - 1] == '/') {
+        --len;
+    }
+    while (len > 0 && fname[len - 1] != '/') {
+        --len;
+    }
+    if (len > 0) {
+        --len;
+    }
+
+    FileNode *parent;
+    try {
+        // entries of the same directory usually follow each other
+        if (m_lastParent != NULL && m_lastParentName.size() == len &&
+                strncmp(m_lastParentName.c_str(), fname, len) == 0) {
+            parent = m_lastParent;
+        } else {
+            parent = makeParents (fname, len);
+            m_lastParent = parent;
+            m_lastParentName.assign(fname, len);
+        }
+
+        FileNode *old = parent->findChild (node->name());
+        if (old != NULL) {
+            if (!old->isTemporaryDir()) {
+                syslog(LOG_ERR, "duplicated file name: %s", fname);
+                throw std::runtime_error("duplicate file names");
+            }
+            if (!node->is_dir) {
+                throw std::runtime_error ("bad archive structure");
+            }
+            // replace intermediate directory created for one of previous
+            // entries
+            for (filemap_t::const_iterator i = old->childs.begin();
+                    i != old->childs.end(); ++i) {
+                i->second->parent = node;
+            }
+            node->childs.swap(old->childs);
+            parent->detachChild (old);
+            if (m_lastParent == old) {
+                m_lastParent = NULL;
+            }
+            delete old;
+            __atomic_sub_fetch(&m_nodeCount, 1, __ATOMIC_RELAXED);
+        }
+    }
+    catch (...) {
+        delete node;
+        throw;
+    }
+
+    attachNode (parent, node);
+}
+
+void VmasFSData::attachNode (FileNode *parent, FileNode *node) {
+    if (node->ino == 0) {
+        // ZIP entry indices are not reused while archive is open, so
+        // entries keep the same inodes regardless of materialization
+        // order (and across mounts of unchanged archive)
+        if (node->id >= 0) {
+            node->ino = FIRST_ENTRY_INO + node->id;
+        } else {
+            node->ino = m_nextIno++;
         }
-        files[parent->full_name.c_str()] = parent;
-        connectNodeToTree (parent);
-    } else if (!parent->is_dir) {
-        throw std::runtime_error ("bad archive structure");
     }
-    // connecting to parent
     node->parent = parent;
     parent->appendChild (node);
+    __atomic_add_fetch(&m_nodeCount, 1, __ATOMIC_RELAXED);
 }
 
-int VmasFSData::removeNode(FileNode *node) {
+int VmasFSData::detachNode(FileNode *node, bool deleteEntry) {
     assert(node != NULL);
     assert(node->parent != NULL);
+    assert(node->childs.empty());
     node->parent->detachChild (node);
     node->parent->setCTime (time(NULL));
-    files.erase(node->full_name.c_str());
+    node->parent = NULL;
+    __atomic_sub_fetch(&m_nodeCount, 1, __ATOMIC_RELAXED);
+
+    if (deleteEntry && node->id >= 0) {
+        MutexLock zipLock(m_zipLock);
+        return (zip_delete (m_zip, node->id) == 0)? 0 : ENOENT;
+    } else {
+        return 0;
+    }
+}
 
-    zip_int64_t id = node->id;
+int VmasFSData::removeNode(FileNode *node) {
+    int res = detachNode (node);
     delete node;
-    if (id >= 0) {
-        return (zip_delete (m_zip, id) == 0)? 0 : ENOENT;
+    return res;
+}
+
+int VmasFSData::unlinkNode(FileNode *node) {
+    if (__atomic_load_n(&node->nlookup, __ATOMIC_ACQUIRE) == 0) {
+        return removeNode(node);
+    }
+    bool deferred = false;
+    if (node->id >= 0) {
+        try {
+            m_orphanEntries.push_back(node->id);
+            deferred = true;
+        }
+        catch (const std::bad_alloc &) {
+            // entry is deleted now, data of orphan is lost if not loaded
+        }
+    }
+    int res = detachNode (node, !deferred);
+    m_orphans.insert(node);
+    return res;
+}
+
+void VmasFSData::deleteOrphan(FileNode *node) {
+    if (m_orphans.erase(node) != 0) {
+        delete node;
+    }
+}
+
+int VmasFSData::loadNode(FileNode *node) {
+    if (!node->isUnloaded()) {
+        return 0;
+    }
+    bool cached = node->isEncrypted() && node->id >= 0 &&
+        m_decryptCache.isEnabled() && node->m_size <= m_decryptItemSize;
+    std::vector<char> data;
+    if (cached) {
+        // cached data takes node buffer memory as inflated data does
+        if (!BigBuffer::fits(node->m_size)) {
+            return -ENOMEM;
+        }
+        try {
+            data.resize(node->m_size);
+            if (m_decryptCache.get(node->id, &data[0], data.size())) {
+                node->buffer = new BigBuffer();
+                node->buffer->write(&data[0], data.size(), 0);
+                wipeData(data);
+                return 0;
+            }
+        }
+        catch (std::bad_alloc) {
+            delete node->buffer;
+            node->buffer = NULL;
+            wipeData(data);
+            return -ENOMEM;
+        }
+    }
+    int res;
+    {
+        MutexLock zipLock(m_zipLock);
+        res = node->load();
+    }
+    if (res == 0 && cached && !data.empty()) {
+        node->buffer->read(&data[0], data.size(), 0);
+        m_decryptCache.put(node->id, &data[0], data.size());
+        wipeData(data);
+    }
+    return res;
+}
+
+void VmasFSData::wipeData(std::vector<char> &data) {
+    volatile char *p = data.empty() ? NULL : &data[0];
+    for (size_t i = 0; i < data.size(); ++i) {
+        p[i] = 0;
+    }
+}
+
+void VmasFSData::setDecryptCache(size_t capacity) {
+    m_decryptCache.setLimits(capacity, m_decryptItemSize);
+}
+
+void VmasFSData::openIO(unsigned int depth) {
+    CentralDirectory cd;
+    if (!cd.open(m_archiveName) || !cd.localHeaderOffsets(m_localHeaders) ||
+            m_localHeaders.size() != (size_t)zip_get_num_entries(m_zip, 0) ||
+            !m_io.open(m_archiveName)) {
+        syslog(LOG_WARNING, "unable to parse central directory, archive data is read via libzip");
+        std::vector<zip_uint64_t>().swap(m_localHeaders);
+        return;
+    }
+    m_ioDepth = depth;
+}
+
+void VmasFSData::saveProgress(zip_t *, double progress, void *data) {
+    VmasFSData *d = (VmasFSData *)data;
+    uint64_t now = Statistics::now();
+    if (now - d->m_lastProgress >= (uint64_t)d->m_progressInterval * 1000000000) {
+        d->m_lastProgress = now;
+        syslog(LOG_INFO, "saving archive: %d%% done", (int)(progress * 100));
+    }
+}
+
+void VmasFSData::startIO() {
+    if (m_io.isOpen()) {
+        m_io.start(m_ioDepth);
+    }
+}
+
+void VmasFSData::setLatencyFile(const char *fileName) {
+    // process is daemonized and changes directory to root
+    if (fileName[0] == '/') {
+        m_latencyDumper.setFileName(fileName);
     } else {
+        m_latencyDumper.setFileName(m_cwd + "/" + fileName);
+    }
+}
+
+void VmasFSData::startLatencyDumper() {
+    m_latencyDumper.start();
+}
+
+off_t VmasFSData::storedDataOffset(FileNode *node) {
+    if (!m_io.isOpen() || node->id < 0 ||
+            (zip_uint64_t)node->id >= m_localHeaders.size()) {
+        return -1;
+    }
+    struct zip_stat st;
+    {
+        MutexLock zipLock(m_zipLock);
+        if (zip_stat_index(m_zip, node->id, 0, &st) != 0) {
+            return -1;
+        }
+    }
+    const zip_uint64_t need = ZIP_STAT_SIZE | ZIP_STAT_COMP_SIZE |
+        ZIP_STAT_COMP_METHOD | ZIP_STAT_ENCRYPTION_METHOD;
+    if ((st.valid & need) != need || st.comp_method != ZIP_CM_STORE ||
+            st.encryption_method != ZIP_EM_NONE || st.comp_size != st.size) {
+        return -1;
+    }
+    zip_uint8_t header[CentralDirectory::LOCAL_HEADER_SIZE];
+    zip_uint64_t offset = m_localHeaders[node->id];
+    zip_uint64_t dataOffset;
+    if (m_io.read((char *)header, sizeof(header), offset) != sizeof(header) ||
+            !CentralDirectory::localDataOffset(header, offset, dataOffset)) {
+        return -1;
+    }
+    return dataOffset;
+}
+
+bool VmasFSData::openData(FileHandle *handle) {
+    FileNode *node = handle->node;
+    if (node == m_statsFile) {
+        // size of rendered text is not known in advance
+        try {
+            std::string *text = new std::string();
+            handle->text = text;
+            printStats(*text);
+        }
+        catch (std::bad_alloc) {
+            // reported by readFile
+        }
+        return true;
+    }
+    if ((handle->flags & O_ACCMODE) != O_RDONLY || !node->isUnloaded()) {
+        return false;
+    }
+    handle->dataOffset = storedDataOffset(node);
+    // data that does not fit into buffer memory limit is streamed too
+    if ((handle->flags & O_DIRECT) == 0 &&
+            (m_streamSize == 0 || node->size() < m_streamSize) &&
+            BigBuffer::fits(node->size())) {
+        return false;
+    }
+    if (handle->dataOffset >= 0) {
+        // stored data is read directly from archive without stream
+        return true;
+    }
+    MutexLock streamLock(m_streamLock);
+    struct zip *z = streamArchive();
+    if (z == NULL) {
+        // data is loaded into node buffer
+        return false;
+    }
+    handle->stream = new (std::nothrow) ZipStream(z, node->id,
+            node->isEncrypted());
+    return handle->stream != NULL;
+}
+
+struct zip *VmasFSData::streamArchive() {
+    if (m_streamZip != NULL || m_streamZipFailed) {
+        return m_streamZip;
+    }
+    // process is daemonized and changes directory to root
+    std::string name = m_archiveName;
+    if (name[0] != '/') {
+        name = m_cwd + "/" + name;
+    }
+    int err;
+    m_streamZip = zip_open(name.c_str(), ZIP_RDONLY, &err);
+    if (m_streamZip == NULL) {
+        char buf[0x100];
+        zip_error_to_str(buf, sizeof(buf), err, errno);
+        syslog(LOG_WARNING, "unable to open %s for streaming: %s",
+                name.c_str(), buf);
+        m_streamZipFailed = true;
+    }
+    return m_streamZip;
+}
+
+int VmasFSData::checkBufferMemory(FileNode *node, int flags) const {
+    if ((flags & O_ACCMODE) == O_RDONLY || (flags & O_TRUNC) != 0 ||
+            !node->isUnloaded() || BigBuffer::fits(node->size())) {
         return 0;
     }
+    // full name is not known without tree lock
+    syslog(LOG_WARNING, "memory limit reached, unable to open %s for writing",
+            node->name());
+    return (node->size() > BigBuffer::maxMemory) ? -EFBIG : -ENOMEM;
+}
+
+int VmasFSData::readFile(FileHandle *handle, char *buf, size_t size,
+        off_t offset) {
+    FileNode *node = handle->node;
+    int res;
+    if (node == m_statsFile) {
+        if (handle->text == NULL) {
+            return -ENOMEM;
+        }
+        const std::string &text = *handle->text;
+        if ((size_t)offset >= text.size()) {
+            return 0;
+        }
+        res = std::min(size, text.size() - offset);
+        memcpy(buf, text.data() + offset, res);
+        return res;
+    }
+    if (handle->stream != NULL &&
+            handle->stream->restarts() >= MAX_STREAM_RESTARTS &&
+            BigBuffer::fits(node->size())) {
+        // random access to compressed data, inflate it only once
+        MutexLock streamLock(m_streamLock);
+        delete handle->stream;
+        handle->stream = NULL;
+    }
+    // data modified or loaded via other handle is read from buffer
+    bool stored = handle->dataOffset >= 0 && node->isUnloaded();
+    if (stored) {
+        res = node->readStored(m_io, handle->dataOffset, buf, size, offset);
+    } else if (handle->stream != NULL && node->isUnloaded()) {
+        MutexLock streamLock(m_streamLock);
+        res = node->readStream(*handle->stream, buf, size, offset);
+    } else {
+        if ((res = loadNode(node)) != 0) {
+            return res;
+        }
+        res = node->read(buf, size, offset);
+    }
+    if (res >= 0) {
+        handle->readDone(offset, res);
+        // sequential reader of stored entry will need next window soon
+        zip_uint64_t end = offset + res;
+        if (stored && handle->isSequential() && end < node->size()) {
+            m_io.prefetch(handle->dataOffset + end, std::min<zip_uint64_t>(
+                        handle->readahead(), node->size() - end));
+        }
+    }
+    return res;
+}
+
+void VmasFSData::releaseHandle(FileHandle *handle) {
+    if (handle->stream != NULL) {
+        MutexLock streamLock(m_streamLock);
+        delete handle->stream;
+        handle->stream = NULL;
+    }
+    delete handle->text;
+    handle->text = NULL;
+    m_handles.release(handle);
+}
+
+void VmasFSData::getAttr(FileNode *node, struct stat *stbuf) {
+    memset(stbuf, 0, sizeof(struct stat));
+    if (node->is_dir) {
+        // Don't materialize directory only to count links: readdirplus
+        // would load the whole next level. Link count 1 means 'unknown
+        // number of subdirectories' for find and similar tools.
+        if (__atomic_load_n(&node->childsLoaded, __ATOMIC_ACQUIRE)) {
+            stbuf->st_nlink = 2 + node->childs.size();
+        } else {
+            stbuf->st_nlink = 1;
+        }
+    } else {
+        stbuf->st_nlink = 1;
+    }
+    MutexLock lock(nodeLock(node));
+    stbuf->st_mode = node->mode();
+    stbuf->st_blksize = STANDARD_BLOCK_SIZE;
+    stbuf->st_ino = node->ino;
+    stbuf->st_blocks = (node->size() + STANDARD_BLOCK_SIZE - 1) / STANDARD_BLOCK_SIZE;
+    stbuf->st_size = node->size();
+    stbuf->st_atime = node->atime();
+    stbuf->st_mtime = node->mtime();
+    stbuf->st_ctime = node->ctime();
+    stbuf->st_uid = node->uid();
+    stbuf->st_gid = node->gid();
 }
 
 void VmasFSData::validateFileName(const char *fname) {
@@ -198,93 +1073,261 @@ void VmasFSData::convertFileName(const char *fname, bool readonly,
     converted.append(start);
 }
 
-FileNode *VmasFSData::findParent (const FileNode *node) const {
-    std::string name = node->getParentName();
-    return find(name.c_str());
+int VmasFSData::findParent (const char *fname, FileNode *&parent) {
+    FileNode *node = m_root;
+    std::string component;
+    const char *slash;
+    while ((slash = strchr(fname, '/')) != NULL) {
+        loadChilds(node);
+        component.assign(fname, slash - fname);
+        node = findChild(node, component.c_str());
+        if (node == NULL) {
+            return -ENOENT;
+        }
+        if (!node->is_dir) {
+            return -ENOTDIR;
+        }
+        fname = slash + 1;
+    }
+    // new child name must not clash with not yet created nodes
+    loadChilds(node);
+    parent = node;
+    return 0;
 }
 
-void VmasFSData::insertNode (FileNode *node) {
-    FileNode *parent = findParent (node);
-    assert (parent != NULL);
-    parent->appendChild (node);
-    node->parent = parent;
+void VmasFSData::insertNode (FileNode *parent, FileNode *node) {
+    assert (parent != NULL && parent->is_dir);
+    assert (parent->findChild(node->name()) == NULL);
+    attachNode (parent, node);
     parent->setCTime (node->ctime());
-    assert (files.find(node->full_name.c_str()) == files.end());
-    files[node->full_name.c_str()] = node;
 }
 
-void VmasFSData::renameNode (FileNode *node, const char *newName, bool
-        reparent) {
+void VmasFSData::renameNode (FileNode *node, FileNode *newParent,
+        const char *newName) {
     assert(node != NULL);
+    assert(newParent != NULL);
     assert(newName != NULL);
-    FileNode *parent1 = node->parent, *parent2;
-    assert (parent1 != NULL);
-    if (reparent) {
-        parent1->detachChild (node);
-    }
+    FileNode *oldParent = node->parent;
+    assert (oldParent != NULL);
 
-    files.erase(node->full_name.c_str());
+    oldParent->detachChild (node);
     node->rename(newName);
-    files[node->full_name.c_str()] = node;
+    node->renamed = true;
+    newParent->appendChild (node);
+    node->parent = newParent;
 
-    if (reparent) {
-        parent2 = findParent(node);
-        assert (parent2 != NULL);
-        parent2->appendChild (node);
-        node->parent = parent2;
+    if (oldParent != newParent) {
+        time_t now = time (NULL);
+        oldParent->setCTime (now);
+        newParent->setCTime (now);
     }
+}
 
-    if (reparent && parent1 != parent2) {
-        time_t now = time (NULL);
-        parent1->setCTime (now);
-        parent2->setCTime (now);
+FileNode *VmasFSData::find (const char *fname) {
+    FileNode *node = m_root;
+    std::string component;
+    while (*fname != '\0') {
+        if (!node->is_dir) {
+            return NULL;
+        }
+        // node may be not yet created because its parent is never visited
+        loadChilds(node);
+        const char *slash = strchr(fname, '/');
+        if (slash == NULL) {
+            return findChild(node, fname);
+        }
+        component.assign(fname, slash - fname);
+        node = findChild(node, component.c_str());
+        if (node == NULL) {
+            return NULL;
+        }
+        fname = slash + 1;
     }
+    return node;
 }
 
-FileNode *VmasFSData::find (const char *fname) const {
-    filemap_t::const_iterator i = files.find(fname);
-    if (i == files.end()) {
-        return NULL;
-    } else {
-        return i->second;
+FileNode *VmasFSData::findChild (FileNode *dir, const char *name) const {
+    if (dir == m_root && m_statsDir != NULL &&
+            strcmp(name, STATS_DIR_NAME) == 0) {
+        return m_statsDir;
     }
+    return dir->findChild(name);
 }
 
-void VmasFSData::save () {
-    for (filemap_t::const_iterator i = files.begin(); i != files.end(); ++i) {
+void VmasFSData::enableStats (bool hidden) {
+    EntryRecord rec;
+    memset(&rec, 0, sizeof(rec));
+    rec.id = FileNode::NEW_NODE_INDEX;
+    rec.mtime = rec.atime = rec.ctime = time(NULL);
+    rec.uid = getuid();
+    rec.gid = getgid();
+    rec.flags = EntryRecord::IS_DIR;
+    rec.mode = S_IFDIR | 0555;
+    m_statsDir = FileNode::createNodeFromRecord(m_zip, STATS_DIR_NAME, rec,
+            &m_arena);
+    rec.flags = 0;
+    rec.mode = S_IFREG | 0444;
+    m_statsFile = FileNode::createNodeFromRecord(m_zip, STATS_FILE_NAME,
+            rec, &m_arena);
+    // nodes are not attached to root, so they are never saved, indexed or
+    // counted as archive files
+    m_statsDir->parent = m_root;
+    m_statsDir->ino = m_nextIno++;
+    m_statsDir->childs[m_statsFile->name()] = m_statsFile;
+    m_statsFile->parent = m_statsDir;
+    m_statsFile->ino = m_nextIno++;
+    m_statsHidden = hidden;
+}
+
+void VmasFSData::printStats (std::string &out) {
+    Statistics::global.print(out);
+    uint64_t hits, misses;
+    m_decryptCache.stats(hits, misses);
+    Statistics::printValue(out, "decrypt_cache.hits", hits);
+    Statistics::printValue(out, "decrypt_cache.misses", misses);
+    Statistics::printValue(out, "decrypt_cache.hit_percent",
+            (hits + misses == 0) ? 0 : hits * 100 / (hits + misses));
+    IOEngine::Stats io = m_io.stats();
+    Statistics::printValue(out, "io.reads", io.reads);
+    Statistics::printValue(out, "io.requests", io.requests);
+    Statistics::printValue(out, "io.bytes", io.bytes);
+    Statistics::printValue(out, "io.errors", io.errors);
+    Statistics::printValue(out, "io.max_in_flight", io.maxInFlight);
+    Statistics::printValue(out, "handles.open", m_handles.used());
+    Statistics::printValue(out, "buffer.limit", BigBuffer::maxMemory);
+}
+
+void VmasFSData::collectRenames (const FileNode *dir, std::string &path,
+        bool renamed, renamelist_t &renames) {
+    for (filemap_t::const_iterator i = dir->childs.begin();
+            i != dir->childs.end(); ++i) {
         FileNode *node = i->second;
-        if (node == m_root) {
+        bool nodeRenamed = renamed || node->renamed;
+        node->renamed = false;
+        size_t len = path.size();
+        if (len != 0) {
+            path.push_back('/');
+        }
+        path.append(node->name());
+        if (nodeRenamed && node->id >= 0) {
+            std::string name(path);
+            if (node->is_dir) {
+                name.push_back('/');
+            }
+            const char *oldName = zip_get_name(m_zip, node->id, ZIP_FL_ENC_RAW);
+            if (oldName == NULL || name != oldName) {
+                renames.push_back(std::make_pair(node->id, name));
+            }
+        }
+        if (node->is_dir) {
+            collectRenames(node, path, nodeRenamed, renames);
+        }
+        path.resize(len);
+    }
+}
+
+void VmasFSData::renameEntries () {
+    renamelist_t renames;
+    std::string path;
+    collectRenames(m_root, path, false, renames);
+
+    // Target name may be still used by entry that is renamed later (for
+    // example, if two entries are swapped). Such entries are moved to
+    // temporary names first and renamed to final names in second pass.
+    std::vector<size_t> postponed;
+    for (size_t i = 0; i < renames.size(); ++i) {
+        zip_int64_t id = renames[i].first;
+        const std::string &name = renames[i].second;
+        if (zip_file_rename(m_zip, id, name.c_str(), ZIP_FL_ENC_UTF_8) == 0) {
             continue;
         }
+        char tmpName[64];
+        snprintf(tmpName, sizeof(tmpName), ".vmasfs-rename-%lld%s",
+                (long long)id, name[name.size() - 1] == '/' ? "/" : "");
+        if (zip_file_rename(m_zip, id, tmpName, ZIP_FL_ENC_UTF_8) == 0) {
+            postponed.push_back(i);
+        } else {
+            syslog(LOG_ERR, "Unable to rename %s in ZIP archive: %s",
+                    name.c_str(), zip_strerror(m_zip));
+        }
+    }
+    for (std::vector<size_t>::const_iterator i = postponed.begin();
+            i != postponed.end(); ++i) {
+        zip_int64_t id = renames[*i].first;
+        const std::string &name = renames[*i].second;
+        if (zip_file_rename(m_zip, id, name.c_str(), ZIP_FL_ENC_UTF_8) != 0) {
+            syslog(LOG_ERR, "Unable to rename %s in ZIP archive: %s",
+                    name.c_str(), zip_strerror(m_zip));
+        }
+    }
+}
+
+void VmasFSData::deleteOrphanEntries () {
+    for (std::vector<zip_int64_t>::const_iterator i = m_orphanEntries.begin();
+            i != m_orphanEntries.end(); ++i) {
+        if (zip_delete(m_zip, *i) != 0) {
+            syslog(LOG_ERR, "Unable to delete entry %lld from ZIP archive: %s",
+                    (long long)*i, zip_strerror(m_zip));
+        }
+    }
+    m_orphanEntries.clear();
+}
+
+void VmasFSData::save () {
+    uint64_t started = Statistics::now();
+    // deletes and renames go first to free names for new entries
+    deleteOrphanEntries ();
+    renameEntries ();
+    uint64_t renamed = Statistics::now();
+    TraceLog::global.complete("save", "rename_entries", started,
+            renamed - started);
+    saveTree (m_root);
+    TraceLog::global.complete("save", "save_tree", renamed,
+            Statistics::now() - renamed);
+}
+
+void VmasFSData::saveTree (FileNode *dir) {
+    for (filemap_t::const_iterator i = dir->childs.begin();
+            i != dir->childs.end(); ++i) {
+        FileNode *node = i->second;
         assert(node != NULL);
-        bool saveMetadata = node->isMetadataChanged();
-        if (node->isChanged() && !node->is_dir) {
-            saveMetadata = true;
-            int res = node->save();
-            if (res != 0) {
-                saveMetadata = false;
-                syslog(LOG_ERR, "Error while saving file %s in ZIP archive: %d",
-                        node->full_name.c_str(), res);
-            }
+        saveNode (node);
+        if (node->is_dir) {
+            saveTree (node);
         }
-        if (saveMetadata) {
-            if (node->isTemporaryDir()) {
-                // persist temporary directory
-                zip_int64_t idx = zip_dir_add(m_zip,
-                        node->full_name.c_str(), ZIP_FL_ENC_UTF_8);
-                if (idx < 0) {
-                    syslog(LOG_ERR, "Unable to save directory %s in ZIP archive",
-                        node->full_name.c_str());
-                    continue;
-                }
-                node->id = idx;
-            }
-            int res = node->saveMetadata();
-            if (res != 0) {
-                syslog(LOG_ERR, "Error while saving metadata for file %s in ZIP archive: %d",
-                        node->full_name.c_str(), res);
+    }
+}
+
+void VmasFSData::saveNode (FileNode *node) {
+    bool saveMetadata = node->isMetadataChanged();
+    if (node->isChanged() && !node->is_dir) {
+        saveMetadata = true;
+        std::string name = node->fullName();
+        VMASFS_PROBE2(save__node__start, name.c_str(), node->size());
+        int res = node->save();
+        VMASFS_PROBE2(save__node__done, name.c_str(), res);
+        if (res != 0) {
+            saveMetadata = false;
+            syslog(LOG_ERR, "Error while saving file %s in ZIP archive: %d",
+                    name.c_str(), res);
+        }
+    }
+    if (saveMetadata) {
+        if (node->isTemporaryDir()) {
+            // persist temporary directory
+            zip_int64_t idx = zip_dir_add(m_zip,
+                    node->fullName().c_str(), ZIP_FL_ENC_UTF_8);
+            if (idx < 0) {
+                syslog(LOG_ERR, "Unable to save directory %s in ZIP archive",
+                    node->fullName().c_str());
+                return;
             }
+            node->id = idx;
+        }
+        int res = node->saveMetadata();
+        if (res != 0) {
+            syslog(LOG_ERR, "Error while saving metadata for file %s in ZIP archive: %d",
+                    node->fullName().c_str(), res);
         }
     }
 }
-
@@ -7,13 +7,90 @@
 #ifndef VMASFS_DATA
 #define VMASFS_DATA
 
+#include <pthread.h>
+#include <stdint.h>
+
+#include <sys/stat.h>
+
+#include <set>
 #include <string>
+#include <utility>
+#include <vector>
 
 #include "types.h"
 #include "fileNode.h"
+#include "fileHandle.h"
+#include "ioEngine.h"
+#include "latencyDumper.h"
+#include "lock.h"
+#include "mountIndex.h"
+#include "secureCache.h"
+#include "statistics.h"
 
+/**
+ * File system data: tree of nodes and archive.
+ *
+ * Locking model (file system operations may be called from several
+ * threads, see -o mt). Locks are always taken in the following order:
+ * tree lock, materialization lock or node lock (they are never held
+ * together), ZIP lock or stream lock.
+ *
+ * - Tree lock (reader-writer) protects tree structure: child maps, node
+ *   names and parents, node modes and owners. Lookups, getattr and
+ *   readdir take it shared, operations creating, removing or renaming
+ *   nodes and changing attributes take it exclusive.
+ * - Node lock protects node data: buffer, state, open count, size and
+ *   times. Operations on opened files (read, write, release) take only
+ *   node lock because FUSE does not remove or reuse node while operation
+ *   on it is in progress. Node locks are shared by several nodes (lock is
+ *   selected by node address).
+ * - Materialization lock serializes creation of nodes in lazy mode by
+ *   readers holding shared tree lock. Nodes and their names are allocated
+ *   from arena, so it must not be used without this lock or exclusive
+ *   tree lock.
+ * - ZIP lock serializes all libzip calls on shared archive handle, libzip
+ *   does not allow to use archive from several threads. Data of big file
+ *   is inflated with only node lock and ZIP lock held, so metadata
+ *   operations are not blocked by it.
+ * - Stream lock serializes libzip calls of streams (see openData). They
+ *   use separate read-only archive handle, so streaming of huge files
+ *   does not block loading of other files.
+ *
+ * Tree is built and saved without locks, at that time only one thread
+ * exists.
+ */
 class VmasFSData {
 private:
+    /**
+     * Name index entry for lazy mode: converted file name (without
+     * trailing slash), ZIP entry index and attributes if entry is loaded
+     * from mount index.
+     */
+    struct IndexEntry {
+        const char *name;
+        zip_int64_t id;
+        const EntryRecord *record;
+        bool is_dir;
+    };
+    typedef std::vector<IndexEntry> nameindex_t;
+
+    /**
+     * Pending renames of ZIP entries: entry index and new name
+     */
+    typedef std::vector<std::pair<zip_int64_t, std::string> > renamelist_t;
+
+    /**
+     * Order index entries by name, same way as filemap_t does
+     */
+    struct IndexEntryLess {
+        bool operator() (const IndexEntry &e, const char *name) const {
+            return strcmp(e.name, name) < 0;
+        }
+        bool operator() (const IndexEntry &e1, const IndexEntry &e2) const {
+            return strcmp(e1.name, e2.name) < 0;
+        }
+    };
+
     /**
      * Check that file name is non-empty and does not contain duplicate
      * slashes
@@ -37,23 +114,247 @@ private:
             bool needPrefix, std::string &converted);
 
     /**
-     * Find node parent by its name
+     * Find directory by first 'len' characters of 'fname' creating
+     * missing intermediate directories
+     * @throws std::bad_alloc
+     * @throws std::runtime_error - if parent is not directory
      */
-    FileNode *findParent (const FileNode *node) const;
+    FileNode *makeParents (const char *fname, size_t len);
 
     /**
-     * Create node parents (if not yet exist) and connect node to
+     * Create node parents (if not yet exist) and connect node for ZIP
+     * entry 'fname' to tree. Intermediate directory with the same name
+     * is replaced by node. Node is deleted if exception is thrown.
      * @throws std::bad_alloc
+     * @throws std::runtime_error - if parent is not directory or on
+     * duplicate file names
+     */
+    void connectNodeToTree (FileNode *node, const char *fname);
+
+    /**
+     * Connect node to parent and assign inode number to it if not yet
+     * assigned
+     */
+    void attachNode (FileNode *parent, FileNode *node);
+
+    /**
+     * Detach node from tree and delete associated entry in zip file if
+     * present and 'deleteEntry' is set. Node itself is not deleted.
+     * @return Error code or 0 is successful
+     */
+    int detachNode (FileNode *node, bool deleteEntry = true);
+
+    /**
+     * Free resources of node and all its descendants that are not
+     * released together with arena (data buffers and nodes allocated
+     * outside of arena)
+     */
+    void releaseTree (FileNode *node);
+
+    /**
+     * Build sorted name index instead of creating nodes for all entries
+     * @throws std::runtime_error - on duplicate file names
+     */
+    void build_index(zip_int64_t n, bool readonly, bool needPrefix);
+
+    /**
+     * Check that parents of entries in name index are not files (as
+     * connectNodeToTree does in eager mode) and count nodes to be created
+     * on materialization
      * @throws std::runtime_error - if parent is not directory
      */
-    void connectNodeToTree (FileNode *node);
+    void check_index();
+
+    struct RecordLess;
+
+    /**
+     * Build tree (or name index in lazy mode) querying libzip for every
+     * entry
+     */
+    void build_with_libzip(bool readonly, bool lazy);
+
+    /**
+     * Read names and attributes of all entries directly from mapped
+     * central directory (read-only mode only) into m_records sorted by
+     * name.
+     * @return false if central directory can not be parsed and libzip
+     * should be used instead
+     * @throws std::runtime_error - on duplicate or invalid file names
+     */
+    bool read_central_directory(const CentralDirectory &cd);
+
+    /**
+     * Build tree (or name index in lazy mode) from entry records sorted
+     * by name
+     * @param names table of names referenced by records
+     */
+    void build_from_records(const EntryRecord *records, zip_uint64_t n,
+            const char *names);
+
+    /**
+     * Write mount index for just built tree. Errors are only logged.
+     */
+    void save_mount_index(const char *indexPath,
+            const MountIndex::Key &key, const CentralDirectory &cd);
+
+    /**
+     * Fill records for ZIP entries in subtree of 'dir'
+     * @param path full name of 'dir'
+     */
+    static void collectRecords(const FileNode *dir, std::string &path,
+            std::vector<EntryRecord> &records, std::vector<char> &names);
+
+    /**
+     * Collect new names of ZIP entries in subtree of 'dir' that are
+     * renamed themselves or have renamed ancestor
+     * @param path full name of 'dir'
+     * @param renamed true if 'dir' or its ancestor is renamed
+     */
+    void collectRenames (const FileNode *dir, std::string &path,
+            bool renamed, renamelist_t &renames);
+
+    /**
+     * Apply renames of nodes to ZIP entries in one batch
+     */
+    void renameEntries ();
+
+    /**
+     * Delete ZIP entries of orphans (see unlinkNode)
+     */
+    void deleteOrphanEntries ();
+
+    /**
+     * Find encrypted entry with the smallest compressed size
+     * @return entry index or -1 if archive has no encrypted entries
+     */
+    zip_int64_t smallestEncryptedEntry () const;
+
+    /**
+     * Save changed nodes in subtree of 'dir'
+     */
+    void saveTree (FileNode *dir);
+
+    /**
+     * Save node data and metadata if changed
+     */
+    void saveNode (FileNode *node);
+
+    /**
+     * Create nodes for direct children of directory using name index.
+     * Missing intermediate directories are created on demand, entries in
+     * subdirectories are skipped without creating nodes for them.
+     */
+    void materialize (FileNode *dir);
+
+    /**
+     * Fill buffer with zeros before it is freed
+     */
+    static void wipeData (std::vector<char> &data);
 
+    /**
+     * libzip progress callback logging save progress every
+     * m_progressInterval seconds
+     */
+    static void saveProgress (zip_t *z, double progress, void *data);
+
+    // memory for nodes, must be destroyed after tree is released
+    NodeArena m_arena;
     FileNode *m_root;
-    filemap_t files;
+    // nodes removed from tree but still referenced by kernel (low-level
+    // frontend only)
+    std::set<FileNode *> m_orphans;
+    // ZIP entries of orphans, deleted on save: orphan may be still open
+    // and its data is loaded on first read, libzip does not open deleted
+    // entries
+    std::vector<zip_int64_t> m_orphanEntries;
+    // number of nodes in tree except root and number of nodes not yet
+    // created in lazy mode (entries of name index and directories without
+    // own entries). Both are changed by readers materializing directories,
+    // so they are accessed atomically.
+    size_t m_nodeCount;
+    size_t m_pendingNodes;
+    // next inode number for nodes without ZIP entry
+    zip_uint64_t m_nextIno;
+    zip_uint64_t m_generation;
+    bool m_lazy;
+    nameindex_t m_index;
+    // entry records read from central directory
+    std::vector<EntryRecord> m_records;
+    // storage for names in m_index and m_records if not loaded from
+    // mount index
+    std::vector<char> m_indexNames;
+    MountIndex m_mountIndex;
+    FileHandlePool m_handles;
+    // reader of data of stored entries, used if m_ioDepth != 0
+    IOEngine m_io;
+    unsigned int m_ioDepth;
+    // decrypted data of small encrypted entries by ZIP entry index. Keys
+    // derived from password can not be cached instead: libzip does not
+    // expose them, key derivation is done inside zip_fopen_index_encrypted.
+    // Kernel page cache (keep_cache) is dropped with inode, this cache is
+    // kept until unmount.
+    SecureCache m_decryptCache;
+    // thread dumping operation latencies on signal
+    LatencyDumper m_latencyDumper;
+    // when save progress was logged last time (in ns)
+    uint64_t m_lastProgress;
+    // local file header offsets of ZIP entries by index
+    std::vector<zip_uint64_t> m_localHeaders;
+    // statistics pseudo-directory and pseudo-file in it (NULL if
+    // disabled), they are not in child map of root
+    FileNode *m_statsDir, *m_statsFile;
+    bool m_statsHidden;
+    // parent directory of last node connected while building tree
+    FileNode *m_lastParent;
+    std::string m_lastParentName;
+
+    static const size_t NODE_LOCK_COUNT = 64;
+    pthread_rwlock_t m_treeLock;
+    pthread_mutex_t m_materializeLock;
+    pthread_mutex_t m_zipLock;
+    pthread_mutex_t m_streamLock;
+    pthread_mutex_t m_nodeLocks[NODE_LOCK_COUNT];
+    // read-only archive handle of streams, opened on first use
+    struct zip *m_streamZip;
+    bool m_streamZipFailed;
+
+    /**
+     * Archive handle for streams. Caller must hold stream lock.
+     * @return NULL if archive can not be opened
+     */
+    struct zip *streamArchive ();
 public:
+    static const zip_uint64_t ROOT_INO, FIRST_ENTRY_INO;
+
     struct zip *m_zip;
     const char *m_archiveName;
     std::string m_cwd;
+    // how long kernel may cache names and attributes (in seconds)
+    double m_entryTimeout;
+    double m_attrTimeout;
+    // let kernel cache writes (FUSE 3 only)
+    bool m_writebackCache;
+    // limits of I/O request sizes (in bytes), 0 means the largest size
+    // supported by FUSE library and kernel
+    unsigned int m_maxWrite;
+    unsigned int m_maxRead;
+    unsigned int m_maxReadahead;
+    // files of this size and bigger opened for reading are streamed from
+    // archive with direct I/O (0 - only files opened with O_DIRECT)
+    zip_uint64_t m_streamSize;
+    // encrypted entries not bigger than this are cached by decrypt cache
+    size_t m_decryptItemSize;
+    // interval of logging archive save progress (in seconds), 0 disables
+    unsigned int m_progressInterval;
+
+    static const size_t DECRYPT_ITEM_SIZE = 64 * 1024;
+    // stream restarted so many times is replaced by node buffer if file
+    // fits into memory limit
+    static const unsigned int MAX_STREAM_RESTARTS = 4;
+    // number of entries reported by save profile
+    static const size_t SLOWEST_ENTRIES = 10;
+    static const char STATS_DIR_NAME[];
+    static const char STATS_FILE_NAME[];
 
     /**
      * Keep archiveName and cwd in class fields and build file tree from z.
@@ -65,10 +366,137 @@ public:
     ~VmasFSData();
 
     /**
-     * try password if ZIP DATA is encrypted
+     * Locks described in class comment
+     */
+    inline pthread_rwlock_t &treeLock () {
+        return m_treeLock;
+    }
+    inline pthread_mutex_t &zipLock () {
+        return m_zipLock;
+    }
+    inline pthread_mutex_t &nodeLock (const FileNode *node) {
+        // low bits of node addresses are the same for all nodes
+        return m_nodeLocks[((uintptr_t)node >> 4) % NODE_LOCK_COUNT];
+    }
+
+    /**
+     * Prepare I/O engine reading data of stored entries with 'depth'
+     * requests in flight (must be called before process is daemonized).
+     * Errors are only logged, data is read via libzip then.
+     */
+    void openIO (unsigned int depth);
+
+    /**
+     * Start threads of I/O engine if it is prepared
+     */
+    void startIO ();
+
+    /**
+     * Write operation latencies dumped on signal also to file 'fileName'
+     * (relative to archive directory), by default they go only to syslog
+     */
+    void setLatencyFile (const char *fileName);
+
+    /**
+     * Start thread dumping operation latencies on signal (see
+     * LatencyDumper, its signals must be blocked before FUSE is started)
+     */
+    void startLatencyDumper ();
+
+    /**
+     * Counters of I/O engine
+     */
+    inline IOEngine::Stats ioStats () {
+        return m_io.stats();
+    }
+
+    /**
+     * Keep up to 'capacity' bytes of decrypted data of small encrypted
+     * entries, so files opened again are not decrypted (and their keys
+     * are not derived from password) again. 0 disables cache. Only
+     * cached copies are locked and wiped, data loaded into node buffer is
+     * in ordinary memory as data decrypted by libzip.
+     */
+    void setDecryptCache (size_t capacity);
+
+    /**
+     * Create read-only pseudo-directory STATS_DIR_NAME in root with file
+     * STATS_FILE_NAME showing activity counters. Contents of file is
+     * rendered when it is opened. Hidden directory is not listed in root,
+     * but still can be looked up. Must be called after tree is built.
+     * @throws std::bad_alloc
+     */
+    void enableStats (bool hidden);
+
+    /**
+     * Check if node is statistics pseudo-directory or pseudo-file: they
+     * can not be changed, removed or renamed and nothing can be created
+     * in pseudo-directory
+     */
+    inline bool isVirtual (const FileNode *node) const {
+        return node != NULL && (node == m_statsDir || node == m_statsFile);
+    }
+
+    /**
+     * Statistics pseudo-directory if it should be listed after children
+     * of 'dir', NULL otherwise
+     */
+    inline FileNode *listedVirtualDir (const FileNode *dir) const {
+        return (dir == m_root && !m_statsHidden) ? m_statsDir : NULL;
+    }
+
+    /**
+     * Find child of directory by name including pseudo-directory in root.
+     * Caller must hold tree lock, children of directory must be loaded.
+     * @return node or NULL
+     */
+    FileNode *findChild (FileNode *dir, const char *name) const;
+
+    /**
+     * Check if data of node opened with 'flags' for writing can be loaded
+     * into buffer without exceeding BigBuffer::maxMemory. Read-only opens
+     * are not checked: data that does not fit is streamed from archive.
+     * @return 0, -EFBIG if data does not fit into limit at all or -ENOMEM
+     *      if buffers of other files take too much memory
+     */
+    int checkBufferMemory (FileNode *node, int flags) const;
+
+    /**
+     * Render contents of statistics pseudo-file
+     */
+    void printStats (std::string &out);
+
+    /**
+     * Arena for nodes inserted into tree
+     */
+    inline NodeArena *arena () {
+        return &m_arena;
+    }
+
+    /**
+     * Pool of handles of opened files
+     */
+    inline FileHandlePool &handles () {
+        return m_handles;
+    }
+
+    /**
+     * Check password against the smallest encrypted entry and use it to
+     * open encrypted entries if it is correct
+     * @return true if password is correct or there are no encrypted
+     * entries
      */
     bool try_passwd(const char *pass);
 
+    /**
+     * Check if password given to try_passwd can be verified. If not, new
+     * and changed files are encrypted with any password given, so caller
+     * should ask for it twice.
+     */
+    inline bool hasEncryptedEntries () const {
+        return smallestEncryptedEntry() != -1;
+    }
+
     /**
      * Detach node from tree, and delete associated entry in zip file if
      * present.
@@ -79,35 +507,159 @@ public:
     int removeNode(FileNode *node);
 
     /**
-     * Build tree of zip file entries from ZIP file
+     * The same as removeNode, but node is kept as orphan if kernel holds
+     * lookup references to it (see FileNode::nlookup). Orphan is deleted
+     * by deleteOrphan when kernel forgets it, its ZIP entry is deleted on
+     * save, so data of orphan opened before unlink can be still read.
      */
-    void build_tree(bool readonly);
+    int unlinkNode(FileNode *node);
 
     /**
-     * Insert new node into tree by adding it to parent's childs list and
+     * Check if node is removed from tree, but not yet forgotten by kernel
+     */
+    inline bool isOrphan(FileNode *node) const {
+        return m_orphans.find(node) != m_orphans.end();
+    }
+
+    /**
+     * Delete orphan node after kernel dropped all references to it
+     */
+    void deleteOrphan(FileNode *node);
+
+    /**
+     * Build tree of zip file entries from ZIP file.
+     * In read-only mode central directory is parsed directly (libzip is
+     * used only if it can not be parsed).
+     * In lazy mode only sorted name index is built, nodes are created
+     * when directory is looked up or listed first time.
+     * If indexPath is not NULL, entry attributes are taken from mount
+     * index file if it is up to date, otherwise index file is
+     * (re)written after building the tree.
+     */
+    void build_tree(bool readonly, bool lazy = false,
+            const char *indexPath = NULL);
+
+    /**
+     * Make sure that child list of directory node is complete (it may be
+     * not if directory is not yet visited in lazy mode)
+     */
+    inline void loadChilds (FileNode *dir) {
+        if (!__atomic_load_n(&dir->childsLoaded, __ATOMIC_ACQUIRE)) {
+            materialize (dir);
+        }
+    }
+
+    /**
+     * Make sure that all nodes in subtree are created (no-op if not in
+     * lazy mode)
+     */
+    void loadTree (FileNode *dir);
+
+    /**
+     * Find parent directory for file 'fname'. In lazy mode children of
+     * parent are materialized.
+     * @param parent (OUT) parent node
+     * @return 0, -ENOENT if parent does not exist or -ENOTDIR if parent
+     * or one of its ancestors is not a directory
+     */
+    int findParent (const char *fname, FileNode *&parent);
+
+    /**
+     * Insert new node into tree by adding it to parent's childs map and
      * specifying node parent field.
      */
-    void insertNode (FileNode *node);
+    void insertNode (FileNode *parent, FileNode *node);
 
     /**
      * Detach node from old parent, rename, attach to new parent.
+     * Descendants are not touched because their full names are derived
+     * from parents. ZIP entries are renamed on save.
+     * In lazy mode subtree of renamed directory must be loaded.
      * @param node
-     * @param newName new name
-     * @param reparent if false, node detaching is not performed
+     * @param newParent new parent directory
+     * @param newName new short name
      */
-    void renameNode (FileNode *node, const char *newName, bool reparent);
+    void renameNode (FileNode *node, FileNode *newParent,
+            const char *newName);
+
+    /**
+     * Root directory node
+     */
+    inline FileNode *root () const {
+        return m_root;
+    }
 
     /**
-     * search for node
+     * Read data of opened node from archive if not yet read. Caller must
+     * hold node lock. ZIP lock is taken only if data should be read.
+     * @return 0 or negative error code
+     */
+    int loadNode (FileNode *node);
+
+    /**
+     * Offset of data of unmodified entry stored without compression and
+     * encryption in archive file. Caller must hold node lock, ZIP lock is
+     * taken inside.
+     * @return offset or -1 if data can not be read bypassing libzip
+     */
+    off_t storedDataOffset (FileNode *node);
+
+    /**
+     * Decide how data of unmodified file opened for reading is read:
+     * data of stored entry is read by I/O engine (if enabled), file
+     * opened with O_DIRECT or not smaller than m_streamSize is read
+     * directly from archive (stream is prepared for compressed entry,
+     * stream lock is taken inside).
+     * Contents of pseudo-file is rendered into handle and read with
+     * direct I/O.
+     * Caller must hold node lock, node must be opened.
+     * @return true if file should be opened with direct I/O
+     */
+    bool openData (FileHandle *handle);
+
+    /**
+     * Read data of opened file from stream or node buffer loading it if
+     * needed. Stream read backwards too often is dropped and node is
+     * loaded instead. Caller must hold node lock.
+     * @return number of bytes read or negative error code
+     */
+    int readFile (FileHandle *handle, char *buf, size_t size, off_t offset);
+
+    /**
+     * Close stream of handle, free rendered pseudo-file contents and
+     * return handle to pool. Node must be already closed.
+     */
+    void releaseHandle (FileHandle *handle);
+
+    /**
+     * Fill file attributes of node. Caller must hold tree lock, node lock
+     * is taken inside. Directory is not materialized, its link count is 1
+     * until children are loaded.
+     */
+    void getAttr (FileNode *node, struct stat *stbuf);
+
+    /**
+     * search for node. In lazy mode parent directories of node are
+     * materialized if needed.
      * @return node or NULL
      */
-    FileNode *find (const char *fname) const;
+    FileNode *find (const char *fname);
+
+    /**
+     * Generation number for inodes. Inode numbers are never reused
+     * during mount, so generation is the same for all nodes and differs
+     * between mounts.
+     */
+    inline zip_uint64_t generation () const {
+        return m_generation;
+    }
 
     /**
-     * Return number of files in tree
+     * Return number of files in tree including not yet materialized ones
      */
     int numFiles () const {
-        return files.size() - 1;
+        return __atomic_load_n(&m_nodeCount, __ATOMIC_RELAXED) +
+            __atomic_load_n(&m_pendingNodes, __ATOMIC_RELAXED);
     }
 
     /**
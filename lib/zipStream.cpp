@@ -0,0 +1,125 @@
+////////////////////////////////////////////////////////////////////////////
+//  Copyright (C) 2021 by V+ Publicidad SpA                               //
+//  http://www.vmaspublicidad.com                                         //
+//                                                                        //
+////////////////////////////////////////////////////////////////////////////
+
+#include <zip.h>
+#include <syslog.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstddef>
+#include <cstring>
+#include <new>
+
+#include "zipStream.h"
+#include "bigBuffer.h"
+
+ZipStream::ZipStream(struct zip *z, zip_uint64_t index, bool encrypted):
+        m_zip(z), m_index(index), m_encrypted(encrypted), m_file(NULL),
+        m_pos(0), m_window(new (std::nothrow) char[WINDOW_SIZE]),
+        m_windowLen(0), m_restarts(0) {
+}
+
+ZipStream::~ZipStream() {
+    if (m_file != NULL) {
+        zip_fclose(m_file);
+    }
+    delete[] m_window;
+}
+
+const size_t ZipStream::WINDOW_SIZE;
+
+int ZipStream::reopen() {
+    if (m_file != NULL) {
+        zip_fclose(m_file);
+    }
+    m_pos = 0;
+    m_windowLen = 0;
+    m_file = BigBuffer::open(m_zip, m_index, m_encrypted);
+    if (m_file == NULL) {
+        syslog(LOG_WARNING, "%s", zip_strerror(m_zip));
+        return -EIO;
+    }
+    return 0;
+}
+
+int ZipStream::readNext(char *buf, size_t size) {
+    size_t done = 0;
+    while (done < size) {
+        zip_int64_t nr = zip_fread(m_file, buf + done, size - done);
+        if (nr < 0) {
+            syslog(LOG_WARNING, "%s", zip_file_strerror(m_file));
+            // decompression state is unknown, start again on next read
+            zip_fclose(m_file);
+            m_file = NULL;
+            return -EIO;
+        }
+        if (nr == 0) {
+            break;
+        }
+        remember(buf + done, nr, m_pos);
+        done += nr;
+        m_pos += nr;
+    }
+    return done;
+}
+
+void ZipStream::remember(const char *buf, size_t size, zip_uint64_t offset) {
+    if (m_window == NULL) {
+        return;
+    }
+    if (size > WINDOW_SIZE) {
+        buf += size - WINDOW_SIZE;
+        offset += size - WINDOW_SIZE;
+        size = WINDOW_SIZE;
+    }
+    size_t pos = offset % WINDOW_SIZE;
+    size_t first = std::min(size, WINDOW_SIZE - pos);
+    memcpy(m_window + pos, buf, first);
+    memcpy(m_window, buf + first, size - first);
+    m_windowLen = std::min(m_windowLen + size, WINDOW_SIZE);
+}
+
+int ZipStream::read(char *buf, size_t size, zip_uint64_t offset) {
+    int res;
+    if (m_file != NULL && offset < m_pos && m_pos - offset <= m_windowLen) {
+        size_t len = std::min<zip_uint64_t>(size, m_pos - offset);
+        size_t pos = offset % WINDOW_SIZE;
+        size_t first = std::min(len, WINDOW_SIZE - pos);
+        memcpy(buf, m_window + pos, first);
+        memcpy(buf + first, m_window, len - first);
+        if (len == size) {
+            return len;
+        }
+        // the rest is after window
+        if ((res = readNext(buf + len, size - len)) < 0) {
+            return res;
+        }
+        return len + res;
+    }
+    if (m_file == NULL || offset < m_pos) {
+        if (m_file != NULL) {
+            ++m_restarts;
+        }
+        if ((res = reopen()) != 0) {
+            return res;
+        }
+    }
+    // caller's buffer is used to skip data before offset
+    while (m_pos < offset && size > 0) {
+        size_t skip = size;
+        if (skip > offset - m_pos) {
+            skip = offset - m_pos;
+        }
+        if ((res = readNext(buf, skip)) < 0) {
+            return res;
+        }
+        if ((size_t)res < skip) {
+            // entry is shorter than expected
+            return 0;
+        }
+    }
+    return readNext(buf, size);
+}
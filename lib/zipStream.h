@@ -0,0 +1,94 @@
+////////////////////////////////////////////////////////////////////////////
+//  Copyright (C) 2021 by V+ Publicidad SpA                               //
+//  http://www.vmaspublicidad.com                                         //
+//                                                                        //
+////////////////////////////////////////////////////////////////////////////
+
+#ifndef ZIP_STREAM_H
+#define ZIP_STREAM_H
+
+#include <zip.h>
+
+/**
+ * Sequential reader of archive entry data that does not keep the data in
+ * memory (used for files opened with direct I/O). Only libzip
+ * decompression state is kept, so memory use does not depend on entry
+ * size.
+ *
+ * Reads forward are served by skipping data. The last WINDOW_SIZE
+ * decompressed bytes are kept, so reads slightly before current position
+ * (out of order requests of several FUSE threads) are served from
+ * memory. Reads before the window restart decompression from the
+ * beginning of entry.
+ *
+ * All methods (and destructor) call libzip, so caller must hold lock of
+ * archive handle.
+ */
+class ZipStream {
+private:
+    // must not be defined
+    ZipStream (const ZipStream &);
+    ZipStream &operator= (const ZipStream &);
+
+    struct zip *m_zip;
+    zip_uint64_t m_index;
+    bool m_encrypted;
+    // NULL if entry is not yet opened
+    struct zip_file *m_file;
+    // offset of the next byte to be decompressed
+    zip_uint64_t m_pos;
+    // the last decompressed bytes [m_pos - m_windowLen, m_pos), ring
+    // buffer indexed by offset modulo WINDOW_SIZE (NULL if allocation
+    // failed, stream works without window then)
+    char *m_window;
+    size_t m_windowLen;
+    // decompression restarts caused by reads before window
+    unsigned int m_restarts;
+
+    /**
+     * (Re)open entry and set position to its beginning
+     * @return 0 or negative error code
+     */
+    int reopen();
+
+    /**
+     * Decompress up to 'size' bytes at current position
+     * @return number of bytes read or negative error code
+     */
+    int readNext(char *buf, size_t size);
+
+    /**
+     * Put 'size' bytes decompressed at 'offset' into window
+     */
+    void remember(const char *buf, size_t size, zip_uint64_t offset);
+
+public:
+    static const size_t WINDOW_SIZE = 1024 * 1024;
+
+    ZipStream(struct zip *z, zip_uint64_t index, bool encrypted);
+    ~ZipStream();
+
+    /**
+     * Read up to 'size' bytes from 'offset'. Caller must not read after
+     * the end of entry.
+     * @return number of bytes read or negative error code
+     */
+    int read(char *buf, size_t size, zip_uint64_t offset);
+
+    /**
+     * Offset of the next byte to be decompressed
+     */
+    inline zip_uint64_t position() const {
+        return m_pos;
+    }
+
+    /**
+     * Number of times decompression was restarted to read data before
+     * window
+     */
+    inline unsigned int restarts() const {
+        return m_restarts;
+    }
+};
+
+#endif
@@ -8,17 +8,44 @@
 #define KEY_VERSION (1)
 #define KEY_RO (2)
 #define KEY_USE_PASSWD (3)
+#define KEY_LAZY (4)
+#define KEY_INDEX (5)
+#define KEY_MT (6)
+#define KEY_HIGHLEVEL (7)
+#define KEY_WRITEBACK (8)
+#define KEY_MAX_READ (9)
+#define KEY_STATS (10)
+#define KEY_HIDE_STATS (11)
+#define KEY_LATENCY (12)
+
+// kernel cache timeouts (in seconds) for names and attributes
+#define DEFAULT_TIMEOUT (1.0)
+// nothing can be changed in read-only mount
+#define READONLY_TIMEOUT (3600.0)
+// kernel does not accept smaller I/O requests limits
+#define MIN_IO_SIZE (4096)
+// cache of decrypted data of small encrypted files (in bytes)
+#define DEFAULT_DECRYPT_CACHE (4 * 1024 * 1024)
+// interval of logging archive save progress on unmount (in seconds)
+#define DEFAULT_SAVE_PROGRESS (10)
 
 #include "config.h"
 
 #include <fuse.h>
+#include <fuse_lowlevel.h>
 #include <fuse_opt.h>
 #include <limits.h>
 #include <syslog.h>
 
 #include <cerrno>
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <string>
 
 #include "vmas-fs.h"
+#include "vmas-fs-ll.h"
 #include "vmasFSData.h"
 
 /**
@@ -34,6 +61,35 @@ void print_usage() {
             "    -r   -o ro             open archive in read-only mode\n"
             "    -f                     don't detach from terminal\n"
             "    -p                     use password\n"
+            "    -o lazy                create file nodes on first directory access\n"
+            "    -o index               keep mount index file next to archive\n"
+            "    -o index_dir=DIR       keep mount index file in DIR\n"
+            "    -o mt                  process requests in several threads\n"
+            "    -o highlevel           use path-based FUSE interface\n"
+            "    -o entry_timeout=T     cache file names for T seconds\n"
+            "                           (default: 1, read-only: 3600)\n"
+            "    -o attr_timeout=T      cache file attributes for T seconds\n"
+            "                           (default: 1, read-only: 3600)\n"
+            "    -o writeback           let kernel cache writes (FUSE 3 only)\n"
+            "    -o max_write=N         send writes in pieces up to N bytes\n"
+            "    -o max_read=N          send reads in pieces up to N bytes\n"
+            "    -o max_readahead=N     read ahead up to N bytes\n"
+            "                           (default: the largest supported)\n"
+            "    -o stream_size=N       read files of N bytes and bigger with\n"
+            "                           direct I/O without caching\n"
+            "    -o io_depth=N          read stored files bypassing libzip\n"
+            "                           with N requests in flight\n"
+            "    -o max_memory=N        keep up to N bytes of file data in memory\n"
+            "    -o decrypt_cache=N     keep up to N bytes of decrypted small\n"
+            "                           files in locked memory (default: 4M)\n"
+            "    -o save_progress=T     log progress of saving archive every T\n"
+            "                           seconds (default: 10, 0 disables)\n"
+            "    -o stats               show activity counters in /.vmasfs/stats\n"
+            "    -o hide_stats          the same, but do not list /.vmasfs\n"
+            "    -o latency             time operations from start (SIGUSR2\n"
+            "                           toggles timing, SIGUSR1 dumps latencies)\n"
+            "    -o latency_file=FILE   dump latencies also to FILE\n"
+            "    -o trace=FILE          write Chrome trace events to FILE\n"
             "    -d                     turn on debugging, also implies -f\n"
             "\n");
 }
@@ -43,6 +99,11 @@ void print_usage() {
  */
 void print_version() {
     fprintf(stderr, "%s version: %s\n", PROGRAM, VERSION);
+#if FUSE_USE_VERSION >= 30
+    // FUSE 3 has no setup function reporting library version
+    fprintf(stderr, "FUSE library version: %s\n", fuse_pkgversion());
+    fuse_lowlevel_version();
+#endif
 }
 
 /**
@@ -61,6 +122,44 @@ struct vmasfs_param {
     bool readonly;
     // optional, use passwd
     bool usePasswd;
+    // build only name index at mount time
+    bool lazy;
+    // use mount index file
+    bool index;
+    // directory for mount index file
+    char *indexDir;
+    // run multi-threaded FUSE loop
+    bool multithreaded;
+    // use high-level (path-based) FUSE interface
+    bool highlevel;
+    // use kernel writeback cache
+    bool writeback;
+    // show statistics pseudo-file, hide its directory from listing
+    bool stats;
+    bool hideStats;
+    // time operations from start
+    bool latency;
+    // file to dump operation latencies to
+    char *latencyFile;
+    // file to write trace events to
+    char *traceFile;
+    // kernel cache timeouts, negative if not given
+    double entryTimeout;
+    double attrTimeout;
+    // I/O request size limits, 0 if not given
+    unsigned int maxWrite;
+    unsigned int maxRead;
+    unsigned int maxReadahead;
+    // minimal size of streamed file, 0 if not given
+    unsigned long long streamSize;
+    // number of archive reads in flight, 0 if not given
+    unsigned int ioDepth;
+    // size of cache of decrypted data
+    unsigned long long decryptCache;
+    // limit of memory of file buffers, 0 if not given
+    unsigned long long maxMemory;
+    // interval of logging save progress
+    unsigned int saveProgress;
 };
 
 /**
@@ -105,6 +204,53 @@ static int process_arg(void *data, const char *arg, int key, struct fuse_args *o
             return DISCARD;
         }
 
+        case KEY_LAZY: {
+            param->lazy = true;
+            return DISCARD;
+        }
+
+        case KEY_INDEX: {
+            param->index = true;
+            return DISCARD;
+        }
+
+        case KEY_MT: {
+            param->multithreaded = true;
+            return DISCARD;
+        }
+
+        case KEY_HIGHLEVEL: {
+            param->highlevel = true;
+            return DISCARD;
+        }
+
+        case KEY_WRITEBACK: {
+            param->writeback = true;
+            return DISCARD;
+        }
+
+        case KEY_STATS: {
+            param->stats = true;
+            return DISCARD;
+        }
+
+        case KEY_HIDE_STATS: {
+            param->stats = true;
+            param->hideStats = true;
+            return DISCARD;
+        }
+
+        case KEY_LATENCY: {
+            param->latency = true;
+            return DISCARD;
+        }
+
+        case KEY_MAX_READ: {
+            // kernel limits reads by mount option, so it is passed to FUSE
+            param->maxRead = strtoul(arg + strlen("max_read="), NULL, 10);
+            return KEEP;
+        }
+
         case FUSE_OPT_KEY_NONOPT: {
             ++param->strArgCount;
             switch (param->strArgCount) {
@@ -138,9 +284,267 @@ static const struct fuse_opt vmasfs_opts[] = {
     FUSE_OPT_KEY("-r",          KEY_RO),
     FUSE_OPT_KEY("ro",          KEY_RO),
     FUSE_OPT_KEY("-p",          KEY_USE_PASSWD),
+    FUSE_OPT_KEY("lazy",        KEY_LAZY),
+    FUSE_OPT_KEY("index",       KEY_INDEX),
+    FUSE_OPT_KEY("mt",          KEY_MT),
+    FUSE_OPT_KEY("highlevel",   KEY_HIGHLEVEL),
+    FUSE_OPT_KEY("writeback",   KEY_WRITEBACK),
+    FUSE_OPT_KEY("max_read=",   KEY_MAX_READ),
+    FUSE_OPT_KEY("stats",       KEY_STATS),
+    FUSE_OPT_KEY("hide_stats",  KEY_HIDE_STATS),
+    FUSE_OPT_KEY("latency",     KEY_LATENCY),
+    {"index_dir=%s", offsetof(struct vmasfs_param, indexDir), 0},
+    {"entry_timeout=%lf", offsetof(struct vmasfs_param, entryTimeout), 0},
+    {"attr_timeout=%lf", offsetof(struct vmasfs_param, attrTimeout), 0},
+    {"max_write=%u", offsetof(struct vmasfs_param, maxWrite), 0},
+    {"max_readahead=%u", offsetof(struct vmasfs_param, maxReadahead), 0},
+    {"stream_size=%llu", offsetof(struct vmasfs_param, streamSize), 0},
+    {"io_depth=%u", offsetof(struct vmasfs_param, ioDepth), 0},
+    {"decrypt_cache=%llu", offsetof(struct vmasfs_param, decryptCache), 0},
+    {"max_memory=%llu", offsetof(struct vmasfs_param, maxMemory), 0},
+    {"save_progress=%u", offsetof(struct vmasfs_param, saveProgress), 0},
+    {"latency_file=%s", offsetof(struct vmasfs_param, latencyFile), 0},
+    {"trace=%s", offsetof(struct vmasfs_param, traceFile), 0},
     {NULL, 0, 0}
 };
 
+/**
+ * Mount file system using high-level (path-based) FUSE interface and
+ * process requests until unmounted.
+ */
+static int run_highlevel(struct fuse_args *args, VmasFSData *data, bool mt) {
+    static struct fuse_operations vmasfs_oper;
+    /* {{{ */
+    vmasfs_oper.init       =   vmasfs_init;
+    vmasfs_oper.destroy    =   vmasfs_destroy;
+    vmasfs_oper.readdir    =   vmasfs_readdir;
+    vmasfs_oper.getattr    =   vmasfs_getattr;
+    vmasfs_oper.statfs     =   vmasfs_statfs;
+    vmasfs_oper.open       =   vmasfs_open;
+    vmasfs_oper.read       =   vmasfs_read;
+    vmasfs_oper.write      =   vmasfs_write;
+    vmasfs_oper.release    =   vmasfs_release;
+    vmasfs_oper.unlink     =   vmasfs_unlink;
+    vmasfs_oper.rmdir      =   vmasfs_rmdir;
+    vmasfs_oper.mkdir      =   vmasfs_mkdir;
+    vmasfs_oper.rename     =   vmasfs_rename;
+    vmasfs_oper.create     =   vmasfs_create;
+    vmasfs_oper.chmod      =   vmasfs_chmod;
+    vmasfs_oper.chown      =   vmasfs_chown;
+    vmasfs_oper.flush      =   vmasfs_flush;
+    vmasfs_oper.fsync      =   vmasfs_fsync;
+    vmasfs_oper.fsyncdir   =   vmasfs_fsyncdir;
+    vmasfs_oper.opendir    =   vmasfs_opendir;
+    vmasfs_oper.releasedir =   vmasfs_releasedir;
+    vmasfs_oper.access     =   vmasfs_access;
+    vmasfs_oper.utimens    =   vmasfs_utimens;
+#if FUSE_USE_VERSION < 30
+    vmasfs_oper.ftruncate  =   vmasfs_ftruncate;
+#endif
+    vmasfs_oper.truncate   =   vmasfs_truncate;
+    vmasfs_oper.setxattr   =   vmasfs_setxattr;
+    vmasfs_oper.getxattr   =   vmasfs_getxattr;
+    vmasfs_oper.listxattr  =   vmasfs_listxattr;
+    vmasfs_oper.removexattr=   vmasfs_removexattr;
+    vmasfs_oper.readlink   =   vmasfs_readlink;
+    vmasfs_oper.symlink    =   vmasfs_symlink;
+
+#if FUSE_VERSION >= 28 && FUSE_USE_VERSION < 30
+    // don't allow NULL path
+    vmasfs_oper.flag_nullpath_ok = 0;
+#endif
+    /* }}} */
+
+    struct fuse *fuse;
+    int res = -1;
+
+#if FUSE_USE_VERSION >= 30
+    // use_ino and timeouts are set in init handler
+    struct fuse_cmdline_opts opts;
+    if (fuse_parse_cmdline(args, &opts) != 0 || opts.mountpoint == NULL) {
+        fuse_opt_free_args(args);
+        delete data;
+        return EXIT_FAILURE;
+    }
+    fuse = fuse_new(args, &vmasfs_oper, sizeof(vmasfs_oper), data);
+    fuse_opt_free_args(args);
+    if (fuse == NULL) {
+        free(opts.mountpoint);
+        delete data;
+        return EXIT_FAILURE;
+    }
+    if (fuse_mount(fuse, opts.mountpoint) == 0) {
+        struct fuse_session *se = fuse_get_session(fuse);
+        if (fuse_set_signal_handlers(se) == 0) {
+            if (fuse_daemonize(opts.foreground) == 0) {
+                if (mt && !opts.singlethread) {
+                    res = fuse_loop_mt(fuse, opts.clone_fd);
+                } else {
+                    res = fuse_loop(fuse);
+                }
+            }
+            fuse_remove_signal_handlers(se);
+        }
+        fuse_unmount(fuse);
+    }
+    // file system data is saved and freed by destroy handler
+    fuse_destroy(fuse);
+    free(opts.mountpoint);
+#else
+    char *mountpoint;
+    // set by FUSE unless -s option is given, used only with -o mt
+    int multithreaded;
+
+    // inode numbers are unique and stable during mount
+    fuse_opt_add_arg(args, "-ouse_ino");
+    if (data != NULL) {
+        char timeouts[64];
+        snprintf(timeouts, sizeof(timeouts), "-oentry_timeout=%g,attr_timeout=%g",
+                data->m_entryTimeout, data->m_attrTimeout);
+        fuse_opt_add_arg(args, timeouts);
+    }
+
+    fuse = fuse_setup(args->argc, args->argv, &vmasfs_oper, sizeof(vmasfs_oper), &mountpoint, &multithreaded, data);
+    fuse_opt_free_args(args);
+    if (fuse == NULL) {
+        delete data;
+        return EXIT_FAILURE;
+    }
+    if (mt && multithreaded) {
+        res = fuse_loop_mt(fuse);
+    } else {
+        res = fuse_loop(fuse);
+    }
+    fuse_teardown(fuse, mountpoint);
+#endif
+    return (res == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/**
+ * Mount file system using low-level (inode-based) FUSE interface and
+ * process requests until unmounted.
+ */
+static int run_lowlevel(struct fuse_args *args, VmasFSData *data, bool mt) {
+    static struct fuse_lowlevel_ops vmasfs_oper;
+    /* {{{ */
+    vmasfs_oper.init        =   vmasfs_ll_init;
+    vmasfs_oper.destroy     =   vmasfs_ll_destroy;
+    vmasfs_oper.lookup      =   vmasfs_ll_lookup;
+    vmasfs_oper.forget      =   vmasfs_ll_forget;
+    vmasfs_oper.getattr     =   vmasfs_ll_getattr;
+    vmasfs_oper.setattr     =   vmasfs_ll_setattr;
+    vmasfs_oper.readlink    =   vmasfs_ll_readlink;
+    vmasfs_oper.mkdir       =   vmasfs_ll_mkdir;
+    vmasfs_oper.unlink      =   vmasfs_ll_unlink;
+    vmasfs_oper.rmdir       =   vmasfs_ll_rmdir;
+    vmasfs_oper.symlink     =   vmasfs_ll_symlink;
+    vmasfs_oper.rename      =   vmasfs_ll_rename;
+    vmasfs_oper.open        =   vmasfs_ll_open;
+    vmasfs_oper.read        =   vmasfs_ll_read;
+    vmasfs_oper.write       =   vmasfs_ll_write;
+    vmasfs_oper.flush       =   vmasfs_ll_flush;
+    vmasfs_oper.release     =   vmasfs_ll_release;
+    vmasfs_oper.fsync       =   vmasfs_ll_fsync;
+    vmasfs_oper.opendir     =   vmasfs_ll_opendir;
+    vmasfs_oper.readdir     =   vmasfs_ll_readdir;
+    vmasfs_oper.releasedir  =   vmasfs_ll_releasedir;
+    vmasfs_oper.fsyncdir    =   vmasfs_ll_fsyncdir;
+    vmasfs_oper.statfs      =   vmasfs_ll_statfs;
+    vmasfs_oper.setxattr    =   vmasfs_ll_setxattr;
+    vmasfs_oper.getxattr    =   vmasfs_ll_getxattr;
+    vmasfs_oper.listxattr   =   vmasfs_ll_listxattr;
+    vmasfs_oper.removexattr =   vmasfs_ll_removexattr;
+    vmasfs_oper.access      =   vmasfs_ll_access;
+    vmasfs_oper.create      =   vmasfs_ll_create;
+#if FUSE_VERSION >= 29
+    vmasfs_oper.forget_multi=   vmasfs_ll_forget_multi;
+#endif
+#if FUSE_USE_VERSION >= 30
+    vmasfs_oper.readdirplus =   vmasfs_ll_readdirplus;
+#endif
+    /* }}} */
+
+    struct fuse_session *se;
+    int res = -1;
+
+#if FUSE_USE_VERSION >= 30
+    struct fuse_cmdline_opts opts;
+    if (fuse_parse_cmdline(args, &opts) != 0 || opts.mountpoint == NULL) {
+        fuse_opt_free_args(args);
+        delete data;
+        return EXIT_FAILURE;
+    }
+    se = fuse_session_new(args, &vmasfs_oper, sizeof(vmasfs_oper), data);
+    fuse_opt_free_args(args);
+    if (se == NULL) {
+        free(opts.mountpoint);
+        delete data;
+        return EXIT_FAILURE;
+    }
+    if (fuse_set_signal_handlers(se) == 0) {
+        if (fuse_session_mount(se, opts.mountpoint) == 0) {
+            if (fuse_daemonize(opts.foreground) == 0) {
+                if (mt && !opts.singlethread) {
+                    res = fuse_session_loop_mt(se, opts.clone_fd);
+                } else {
+                    res = fuse_session_loop(se);
+                }
+            }
+            fuse_session_unmount(se);
+        }
+        fuse_remove_signal_handlers(se);
+    }
+    // file system data is saved and freed by destroy handler
+    fuse_session_destroy(se);
+    free(opts.mountpoint);
+#else
+    char *mountpoint;
+    // set by FUSE unless -s option is given, used only with -o mt
+    int multithreaded;
+    int foreground;
+    struct fuse_chan *ch;
+
+    if (fuse_parse_cmdline(args, &mountpoint, &multithreaded, &foreground) != 0
+            || mountpoint == NULL) {
+        fuse_opt_free_args(args);
+        delete data;
+        return EXIT_FAILURE;
+    }
+    ch = fuse_mount(mountpoint, args);
+    if (ch == NULL) {
+        free(mountpoint);
+        fuse_opt_free_args(args);
+        delete data;
+        return EXIT_FAILURE;
+    }
+    se = fuse_lowlevel_new(args, &vmasfs_oper, sizeof(vmasfs_oper), data);
+    fuse_opt_free_args(args);
+    if (se == NULL) {
+        fuse_unmount(mountpoint, ch);
+        free(mountpoint);
+        delete data;
+        return EXIT_FAILURE;
+    }
+    if (fuse_set_signal_handlers(se) == 0) {
+        fuse_session_add_chan(se, ch);
+        if (fuse_daemonize(foreground) == 0) {
+            if (mt && multithreaded) {
+                res = fuse_session_loop_mt(se);
+            } else {
+                res = fuse_session_loop(se);
+            }
+        }
+        fuse_remove_signal_handlers(se);
+        fuse_session_remove_chan(ch);
+    }
+    // file system data is saved and freed by destroy handler
+    fuse_session_destroy(se);
+    fuse_unmount(mountpoint, ch);
+    free(mountpoint);
+#endif
+    return (res == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
 int main(int argc, char *argv[]) {
     if (sizeof(void*) > sizeof(uint64_t)) {
         fprintf(stderr,"%s: This program cannot be run on your system because of FUSE design limitation\n", PROGRAM);
@@ -154,15 +558,54 @@ int main(int argc, char *argv[]) {
     param.readonly = false;
     param.strArgCount = 0;
     param.usePasswd = false;
+    param.lazy = false;
+    param.index = false;
+    param.indexDir = NULL;
+    param.multithreaded = false;
+    param.highlevel = false;
+    param.writeback = false;
+    param.stats = false;
+    param.hideStats = false;
+    param.latency = false;
+    param.latencyFile = NULL;
+    param.traceFile = NULL;
+    param.entryTimeout = -1;
+    param.attrTimeout = -1;
+    param.maxWrite = 0;
+    param.maxRead = 0;
+    param.maxReadahead = 0;
+    param.streamSize = 0;
+    param.ioDepth = 0;
+    param.decryptCache = DEFAULT_DECRYPT_CACHE;
+    param.maxMemory = 0;
+    param.saveProgress = DEFAULT_SAVE_PROGRESS;
     param.fileName = NULL;
 
     if (fuse_opt_parse(&args, &param, vmasfs_opts, process_arg)) {
+        free(param.indexDir);
+        free(param.latencyFile);
         fuse_opt_free_args(&args);
         return EXIT_FAILURE;
     }
+    // copied to not track allocated string on every return path
+    bool useIndex = param.index || param.indexDir != NULL;
+    std::string indexDir;
+    if (param.indexDir != NULL) {
+        indexDir = param.indexDir;
+        free(param.indexDir);
+    }
+    std::string latencyFile;
+    if (param.latencyFile != NULL) {
+        latencyFile = param.latencyFile;
+        free(param.latencyFile);
+    }
 
     // if all work is done inside options parsing...
+#if FUSE_USE_VERSION >= 30
+    if (param.help || param.version) {
+#else
     if (param.help) {
+#endif
         fuse_opt_free_args(&args);
         return EXIT_SUCCESS;
     }
@@ -175,84 +618,108 @@ int main(int argc, char *argv[]) {
             fuse_opt_free_args(&args);
             return EXIT_FAILURE;
         }
+        if ((param.maxWrite != 0 && param.maxWrite < MIN_IO_SIZE) ||
+                (param.maxRead != 0 && param.maxRead < MIN_IO_SIZE)) {
+            fprintf(stderr, "%s: max_write and max_read must be at least %d\n", PROGRAM, MIN_IO_SIZE);
+            fuse_opt_free_args(&args);
+            return EXIT_FAILURE;
+        }
 
         openlog(PROGRAM, LOG_PID, LOG_USER);
-        if ((data = initVmasFS(PROGRAM, param.fileName, param.readonly))
-                == NULL) {
+        data = initVmasFS(PROGRAM, param.fileName, param.readonly,
+                param.lazy, useIndex ? indexDir.c_str() : NULL);
+        if (data == NULL) {
+            free(param.traceFile);
+            fuse_opt_free_args(&args);
+            return EXIT_FAILURE;
+        }
+        // relative name is opened before process changes directory
+        if (param.traceFile != NULL &&
+                !TraceLog::global.open(param.traceFile)) {
+            fprintf(stderr, "%s: unable to open trace file %s\n",
+                    PROGRAM, param.traceFile);
+            delete data;
+            free(param.traceFile);
             fuse_opt_free_args(&args);
             return EXIT_FAILURE;
         }
+        free(param.traceFile);
+        if (!latencyFile.empty()) {
+            data->setLatencyFile(latencyFile.c_str());
+        }
         // try password
         if (param.usePasswd) {
+            // password can not be checked if there are no encrypted
+            // entries, ask it twice to not encrypt new files with a typo
+            bool confirm = !param.readonly && !data->hasEncryptedEntries();
             int try_count = 3;
             while (try_count--) {
+                if (confirm) {
+                    // getpass returns static buffer, first answer is copied
+                    std::string pass = getpass("Enter password: ");
+                    const char *repeat = getpass("Repeat password: ");
+                    bool match = (pass == repeat);
+                    pass.assign(pass.size(), '\0');
+                    if (match && data->try_passwd(repeat)) {
+                        break;
+                    }
+                    fprintf(stderr,"Passwords do not match!\n");
+                    continue;
+                }
                 if (data->try_passwd(getpass("Enter password: "))) {
                     break;
                 }
                 fprintf(stderr,"Incorrect!\n");
             }
             if (try_count < 0) {
+                delete data;
                 fuse_opt_free_args(&args);
                 fprintf(stderr,"%s quit!\n", PROGRAM);
                 return EXIT_FAILURE;
             }
+            data->setDecryptCache(param.decryptCache);
         }
-    }
-
-    static struct fuse_operations vmasfs_oper;
-    /* {{{ */
-    vmasfs_oper.init       =   vmasfs_init;
-    vmasfs_oper.destroy    =   vmasfs_destroy;
-    vmasfs_oper.readdir    =   vmasfs_readdir;
-    vmasfs_oper.getattr    =   vmasfs_getattr;
-    vmasfs_oper.statfs     =   vmasfs_statfs;
-    vmasfs_oper.open       =   vmasfs_open;
-    vmasfs_oper.read       =   vmasfs_read;
-    vmasfs_oper.write      =   vmasfs_write;
-    vmasfs_oper.release    =   vmasfs_release;
-    vmasfs_oper.unlink     =   vmasfs_unlink;
-    vmasfs_oper.rmdir      =   vmasfs_rmdir;
-    vmasfs_oper.mkdir      =   vmasfs_mkdir;
-    vmasfs_oper.rename     =   vmasfs_rename;
-    vmasfs_oper.create     =   vmasfs_create;
-    vmasfs_oper.chmod      =   vmasfs_chmod;
-    vmasfs_oper.chown      =   vmasfs_chown;
-    vmasfs_oper.flush      =   vmasfs_flush;
-    vmasfs_oper.fsync      =   vmasfs_fsync;
-    vmasfs_oper.fsyncdir   =   vmasfs_fsyncdir;
-    vmasfs_oper.opendir    =   vmasfs_opendir;
-    vmasfs_oper.releasedir =   vmasfs_releasedir;
-    vmasfs_oper.access     =   vmasfs_access;
-    vmasfs_oper.utimens    =   vmasfs_utimens;
-    vmasfs_oper.ftruncate  =   vmasfs_ftruncate;
-    vmasfs_oper.truncate   =   vmasfs_truncate;
-    vmasfs_oper.setxattr   =   vmasfs_setxattr;
-    vmasfs_oper.getxattr   =   vmasfs_getxattr;
-    vmasfs_oper.listxattr  =   vmasfs_listxattr;
-    vmasfs_oper.removexattr=   vmasfs_removexattr;
-    vmasfs_oper.readlink   =   vmasfs_readlink;
-    vmasfs_oper.symlink    =   vmasfs_symlink;
-
-#if FUSE_VERSION >= 28
-    // don't allow NULL path
-    vmasfs_oper.flag_nullpath_ok = 0;
+        if (param.stats) {
+            try {
+                data->enableStats(param.hideStats);
+            }
+            catch (std::bad_alloc) {
+                delete data;
+                fuse_opt_free_args(&args);
+                fprintf(stderr, "%s: no enough memory\n", PROGRAM);
+                return EXIT_FAILURE;
+            }
+        }
+        double timeout = param.readonly ? READONLY_TIMEOUT : DEFAULT_TIMEOUT;
+        data->m_entryTimeout = (param.entryTimeout < 0) ? timeout : param.entryTimeout;
+        data->m_attrTimeout = (param.attrTimeout < 0) ? timeout : param.attrTimeout;
+        data->m_maxWrite = param.maxWrite;
+        data->m_maxRead = param.maxRead;
+        data->m_maxReadahead = param.maxReadahead;
+        data->m_streamSize = param.streamSize;
+        BigBuffer::maxMemory = param.maxMemory;
+        data->m_progressInterval = param.saveProgress;
+        if (param.ioDepth != 0) {
+            data->openIO(param.ioDepth);
+        }
+        if (param.writeback) {
+#if FUSE_USE_VERSION >= 30
+            // nothing to cache in read-only mount
+            data->m_writebackCache = !param.readonly;
+#else
+            fprintf(stderr, "%s: writeback cache needs FUSE 3, option ignored\n", PROGRAM);
 #endif
-    /* }}} */
-
-    struct fuse *fuse;
-    char *mountpoint;
-    // this flag ignored because libzip does not supports multithreading
-    int multithreaded;
-    int res;
+        }
+        Statistics::global.setTiming(param.latency);
+        // latency signals are accepted by signal thread only, FUSE threads
+        // inherit signal mask
+        LatencyDumper::blockSignals();
+    }
 
-    fuse = fuse_setup(args.argc, args.argv, &vmasfs_oper, sizeof(vmasfs_oper), &mountpoint, &multithreaded, data);
-    fuse_opt_free_args(&args);
-    if (fuse == NULL) {
-        delete data;
-        return EXIT_FAILURE;
+    // FUSE library version is reported by high-level library only
+    if (param.highlevel || param.version) {
+        return run_highlevel(&args, data, param.multithreaded);
     }
-    res = fuse_loop(fuse);
-    fuse_teardown(fuse, mountpoint);
-    return (res == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+    return run_lowlevel(&args, data, param.multithreaded);
 }
 /* vim:set st=4 sw=4 et fdm=marker: */
@@ -0,0 +1,85 @@
+////////////////////////////////////////////////////////////////////////////
+//  Copyright (C) 2021 by V+ Publicidad SpA                               //
+//  http://www.vmaspublicidad.com                                         //
+//                                                                        //
+////////////////////////////////////////////////////////////////////////////
+
+// Overhead of operation timing: OpTimer around an empty operation with
+// timing disabled and enabled, and cost of clock_gettime(CLOCK_MONOTONIC)
+// that timed OpTimer calls twice.
+//
+// Build from the top directory of source tree:
+//
+//   make -C lib
+//   g++ -O2 -Ilib $(pkg-config libzip --cflags) -o timerBench
+//       performance_tests/timerBench.cpp -Llib -lvmasfs
+//       $(pkg-config libzip --libs) -lpthread
+//   ./timerBench [iterations]
+
+#include "../config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "statistics.h"
+
+static const int RUNS = 5;
+
+static double now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/**
+ * Best time of RUNS runs of 'n' empty operations in ns per operation
+ */
+static double timerBench(bool timing, long n) {
+    Statistics::global.setTiming(timing);
+    double best = 0;
+    for (int run = 0; run < RUNS; ++run) {
+        double started = now();
+        for (long i = 0; i < n; ++i) {
+            OpTimer timer(Statistics::GETATTR);
+            // keep compiler from merging iterations
+            __asm__ __volatile__ ("" ::: "memory");
+        }
+        double elapsed = now() - started;
+        if (best == 0 || elapsed < best) {
+            best = elapsed;
+        }
+    }
+    Statistics::global.setTiming(false);
+    return best / n * 1e9;
+}
+
+/**
+ * Best time of RUNS runs of 'n' clock_gettime calls in ns per call
+ */
+static double clockBench(long n) {
+    double best = 0;
+    for (int run = 0; run < RUNS; ++run) {
+        struct timespec ts;
+        double started = now();
+        for (long i = 0; i < n; ++i) {
+            clock_gettime(CLOCK_MONOTONIC, &ts);
+        }
+        double elapsed = now() - started;
+        if (best == 0 || elapsed < best) {
+            best = elapsed;
+        }
+    }
+    return best / n * 1e9;
+}
+
+int main(int argc, char **argv) {
+    long n = (argc > 1) ? atol(argv[1]) : 20000000;
+
+    printf("timing disabled     %6.1f ns per operation\n",
+            timerBench(false, n));
+    printf("timing enabled      %6.1f ns per operation\n",
+            timerBench(true, n));
+    printf("clock_gettime       %6.1f ns per call\n", clockBench(n));
+    return EXIT_SUCCESS;
+}
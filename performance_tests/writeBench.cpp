@@ -0,0 +1,73 @@
+////////////////////////////////////////////////////////////////////////////
+//  Copyright (C) 2021 by V+ Publicidad SpA                               //
+//  http://www.vmaspublicidad.com                                         //
+//                                                                        //
+////////////////////////////////////////////////////////////////////////////
+
+// Cost of write request inside vmas-fs: OpTimer, node lock and
+// BigBuffer::write called in a loop, no kernel and no FUSE involved.
+//
+// Build from the top directory of source tree:
+//
+//   make -C lib
+//   g++ -O2 -Ilib $(pkg-config libzip --cflags) -o writeBench
+//       performance_tests/writeBench.cpp -Llib -lvmasfs
+//       $(pkg-config libzip --libs) -lpthread
+//   ./writeBench [MiB]
+
+#include "../config.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <vector>
+
+#include "bigBuffer.h"
+#include "lock.h"
+#include "statistics.h"
+
+static const int RUNS = 5;
+
+static double now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/**
+ * Write 'total' bytes into new buffer by requests of 'size' bytes like
+ * write handler does. Returns best throughput of RUNS runs in MiB/s.
+ */
+static double writeBench(size_t size, size_t total) {
+    std::vector<char> data(size, 'x');
+    pthread_mutex_t nodeLock = PTHREAD_MUTEX_INITIALIZER;
+    double best = 0;
+    for (int run = 0; run < RUNS; ++run) {
+        BigBuffer *buffer = new BigBuffer();
+        double started = now();
+        for (size_t offset = 0; offset < total; offset += size) {
+            OpTimer timer(Statistics::WRITE);
+            MutexLock lock(nodeLock);
+            timer.transferred(buffer->write(&data[0], size, offset));
+        }
+        double elapsed = now() - started;
+        delete buffer;
+        if (best == 0 || elapsed < best) {
+            best = elapsed;
+        }
+    }
+    return total / best / (1024 * 1024);
+}
+
+int main(int argc, char **argv) {
+    size_t total = ((argc > 1) ? atol(argv[1]) : 512) * 1024UL * 1024;
+    const size_t SIZES[] = {4096, 32768, 131072, 1048576};
+
+    printf("request size    requests    throughput\n");
+    for (size_t i = 0; i < sizeof(SIZES) / sizeof(SIZES[0]); ++i) {
+        printf("%7zu KiB    %10zu    %6.0f MiB/s\n", SIZES[i] / 1024,
+                total / SIZES[i], writeBench(SIZES[i], total));
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,141 @@
+// libzip stubs for tests of file tree. Archive is a list of entry names,
+// entries are empty files (or directories if name ends with slash).
+// Functions changing archive or reading entry data must not be called.
+//
+// Include after common.h.
+
+#include <string>
+#include <vector>
+
+// libzip stub structures
+struct zip {
+    std::vector<std::string> names;
+};
+struct zip_file {};
+struct zip_source {};
+
+/**
+ * Fill archive with entry names from NULL-terminated array
+ */
+void initArchive(struct zip &z, const char *const names[]) {
+    for (const char *const *name = names; *name != NULL; ++name) {
+        z.names.push_back(*name);
+    }
+}
+
+// libzip stub functions
+
+zip_int64_t zip_get_num_entries(struct zip *z, zip_flags_t) {
+    return z->names.size();
+}
+
+const char *zip_get_name(struct zip *z, zip_uint64_t index, zip_flags_t) {
+    return z->names[index].c_str();
+}
+
+int zip_stat_index(struct zip *z, zip_uint64_t index, zip_flags_t,
+        struct zip_stat *zs) {
+    zs->valid = ZIP_STAT_NAME | ZIP_STAT_INDEX | ZIP_STAT_SIZE |
+        ZIP_STAT_COMP_SIZE | ZIP_STAT_MTIME | ZIP_STAT_CRC |
+        ZIP_STAT_COMP_METHOD | ZIP_STAT_ENCRYPTION_METHOD | ZIP_STAT_FLAGS;
+    zs->name = z->names[index].c_str();
+    zs->index = index;
+    zs->size = 0;
+    zs->comp_size = 0;
+    zs->mtime = 0;
+    zs->crc = 0;
+    zs->comp_method = ZIP_CM_STORE;
+    zs->encryption_method = ZIP_EM_NONE;
+    zs->flags = 0;
+    return 0;
+}
+
+int zip_close(struct zip *) {
+    return 0;
+}
+
+// only stubs
+
+struct zip *zip_open(const char *, int, int *) {
+    assert(false);
+    return NULL;
+}
+
+void zip_discard(struct zip *) {
+    assert(false);
+}
+
+int zip_error_to_str(char *, zip_uint64_t, int, int) {
+    assert(false);
+    return 0;
+}
+
+zip_int64_t zip_file_add(struct zip *, const char *, struct zip_source *, zip_flags_t) {
+    assert(false);
+    return 0;
+}
+
+zip_int64_t zip_dir_add(struct zip *, const char *, zip_flags_t) {
+    assert(false);
+    return 0;
+}
+
+int zip_delete(struct zip *, zip_uint64_t) {
+    assert(false);
+    return 0;
+}
+
+int zip_fclose(struct zip_file *) {
+    assert(false);
+    return 0;
+}
+
+struct zip_file *zip_fopen_index(struct zip *, zip_uint64_t, zip_flags_t) {
+    assert(false);
+    return NULL;
+}
+
+zip_int64_t zip_fread(struct zip_file *, void *, zip_uint64_t) {
+    assert(false);
+    return 0;
+}
+
+int zip_file_rename(struct zip *, zip_uint64_t, const char *, zip_flags_t) {
+    assert(false);
+    return 0;
+}
+
+int zip_file_replace(struct zip *, zip_uint64_t, struct zip_source *, zip_flags_t) {
+    assert(false);
+    return 0;
+}
+
+int zip_file_set_encryption(struct zip *, zip_uint64_t, zip_uint16_t, const char *) {
+    assert(false);
+    return 0;
+}
+
+int zip_register_progress_callback_with_state(struct zip *, double,
+        zip_progress_callback, void (*)(void *), void *) {
+    assert(false);
+    return 0;
+}
+
+void zip_source_free(struct zip_source *) {
+    assert(false);
+}
+
+struct zip_source *zip_source_function(struct zip *, zip_source_callback, void *) {
+    assert(false);
+    return NULL;
+}
+
+const char *zip_strerror(struct zip *) {
+    assert(false);
+    return NULL;
+}
+
+const char *zip_file_strerror(struct zip_file *) {
+    assert(false);
+    return NULL;
+}
@@ -10,6 +10,7 @@
 #define private public
 
 #include "bigBuffer.h"
+#include "statistics.h"
 #include "common.h"
 
 // global variables
@@ -27,10 +28,15 @@ struct zip {
     bool fail_zip_source_function;
     bool fail_zip_add;
     bool fail_zip_replace;
+    bool fail_zip_set_encryption;
+    // encryption method of the last entry or -1
+    int encryption;
+    bool deleted;
 
     struct zip_source *source;
 
-    zip(): zip_fread_custom_return(false) {}
+    zip(): zip_fread_custom_return(false), fail_zip_set_encryption(false),
+        encryption(-1), deleted(false) {}
 };
 struct zip_file {
     struct zip *zip;
@@ -53,6 +59,16 @@ int zip_file_replace(struct zip *z, zip_uint64_t, struct zip_source *, zip_flags
     return z->fail_zip_replace ? -1 : 0;
 }
 
+int zip_file_set_encryption(struct zip *z, zip_uint64_t, zip_uint16_t method, const char *password) {
+    assert(use_zip);
+    assert(password != NULL);
+    if (z->fail_zip_set_encryption) {
+        return -1;
+    }
+    z->encryption = method;
+    return 0;
+}
+
 struct zip_file *zip_fopen_index(struct zip *z, zip_uint64_t, zip_flags_t) {
     assert(use_zip);
     if (z->fail_zip_fopen_index) {
@@ -137,8 +153,9 @@ int zip_close(struct zip *) {
     return 0;
 }
 
-int zip_delete(struct zip *, int) {
-    assert(false);
+int zip_delete(struct zip *z, zip_uint64_t) {
+    assert(use_zip);
+    z->deleted = true;
     return 0;
 }
 
@@ -498,6 +515,55 @@ void writeZip() {
     }
 }
 
+// Save file to zip with password
+// Check that new and replaced entries are encrypted
+void writeEncryptedZip() {
+    BigBuffer::passwd = "secret";
+    // new file
+    {
+        BigBuffer bb;
+        struct zip z;
+        zip_int64_t id = -1;
+        z.fail_zip_source_function = false;
+        z.fail_zip_add = false;
+        z.fail_zip_set_encryption = true;
+        assert(bb.saveToZip(time(NULL), &z, "bebebe.txt", true, id) == -EIO);
+        assert(id == -1);
+        // added entry is removed, source is freed by libzip
+        assert(z.deleted);
+        delete (BigBuffer::CallBackStruct *)z.source->cbs;
+        free(z.source);
+
+        z.fail_zip_set_encryption = false;
+        assert(bb.saveToZip(time(NULL), &z, "bebebe.txt", true, id) == 0);
+        assert(id == 0);
+        assert(z.encryption == ZIP_EM_AES_256);
+        delete (BigBuffer::CallBackStruct *)z.source->cbs;
+        free(z.source);
+    }
+    // existing file
+    {
+        BigBuffer bb;
+        struct zip z;
+        zip_int64_t id = 11;
+        z.fail_zip_source_function = false;
+        z.fail_zip_replace = false;
+        z.fail_zip_set_encryption = true;
+        z.source = NULL;
+        // data is not replaced
+        assert(bb.saveToZip(time(NULL), &z, "bebebe.txt", false, id) == -EIO);
+        assert(z.source == NULL);
+
+        z.fail_zip_set_encryption = false;
+        assert(bb.saveToZip(time(NULL), &z, "bebebe.txt", false, id) == 0);
+        assert(id == 11);
+        assert(z.encryption == ZIP_EM_AES_256);
+        delete (BigBuffer::CallBackStruct *)z.source->cbs;
+        free(z.source);
+    }
+    BigBuffer::passwd = NULL;
+}
+
 void zipFReadLengthFailure() {
     BigBuffer bb;
     struct zip z;
@@ -530,6 +596,35 @@ void zipFReadLengthFailure() {
     }
 }
 
+// Buffers do not grow over memory limit
+void memoryLimit() {
+    char buf[BigBuffer::chunkSize * 3];
+    memset(buf, 'm', sizeof(buf));
+    BigBuffer::maxMemory = Statistics::global.bufferBytes() +
+        BigBuffer::chunkSize * 2;
+    assert(BigBuffer::fits(BigBuffer::chunkSize * 2));
+    assert(!BigBuffer::fits(BigBuffer::chunkSize * 2 + 1));
+
+    BigBuffer bb;
+    assert(bb.write(buf, BigBuffer::chunkSize, 0) == BigBuffer::chunkSize);
+    bool thrown = false;
+    try {
+        bb.write(buf, sizeof(buf), BigBuffer::chunkSize);
+    }
+    catch (const std::bad_alloc &) {
+        thrown = true;
+    }
+    assert(thrown);
+    // failed write does not change length or hold memory
+    assert(bb.len == BigBuffer::chunkSize);
+    assert(bb.write(buf, BigBuffer::chunkSize, BigBuffer::chunkSize)
+            == BigBuffer::chunkSize);
+    assert(!BigBuffer::fits(1));
+
+    BigBuffer::maxMemory = 0;
+    assert(BigBuffer::fits(sizeof(buf)));
+}
+
 int main(int, char **) {
     initTest();
 
@@ -541,12 +636,14 @@ int main(int, char **) {
     truncateRead();
     writeFile();
     readExpanded();
+    memoryLimit();
     zipUserFunctionCallBackEmpty();
     zipUserFunctionCallBackNonEmpty();
 
     use_zip = true;
     readZip();
     writeZip();
+    writeEncryptedZip();
 
     zipFReadLengthFailure();
 
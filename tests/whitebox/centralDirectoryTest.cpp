@@ -0,0 +1,205 @@
+#include "../config.h"
+
+#include <zip.h>
+#include <assert.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "centralDirectory.h"
+#include "common.h"
+
+const char *ARCHIVE_FILE = "centralDirectoryTest.zip";
+
+typedef std::vector<zip_uint8_t> bytes_t;
+
+void putShort(bytes_t &b, zip_uint16_t v) {
+    b.push_back(v & 0xFF);
+    b.push_back(v >> 8);
+}
+
+void putLong(bytes_t &b, zip_uint32_t v) {
+    putShort(b, v & 0xFFFF);
+    putShort(b, v >> 16);
+}
+
+void putLongLong(bytes_t &b, zip_uint64_t v) {
+    putLong(b, v & 0xFFFFFFFF);
+    putLong(b, v >> 32);
+}
+
+/**
+ * Append local header with extra field, central directory record is
+ * appended to 'cd'
+ */
+void addEntry(bytes_t &zip, bytes_t &cd, const char *name,
+        const bytes_t &localExtra, bool zip64) {
+    zip_uint64_t offset = zip.size();
+    putLong(zip, 0x04034b50);
+    putShort(zip, 20);
+    putShort(zip, 0);
+    putShort(zip, 0);
+    putShort(zip, 0);
+    putShort(zip, 0);
+    putLong(zip, 0);
+    putLong(zip, 0);
+    putLong(zip, 0);
+    putShort(zip, strlen(name));
+    putShort(zip, localExtra.size());
+    zip.insert(zip.end(), name, name + strlen(name));
+    zip.insert(zip.end(), localExtra.begin(), localExtra.end());
+
+    bytes_t extra;
+    if (zip64) {
+        putShort(extra, 0x0001);
+        putShort(extra, 16);
+        putLongLong(extra, 0x100000000ULL);
+        putLongLong(extra, offset);
+    }
+    putLong(cd, 0x02014b50);
+    putShort(cd, (3 << 8) | 20);
+    putShort(cd, 20);
+    putShort(cd, 0);
+    putShort(cd, 0);
+    // 2020-01-02 03:04:06
+    putShort(cd, (3 << 11) | (4 << 5) | 3);
+    putShort(cd, ((2020 - 1980) << 9) | (1 << 5) | 2);
+    putLong(cd, 0);
+    putLong(cd, 0);
+    putLong(cd, zip64 ? 0xFFFFFFFF : 10);
+    putShort(cd, strlen(name));
+    putShort(cd, extra.size());
+    putShort(cd, 0);
+    putShort(cd, 0);
+    putShort(cd, 0);
+    putLong(cd, 0100644 << 16);
+    putLong(cd, zip64 ? 0xFFFFFFFF : offset);
+    cd.insert(cd.end(), name, name + strlen(name));
+    cd.insert(cd.end(), extra.begin(), extra.end());
+}
+
+/**
+ * Append central directory, 'trailer' (ZIP64 records) and end of central
+ * directory record, then write archive to file
+ */
+void writeArchive(bytes_t &zip, const bytes_t &cd, zip_uint16_t count,
+        const bytes_t &trailer = bytes_t()) {
+    zip_uint32_t cdOffset = zip.size();
+    zip.insert(zip.end(), cd.begin(), cd.end());
+    zip.insert(zip.end(), trailer.begin(), trailer.end());
+    putLong(zip, 0x06054b50);
+    putShort(zip, 0);
+    putShort(zip, 0);
+    putShort(zip, count);
+    putShort(zip, count);
+    putLong(zip, cd.size());
+    putLong(zip, cdOffset);
+    putShort(zip, 0);
+
+    FILE *f = fopen(ARCHIVE_FILE, "wb");
+    assert(f != NULL);
+    assert(fwrite(&zip[0], 1, zip.size(), f) == zip.size());
+    fclose(f);
+}
+
+/**
+ * Entries are read in central directory order with sizes and offsets
+ * from ZIP64 extra field and local header extra fields
+ */
+void readEntries() {
+    bytes_t zip, cd, noExtra, localExtra;
+    putShort(localExtra, 0x5455);
+    putShort(localExtra, 5);
+    localExtra.push_back(1);
+    putLong(localExtra, 1000000);
+
+    addEntry(zip, cd, "dir/file", localExtra, false);
+    addEntry(zip, cd, "big", noExtra, true);
+    writeArchive(zip, cd, 2);
+
+    CentralDirectory dir;
+    assert(dir.open(ARCHIVE_FILE));
+    assert(dir.count() == 2);
+
+    zip_uint64_t pos = 0;
+    CentralDirectory::Entry entry;
+    assert(!dir.atEnd(pos));
+    assert(dir.readEntry(pos, entry));
+    assert(std::string(entry.name, entry.nameLength) == "dir/file");
+    assert(entry.size == 10);
+    assert(entry.offset == 0);
+    assert((entry.versionMadeBy >> 8) == 3);
+    assert((entry.externalAttributes >> 16) == 0100644);
+    struct tm *tm = localtime(&entry.mtime);
+    assert(tm->tm_year == 120 && tm->tm_mon == 0 && tm->tm_mday == 2);
+    assert(tm->tm_hour == 3 && tm->tm_min == 4 && tm->tm_sec == 6);
+
+    const zip_uint8_t *ef = entry.localExtra;
+    zip_uint16_t type, len;
+    const zip_uint8_t *field;
+    assert(CentralDirectory::nextExtraField(ef,
+                entry.localExtra + entry.localExtraLength, type, len, field));
+    assert(type == 0x5455 && len == 5 && field[0] == 1);
+    assert(!CentralDirectory::nextExtraField(ef,
+                entry.localExtra + entry.localExtraLength, type, len, field));
+
+    assert(dir.readEntry(pos, entry));
+    assert(std::string(entry.name, entry.nameLength) == "big");
+    assert(entry.size == 0x100000000ULL);
+    assert(entry.offset == 30 + strlen("dir/file") + localExtra.size());
+    assert(entry.localExtraLength == 0);
+    assert(dir.atEnd(pos));
+
+    std::vector<zip_uint64_t> offsets;
+    assert(dir.localHeaderOffsets(offsets));
+    assert(offsets.size() == 2);
+    assert(offsets[1] == entry.offset);
+}
+
+/**
+ * Damaged central directory record should be rejected
+ */
+void damagedRecord() {
+    bytes_t zip, cd, noExtra;
+    addEntry(zip, cd, "file", noExtra, false);
+    // signature of central directory record
+    cd[0] = 0;
+    writeArchive(zip, cd, 1);
+
+    CentralDirectory dir;
+    assert(dir.open(ARCHIVE_FILE));
+    zip_uint64_t pos = 0;
+    CentralDirectory::Entry entry;
+    assert(!dir.readEntry(pos, entry));
+}
+
+/**
+ * ZIP64 end of central directory locator pointing out of file should be
+ * rejected even if offset overflows when added to record size
+ */
+void badLocatorOffset() {
+    bytes_t zip, cd, noExtra, locator;
+    addEntry(zip, cd, "file", noExtra, false);
+    putLong(locator, 0x07064b50);
+    putLong(locator, 0);
+    putLongLong(locator, 0xFFFFFFFFFFFFFFF0ULL);
+    putLong(locator, 1);
+    writeArchive(zip, cd, 1, locator);
+
+    CentralDirectory dir;
+    assert(!dir.open(ARCHIVE_FILE));
+}
+
+int main(int, char **) {
+    initTest();
+
+    readEntries();
+    damagedRecord();
+    badLocatorOffset();
+
+    unlink(ARCHIVE_FILE);
+    return EXIT_SUCCESS;
+}
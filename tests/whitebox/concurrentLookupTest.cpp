@@ -0,0 +1,91 @@
+#include "../config.h"
+
+#include <zip.h>
+#include <assert.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "vmasFSData.h"
+#include "common.h"
+#include "archiveStubs.h"
+
+// test functions
+
+const int DIR_COUNT = 50;
+const int FILE_COUNT = 20;
+const int THREAD_COUNT = 8;
+
+std::string fileName(int dir, int file) {
+    char buf[64];
+    snprintf(buf, sizeof(buf), "d%d/s%d/f%d", dir, file % 2, file);
+    return buf;
+}
+
+struct LookupState {
+    VmasFSData *data;
+    int shift;
+    std::vector<FileNode *> found;
+};
+
+/**
+ * Look up all files under shared tree lock starting from different
+ * directory in each thread
+ */
+void *lookupAll(void *arg) {
+    LookupState *state = (LookupState *)arg;
+    state->found.resize(DIR_COUNT * FILE_COUNT);
+    for (int i = 0; i < DIR_COUNT; ++i) {
+        int dir = (i + state->shift) % DIR_COUNT;
+        for (int file = 0; file < FILE_COUNT; ++file) {
+            ReadLock lock(state->data->treeLock());
+            FileNode *node = state->data->find(fileName(dir, file).c_str());
+            assert(node != NULL);
+            state->found[dir * FILE_COUNT + file] = node;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Directories materialized concurrently by readers contain each node
+ * exactly once
+ */
+void concurrentLazyLookup() {
+    struct zip z;
+    for (int dir = 0; dir < DIR_COUNT; ++dir) {
+        for (int file = 0; file < FILE_COUNT; ++file) {
+            z.names.push_back(fileName(dir, file));
+        }
+    }
+    VmasFSData zd("test.zip", &z, "/tmp");
+    zd.build_tree(false, true);
+
+    pthread_t threads[THREAD_COUNT];
+    LookupState states[THREAD_COUNT];
+    for (int i = 0; i < THREAD_COUNT; ++i) {
+        states[i].data = &zd;
+        states[i].shift = i * DIR_COUNT / THREAD_COUNT;
+        assert(pthread_create(&threads[i], NULL, lookupAll, &states[i]) == 0);
+    }
+    for (int i = 0; i < THREAD_COUNT; ++i) {
+        assert(pthread_join(threads[i], NULL) == 0);
+    }
+    for (int i = 1; i < THREAD_COUNT; ++i) {
+        assert(states[i].found == states[0].found);
+    }
+    FileNode *dir = zd.find("d0/s1");
+    assert(dir->childs.size() == FILE_COUNT / 2);
+    // directory dN, its subdirectories s0 and s1 and files
+    assert(zd.numFiles() == DIR_COUNT * (3 + FILE_COUNT));
+}
+
+int main(int, char **) {
+    initTest();
+
+    concurrentLazyLookup();
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,65 @@
+#include "../config.h"
+
+#include <zip.h>
+#include <assert.h>
+#include <stdlib.h>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "vmasFSData.h"
+#include "dirCursor.h"
+#include "common.h"
+#include "archiveStubs.h"
+
+// test functions
+
+const char *const ENTRIES[] = {"dir/a", "dir/b", "dir/c", "dir/e", NULL};
+
+/**
+ * Listing is resumed after last returned name
+ */
+void resumeByName() {
+    struct zip z;
+    initArchive(z, ENTRIES);
+    VmasFSData zd("test.zip", &z, "/tmp");
+    zd.build_tree(false);
+    FileNode *dir = zd.find("dir");
+
+    DirCursor cursor;
+    filemap_t::const_iterator i = cursor.seek(dir, 0);
+    assert(strcmp(i->first, "a") == 0);
+    cursor.returned(i->first, 3);
+    i = cursor.seek(dir, 3);
+    assert(strcmp(i->first, "b") == 0);
+    cursor.returned(i->first, 4);
+
+    // changes before position don't shift remaining entries
+    dir->detachChild(zd.find("dir/a"));
+    FileNode *node = FileNode::createFile(&z, "dir/d", 0, 0, 0644,
+            zd.arena());
+    zd.insertNode(dir, node);
+    i = cursor.seek(dir, 4);
+    assert(strcmp(i->first, "c") == 0);
+    cursor.returned(i->first, 5);
+    i = cursor.seek(dir, 5);
+    assert(i->second == node);
+    cursor.returned(i->first, 6);
+    i = cursor.seek(dir, 6);
+    assert(strcmp(i->first, "e") == 0);
+    cursor.returned(i->first, 7);
+    assert(cursor.seek(dir, 7) == dir->childs.end());
+
+    // rewind and seek to other offset
+    assert(cursor.seek(dir, 1) == dir->childs.begin());
+    i = cursor.seek(dir, 4);
+    assert(strcmp(i->first, "d") == 0);
+}
+
+int main(int, char **) {
+    initTest();
+
+    resumeByName();
+
+    return EXIT_SUCCESS;
+}
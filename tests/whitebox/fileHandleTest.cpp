@@ -0,0 +1,71 @@
+#include "../config.h"
+
+#include <assert.h>
+#include <stdlib.h>
+
+#include "fileHandle.h"
+#include "common.h"
+
+/**
+ * Read-ahead window grows while reads are sequential and is dropped on
+ * random access
+ */
+void sequentialReads() {
+    FileHandlePool pool;
+    FileHandle *h = pool.allocate(NULL, 0);
+    assert(!h->isSequential());
+    assert(h->readahead() == 0);
+
+    h->readDone(0, 4096);
+    assert(h->isSequential());
+    assert(h->readahead() == FileHandle::MIN_READAHEAD);
+    h->readDone(4096, 4096);
+    assert(h->readahead() == 2 * FileHandle::MIN_READAHEAD);
+    for (int i = 2; i < 100; ++i) {
+        h->readDone(i * 4096, 4096);
+    }
+    assert(h->readahead() == FileHandle::MAX_READAHEAD);
+
+    h->readDone(0, 4096);
+    assert(!h->isSequential());
+    assert(h->readahead() == 0);
+    h->readDone(4096, 100);
+    assert(h->isSequential());
+
+    pool.release(h);
+}
+
+/**
+ * Released handles are reused and reset
+ */
+void poolReuse() {
+    FileHandlePool pool;
+    FileHandle *h1 = pool.allocate(NULL, 1);
+    FileHandle *h2 = pool.allocate(NULL, 2);
+    assert(h1 != h2);
+    assert(h1->flags == 1 && h2->flags == 2);
+    assert(pool.used() == 2);
+    h1->readDone(0, 10);
+
+    pool.release(h1);
+    assert(pool.used() == 1);
+    FileHandle *h3 = pool.allocate(NULL, 3);
+    assert(h3 == h1);
+    assert(h3->flags == 3);
+    assert(!h3->isSequential() && h3->readahead() == 0);
+
+    // more handles than in one chunk
+    for (int i = 0; i < 1000; ++i) {
+        pool.allocate(NULL, 0);
+    }
+    assert(pool.used() == 1002);
+}
+
+int main(int, char **) {
+    initTest();
+
+    sequentialReads();
+    poolReuse();
+
+    return EXIT_SUCCESS;
+}
@@ -12,6 +12,8 @@
 #define protected public
 
 #include "fileNode.h"
+#include "bigBuffer.h"
+#include "statistics.h"
 #include "common.h"
 
 using namespace std;
@@ -55,6 +57,16 @@ int zip_file_replace(struct zip *, zip_uint64_t, struct zip_source *, zip_flags_
     return 0;
 }
 
+int zip_file_set_encryption(struct zip *, zip_uint64_t, zip_uint16_t, const char *) {
+    assert(false);
+    return 0;
+}
+
+int zip_delete(struct zip *, zip_uint64_t) {
+    assert(false);
+    return 0;
+}
+
 struct zip_source *zip_source_function(struct zip *, zip_source_callback, void *) {
     assert(false);
     return NULL;
@@ -87,58 +99,197 @@ const char *zip_strerror(struct zip *) {
 void parseNameTest () {
     auto_ptr<FileNode> n (FileNode::createRootNode());
 
-    n->full_name = "test";
-    n->parse_name ();
-    assert (n->name == n->full_name.c_str());
+    n->is_dir = false;
+    n->parse_name ("test");
+    assert (strcmp(n->name(), "test") == 0);
+    assert (!n->is_dir);
+
+    n->parse_name ("dir/test");
+    assert (strcmp(n->name(), "test") == 0);
+
+    n->parse_name ("dir/dir2/dir3/test");
+    assert (strcmp(n->name(), "test") == 0);
+    assert (!n->is_dir);
 
-    n->full_name = "dir/test";
-    n->parse_name ();
-    assert (n->name == n->full_name.c_str() + strlen("dir/"));
+    n->parse_name ("subdir/");
+    assert (strcmp(n->name(), "subdir") == 0);
+    assert (n->is_dir);
 
-    n->full_name = "dir/dir2/dir3/test";
-    n->parse_name ();
-    assert (n->name == n->full_name.c_str() + strlen("dir/dir2/dir3/"));
+    n->parse_name ("dir/subdir/");
+    assert (strcmp(n->name(), "subdir") == 0);
 
-    n->full_name = "subdir/";
-    n->parse_name ();
-    assert (n->name == n->full_name.c_str());
+    n->parse_name ("dir/dir2/dir3/subdir/");
+    assert (strcmp(n->name(), "subdir") == 0);
+}
+
+/**
+ * Test fullName()
+ */
+void fullNameTest () {
+    auto_ptr<FileNode> root (FileNode::createRootNode());
+    auto_ptr<FileNode> dir (FileNode::createIntermediateDir(NULL, "dir/"));
+    auto_ptr<FileNode> dir2 (FileNode::createIntermediateDir(NULL, "dir/dir2/"));
+    auto_ptr<FileNode> file (FileNode::createFile(NULL, "dir/dir2/file", 0, 0, 0666));
+
+    assert (root->fullName() == "");
+    // detached node
+    assert (file->fullName() == "file");
 
-    n->full_name = "dir/subdir/";
-    n->parse_name ();
-    assert (n->name == n->full_name.c_str() + strlen("dir/"));
+    dir->parent = root.get();
+    root->appendChild (dir.get());
+    dir2->parent = dir.get();
+    dir->appendChild (dir2.get());
+    file->parent = dir2.get();
+    dir2->appendChild (file.get());
+    assert (dir->fullName() == "dir");
+    assert (file->fullName() == "dir/dir2/file");
+    assert (dir->findChild("dir2") == dir2.get());
 
-    n->full_name = "dir/dir2/dir3/subdir/";
-    n->parse_name ();
-    assert (n->name == n->full_name.c_str() + strlen("dir/dir2/dir3/"));
+    // renaming directory changes names of all descendants
+    root->detachChild (dir.get());
+    dir->rename ("renamed");
+    root->appendChild (dir.get());
+    assert (file->fullName() == "renamed/dir2/file");
+    assert (root->findChild("dir") == NULL);
+    assert (root->findChild("renamed") == dir.get());
 }
 
 /**
- * Test getParentName()
+ * Nodes allocated from arena keep names and children in arena
  */
-void parentNameTest () {
-    // files
-    {
-        auto_ptr<FileNode> n (FileNode::createFile(NULL, "test", 0, 0, 0666));
-        assert (n->getParentName() == "");
-    }
-    {
-        auto_ptr<FileNode> n (FileNode::createFile(NULL, "dir/file", 0, 0, 0666));
-        assert (n->getParentName() == "dir");
-    }
-    {
-        auto_ptr<FileNode> n (FileNode::createFile(NULL, "dir/dir2/file", 0, 0, 0666));
-        assert (n->getParentName() == "dir/dir2");
-    }
-    // directories
-    {
-        auto_ptr<FileNode> n (FileNode::createIntermediateDir(NULL, "dir/subdir/"));
-        assert (n->getParentName() == "dir");
-    }
+void arenaNodesTest () {
+    NodeArena arena;
+    FileNode *dir = FileNode::createDir(NULL, "dir/", 0, 0, 0755, &arena);
+    FileNode *file = FileNode::createFile(NULL, "dir/file", 0, 0, 0644,
+            &arena);
+    assert(dir->isFromArena(&arena));
+    assert(strcmp(file->name(), "file") == 0);
+
+    dir->appendChild(file);
+    file->parent = dir;
+    dir->detachChild(file);
+    file->rename("a-much-longer-file-name");
+    dir->appendChild(file);
+    assert(dir->findChild("a-much-longer-file-name") == file);
+
+    // removed node memory is reused
+    dir->detachChild(file);
+    delete file;
+    FileNode *file2 = FileNode::createFile(NULL, "dir/file2", 0, 0, 0644,
+            &arena);
+    assert(file2 == file);
+    delete file2;
+    delete dir;
+
+    FileNode *heap = FileNode::createRootNode();
+    assert(heap->isFromArena(NULL));
+    delete heap;
+}
+
+/**
+ * Opening of archive entry does not read its data
+ */
+void lazyOpenTest () {
+    struct zip z;
+    auto_ptr<FileNode> n (FileNode::createFile(&z, "file", 0, 0, 0644));
+    // pretend node is unmodified archive entry
+    delete n->buffer;
+    n->buffer = NULL;
+    n->state = FileNode::CLOSED;
+    n->id = 0;
+    n->m_size = 100;
+
+    assert (n->open() == 0);
+    assert (n->open() == 0);
+    assert (n->isUnloaded());
+    assert (!n->isChanged());
+    assert (n->size() == 100);
+    assert (n->close() == 0);
+    assert (n->close() == 0);
+    assert (!n->isUnloaded());
+    assert (n->size() == 100);
+}
+
+/**
+ * Truncate changes size and modification time
+ */
+void truncateTest () {
+    auto_ptr<FileNode> n (FileNode::createFile(NULL, "file", 0, 0, 0644));
+    assert (n->open() == 0);
+    assert (n->write("0123456789", 10, 0) == 10);
+    n->m_mtime = 0;
+    n->metadataChanged = false;
+
+    assert (n->truncate(4) == 0);
+    assert (n->size() == 4);
+    assert (n->mtime() != 0);
+    assert (n->isMetadataChanged());
+    // write after truncation point extends file with zeros
+    assert (n->write("x", 1, 8) == 1);
+    assert (n->size() == 9);
+    char buf[9];
+    assert (n->read(buf, sizeof(buf), 0) == 9);
+    assert (memcmp(buf, "0123\0\0\0\0x", 9) == 0);
+}
+
+/**
+ * Write failed for lack of memory does not mark file as changed
+ */
+void failedWriteTest () {
+    struct zip z;
+    auto_ptr<FileNode> n (FileNode::createFile(&z, "file", 0, 0, 0644));
+    // pretend node is loaded unmodified archive entry
+    n->state = FileNode::OPENED;
+    n->open_count = 1;
+    n->id = 0;
+    n->m_mtime = 0;
+    n->metadataChanged = false;
+    Statistics::global.dirtyChanged(-1);
+    int64_t dirty = Statistics::global.dirtyNodes();
+
+    BigBuffer::maxMemory = 1;
+    assert (n->write("0123456789", 10, 0) == -ENOMEM);
+    BigBuffer::maxMemory = 0;
+    assert (!n->isChanged());
+    assert (!n->isMetadataChanged());
+    assert (n->mtime() == 0);
+    assert (Statistics::global.dirtyNodes() == dirty);
+
+    assert (n->write("0123456789", 10, 0) == 10);
+    assert (n->isChanged());
+    assert (Statistics::global.dirtyNodes() == dirty + 1);
+}
+
+/**
+ * Encryption state of entry is kept in node and in its record
+ */
+void encryptedRecordTest () {
+    struct zip z;
+    EntryRecord rec;
+    memset(&rec, 0, sizeof(rec));
+    rec.mode = S_IFREG | 0644;
+    rec.flags = EntryRecord::ENCRYPTED;
+    auto_ptr<FileNode> n (FileNode::createNodeFromRecord(&z, "file", rec));
+    assert (n->isEncrypted());
+    EntryRecord filled;
+    n->fillRecord(filled);
+    assert (filled.flags & EntryRecord::ENCRYPTED);
+
+    rec.flags = 0;
+    auto_ptr<FileNode> plain (FileNode::createNodeFromRecord(&z, "plain", rec));
+    assert (!plain->isEncrypted());
+    auto_ptr<FileNode> created (FileNode::createFile(&z, "new", 0, 0, 0644));
+    assert (!created->isEncrypted());
 }
 
 int main(int, char **) {
     parseNameTest ();
-    parentNameTest ();
+    fullNameTest ();
+    arenaNodesTest ();
+    lazyOpenTest ();
+    truncateTest ();
+    failedWriteTest ();
+    encryptedRecordTest ();
 
     return EXIT_SUCCESS;
 }
@@ -0,0 +1,186 @@
+#include "../config.h"
+
+#include <zip.h>
+#include <assert.h>
+#include <stdlib.h>
+#include <cerrno>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "vmasFSData.h"
+#include "common.h"
+#include "archiveStubs.h"
+
+// test functions
+
+const char *const ENTRIES[] = {"dir/", "dir/file", "other/sub/file2", "top",
+    NULL};
+
+void collectInodes(const FileNode *node, std::set<zip_uint64_t> &inodes) {
+    assert(node->ino != 0);
+    assert(inodes.insert(node->ino).second);
+    for (filemap_t::const_iterator i = node->childs.begin();
+            i != node->childs.end(); ++i) {
+        collectInodes(i->second, inodes);
+    }
+}
+
+/**
+ * All nodes including intermediate directories have unique inodes,
+ * inodes of ZIP entries are derived from entry indices
+ */
+void uniqueInodes() {
+    struct zip z;
+    initArchive(z, ENTRIES);
+    VmasFSData zd("test.zip", &z, "/tmp");
+    zd.build_tree(false);
+
+    std::set<zip_uint64_t> inodes;
+    collectInodes(zd.find(""), inodes);
+    assert(inodes.size() == 7);
+    assert(zd.find("")->ino == VmasFSData::ROOT_INO);
+    assert(zd.find("dir/file")->ino == VmasFSData::FIRST_ENTRY_INO + 1);
+    assert(zd.find("other")->ino >= VmasFSData::FIRST_ENTRY_INO + z.names.size());
+}
+
+/**
+ * Inode is not changed on rename, new nodes get fresh inodes
+ */
+void stableInodes() {
+    struct zip z;
+    initArchive(z, ENTRIES);
+    VmasFSData zd("test.zip", &z, "/tmp");
+    zd.build_tree(false);
+
+    FileNode *file = zd.find("dir/file");
+    zip_uint64_t ino = file->ino;
+    FileNode *parent;
+    assert(zd.findParent("other/moved", parent) == 0);
+    zd.renameNode(file, parent, "moved");
+    assert(zd.find("other/moved") == file);
+    assert(file->ino == ino);
+
+    FileNode *created = FileNode::createFile(&z, "dir/new", 0, 0, 0644,
+            zd.arena());
+    assert(zd.findParent("dir/new", parent) == 0);
+    zd.insertNode(parent, created);
+    std::set<zip_uint64_t> inodes;
+    collectInodes(zd.find(""), inodes);
+    assert(inodes.size() == 8);
+}
+
+/**
+ * Inodes of ZIP entries don't depend on materialization order
+ */
+void lazyInodes() {
+    struct zip z;
+    initArchive(z, ENTRIES);
+    VmasFSData zd("test.zip", &z, "/tmp");
+    zd.build_tree(false, true);
+
+    assert(zd.find("top")->ino == VmasFSData::FIRST_ENTRY_INO + 3);
+    assert(zd.find("dir/file")->ino == VmasFSData::FIRST_ENTRY_INO + 1);
+}
+
+/**
+ * Lazy mode counts files not yet materialized, so file count is the same
+ * as in eager mode and follows created and removed files
+ */
+void lazyFileCount() {
+    struct zip z;
+    initArchive(z, ENTRIES);
+    VmasFSData eager("test.zip", &z, "/tmp");
+    eager.build_tree(false);
+    assert(eager.numFiles() == 6);
+
+    VmasFSData zd("test.zip", &z, "/tmp");
+    zd.build_tree(false, true);
+    assert(zd.numFiles() == 6);
+    zd.find("other/sub/file2");
+    assert(zd.numFiles() == 6);
+
+    FileNode *created = FileNode::createFile(&z, "new", 0, 0, 0644,
+            zd.arena());
+    FileNode *parent;
+    assert(zd.findParent("new", parent) == 0);
+    zd.insertNode(parent, created);
+    assert(zd.numFiles() == 7);
+    zd.removeNode(created);
+    assert(zd.numFiles() == 6);
+}
+
+/**
+ * File used as parent directory is rejected in lazy mode as in eager mode
+ */
+void fileAsParent(bool lazy) {
+    struct zip z;
+    z.names.push_back("file");
+    z.names.push_back("file/child");
+    VmasFSData zd("test.zip", &z, "/tmp");
+    bool thrown = false;
+    try {
+        zd.build_tree(false, lazy);
+    }
+    catch (const std::runtime_error &e) {
+        thrown = true;
+        assert(strcmp(e.what(), "bad archive structure") == 0);
+    }
+    assert(thrown);
+}
+
+/**
+ * Missing parent and parent that is not a directory are distinguished
+ */
+void parentErrors() {
+    struct zip z;
+    initArchive(z, ENTRIES);
+    VmasFSData zd("test.zip", &z, "/tmp");
+    zd.build_tree(false, true);
+
+    FileNode *parent = NULL;
+    assert(zd.findParent("missing/new", parent) == -ENOENT);
+    assert(zd.findParent("top/new", parent) == -ENOTDIR);
+    assert(zd.findParent("top/sub/new", parent) == -ENOTDIR);
+    assert(parent == NULL);
+    assert(zd.findParent("other/sub/new", parent) == 0);
+    assert(parent == zd.find("other/sub"));
+}
+
+/**
+ * Attributes of directory don't materialize it in lazy mode
+ */
+void lazyDirAttr() {
+    struct zip z;
+    initArchive(z, ENTRIES);
+    VmasFSData zd("test.zip", &z, "/tmp");
+    zd.build_tree(false, true);
+
+    FileNode *dir = zd.find("other");
+    struct stat st;
+    zd.getAttr(dir, &st);
+    assert(S_ISDIR(st.st_mode));
+    assert(st.st_nlink == 1);
+    zd.getAttr(dir, &st);
+    assert(st.st_nlink == 1);
+
+    zd.loadChilds(dir);
+    zd.getAttr(dir, &st);
+    assert(st.st_nlink == 3);
+}
+
+int main(int, char **) {
+    initTest();
+
+    uniqueInodes();
+    stableInodes();
+    lazyInodes();
+    lazyFileCount();
+    fileAsParent(false);
+    fileAsParent(true);
+    parentErrors();
+    lazyDirAttr();
+
+    return EXIT_SUCCESS;
+}
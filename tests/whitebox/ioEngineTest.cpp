@@ -0,0 +1,90 @@
+#include "../config.h"
+
+#include <assert.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstdio>
+#include <vector>
+
+#include "ioEngine.h"
+#include "common.h"
+
+static const size_t FILE_SIZE = 5 * IOEngine::CHUNK_SIZE + 1000;
+
+/**
+ * Create temporary file with known content
+ */
+void createFile(char *name) {
+    int fd = mkstemp(name);
+    assert(fd != -1);
+    std::vector<char> data(FILE_SIZE);
+    for (size_t i = 0; i < FILE_SIZE; ++i) {
+        data[i] = (char)(i % 251);
+    }
+    assert(write(fd, &data[0], FILE_SIZE) == (ssize_t)FILE_SIZE);
+    close(fd);
+}
+
+/**
+ * Read range of file and check content
+ */
+void checkRead(IOEngine &io, size_t size, off_t offset, size_t expected) {
+    std::vector<char> buf(size + 1);
+    assert(io.read(&buf[0], size, offset) == (int)expected);
+    for (size_t i = 0; i < expected; ++i) {
+        assert(buf[i] == (char)((offset + i) % 251));
+    }
+}
+
+/**
+ * Big reads are split into chunks, reads after end of file are short
+ */
+void parallelReads() {
+    char name[] = "/tmp/ioEngineTest.XXXXXX";
+    createFile(name);
+    IOEngine io;
+    assert(io.open(name));
+    unlink(name);
+    io.start(4);
+
+    checkRead(io, 100, 10, 100);
+    checkRead(io, FILE_SIZE, 0, FILE_SIZE);
+    checkRead(io, 3 * IOEngine::CHUNK_SIZE, 12345, 3 * IOEngine::CHUNK_SIZE);
+    // tail of file is in the last chunk
+    checkRead(io, 2 * IOEngine::CHUNK_SIZE, FILE_SIZE - 100, 100);
+    checkRead(io, 100, FILE_SIZE + 10, 0);
+
+    IOEngine::Stats st = io.stats();
+    assert(st.reads == 5);
+    assert(st.requests == 1 + 6 + 3 + 2 + 1);
+    assert(st.bytes == 100 + FILE_SIZE + 3 * IOEngine::CHUNK_SIZE + 100);
+    assert(st.errors == 0);
+    assert(st.maxInFlight >= 1 && st.maxInFlight <= 4);
+    io.stop();
+    assert(!io.isOpen());
+}
+
+/**
+ * Without threads requests are executed by caller
+ */
+void noThreads() {
+    char name[] = "/tmp/ioEngineTest.XXXXXX";
+    createFile(name);
+    IOEngine io;
+    assert(!io.open("/nonexistent/file"));
+    assert(io.open(name));
+    unlink(name);
+
+    checkRead(io, FILE_SIZE, 0, FILE_SIZE);
+    assert(io.stats().requests == 1);
+}
+
+int main(int, char **) {
+    initTest();
+
+    parallelReads();
+    noThreads();
+
+    return EXIT_SUCCESS;
+}
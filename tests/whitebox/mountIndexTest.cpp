@@ -0,0 +1,117 @@
+#include "../config.h"
+
+#include <zip.h>
+#include <assert.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "mountIndex.h"
+#include "common.h"
+
+const char *INDEX_FILE = "mountIndexTest.vmidx";
+
+MountIndex::Key makeTestKey(zip_uint64_t hash) {
+    MountIndex::Key key;
+    memset(&key, 0, sizeof(key));
+    key.archiveSize = 12345;
+    key.archiveMTime = 1000000;
+    key.cdHash = hash;
+    key.flags = MountIndex::READONLY;
+    return key;
+}
+
+void addRecord(std::vector<EntryRecord> &records, std::vector<char> &names,
+        const char *name, zip_int64_t id, bool isDir) {
+    EntryRecord rec;
+    memset(&rec, 0, sizeof(rec));
+    rec.id = id;
+    rec.size = id * 100;
+    rec.offset = id * 1000;
+    rec.mtime = rec.atime = rec.ctime = 1000 + id;
+    rec.mode = isDir ? (S_IFDIR | 0755) : (S_IFREG | 0644);
+    rec.flags = isDir ? EntryRecord::IS_DIR : 0;
+    rec.nameOffset = names.size();
+    names.insert(names.end(), name, name + strlen(name) + 1);
+    records.push_back(rec);
+}
+
+/**
+ * Saved index should be loaded with the same key
+ */
+void saveLoad() {
+    std::vector<EntryRecord> records;
+    std::vector<char> names;
+    addRecord(records, names, "dir", 1, true);
+    addRecord(records, names, "dir/file", 0, false);
+    addRecord(records, names, "file", 2, false);
+
+    assert(MountIndex::save(INDEX_FILE, makeTestKey(42), records, names));
+
+    MountIndex idx;
+    assert(idx.load(INDEX_FILE, makeTestKey(42)));
+    assert(idx.count() == 3);
+    assert(strcmp(idx.name(idx.record(0)), "dir") == 0);
+    assert(strcmp(idx.name(idx.record(1)), "dir/file") == 0);
+    assert(strcmp(idx.name(idx.record(2)), "file") == 0);
+    assert(idx.record(0).flags & EntryRecord::IS_DIR);
+    assert(idx.record(1).id == 0);
+    assert(idx.record(1).offset == 0);
+    assert(idx.record(2).size == 200);
+    assert(idx.record(2).mtime == 1002);
+}
+
+/**
+ * Index of changed archive should be rejected
+ */
+void staleKey() {
+    std::vector<EntryRecord> records;
+    std::vector<char> names;
+    addRecord(records, names, "file", 0, false);
+
+    assert(MountIndex::save(INDEX_FILE, makeTestKey(42), records, names));
+
+    MountIndex idx;
+    assert(!idx.load(INDEX_FILE, makeTestKey(43)));
+}
+
+/**
+ * Truncated index should be rejected
+ */
+void damagedFile() {
+    std::vector<EntryRecord> records;
+    std::vector<char> names;
+    addRecord(records, names, "file", 0, false);
+
+    assert(MountIndex::save(INDEX_FILE, makeTestKey(42), records, names));
+    assert(truncate(INDEX_FILE, 100) == 0);
+
+    MountIndex idx;
+    assert(!idx.load(INDEX_FILE, makeTestKey(42)));
+}
+
+/**
+ * Index is placed next to archive or in cache directory
+ */
+void indexPath() {
+    assert(MountIndex::path("dir/archive.zip", "") == "dir/archive.zip.vmidx");
+    std::string p = MountIndex::path("archive.zip", "/var/cache");
+    assert(p.compare(0, strlen("/var/cache/archive.zip-"), "/var/cache/archive.zip-") == 0);
+    assert(p.compare(p.size() - strlen(".vmidx"), strlen(".vmidx"), ".vmidx") == 0);
+}
+
+int main(int, char **) {
+    initTest();
+
+    saveLoad();
+    staleKey();
+    damagedFile();
+    indexPath();
+
+    unlink(INDEX_FILE);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,56 @@
+#include "../config.h"
+
+#include <assert.h>
+#include <stdlib.h>
+#include <map>
+
+#include "nodeArena.h"
+#include "common.h"
+
+/**
+ * Released chunks are reused for allocations of the same size
+ */
+void reuseChunks() {
+    NodeArena arena;
+    void *p1 = arena.allocate(40);
+    void *p2 = arena.allocate(40);
+    assert(p1 != p2);
+    assert(((size_t)p1 & 15) == 0 && ((size_t)p2 & 15) == 0);
+    size_t blocks = arena.blocksSize();
+
+    arena.release(p1, 40);
+    assert(arena.allocate(100) != p1);
+    assert(arena.allocate(40) == p1);
+    assert(arena.blocksSize() == blocks);
+
+    // big chunks get their own block
+    arena.allocate(4 * 1024 * 1024);
+    assert(arena.blocksSize() > blocks);
+}
+
+/**
+ * Map nodes are taken from arena
+ */
+void mapAllocator() {
+    NodeArena arena;
+    typedef std::map<int, int, std::less<int>,
+            ArenaAllocator<std::pair<const int, int> > > map_t;
+    map_t::allocator_type alloc(&arena);
+    map_t m(map_t::key_compare(), alloc);
+    for (int i = 0; i < 1000; ++i) {
+        m[i] = i;
+    }
+    assert(arena.blocksSize() > 0);
+    m.erase(10);
+    m[2000] = 2000;
+    assert(m.size() == 1000);
+}
+
+int main(int, char **) {
+    initTest();
+
+    reuseChunks();
+    mapAllocator();
+
+    return EXIT_SUCCESS;
+}
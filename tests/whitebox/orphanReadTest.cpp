@@ -0,0 +1,334 @@
+#include "../config.h"
+
+#include <fuse_lowlevel.h>
+#include <zip.h>
+#include <assert.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <cerrno>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "vmasFSData.h"
+#include "vmas-fs-ll.h"
+#include "common.h"
+
+// libzip stub structures
+
+/**
+ * Archive of compressed files with data "data of <name>". Deleted entries
+ * can not be opened, like in libzip.
+ */
+struct zip {
+    std::vector<std::string> names;
+    std::vector<bool> deleted;
+    int deletes;
+};
+struct zip_file {
+    std::string data;
+    size_t pos;
+};
+struct zip_source {};
+
+static std::string entryData(const std::string &name) {
+    return "data of " + name;
+}
+
+// FUSE stub structures
+
+struct fuse_req {
+    VmasFSData *data;
+    int err;
+    std::string buf;
+    struct fuse_entry_param entry;
+    struct fuse_file_info fi;
+};
+
+// libzip stub functions
+
+zip_int64_t zip_get_num_entries(struct zip *z, zip_flags_t) {
+    return z->names.size();
+}
+
+const char *zip_get_name(struct zip *z, zip_uint64_t index, zip_flags_t) {
+    return z->names[index].c_str();
+}
+
+int zip_stat_index(struct zip *z, zip_uint64_t index, zip_flags_t,
+        struct zip_stat *zs) {
+    zs->valid = ZIP_STAT_NAME | ZIP_STAT_INDEX | ZIP_STAT_SIZE |
+        ZIP_STAT_COMP_SIZE | ZIP_STAT_MTIME | ZIP_STAT_CRC |
+        ZIP_STAT_COMP_METHOD | ZIP_STAT_ENCRYPTION_METHOD | ZIP_STAT_FLAGS;
+    zs->name = z->names[index].c_str();
+    zs->index = index;
+    zs->size = entryData(z->names[index]).size();
+    zs->comp_size = zs->size / 2;
+    zs->mtime = 0;
+    zs->crc = 0;
+    zs->comp_method = ZIP_CM_DEFLATE;
+    zs->encryption_method = ZIP_EM_NONE;
+    zs->flags = 0;
+    return 0;
+}
+
+struct zip_file *zip_fopen_index(struct zip *z, zip_uint64_t index,
+        zip_flags_t) {
+    if (z->deleted[index]) {
+        // ZIP_ER_CHANGED
+        return NULL;
+    }
+    struct zip_file *zf = new zip_file;
+    zf->data = entryData(z->names[index]);
+    zf->pos = 0;
+    return zf;
+}
+
+zip_int64_t zip_fread(struct zip_file *zf, void *buf, zip_uint64_t size) {
+    if (size > zf->data.size() - zf->pos) {
+        size = zf->data.size() - zf->pos;
+    }
+    memcpy(buf, zf->data.data() + zf->pos, size);
+    zf->pos += size;
+    return size;
+}
+
+int zip_fclose(struct zip_file *zf) {
+    delete zf;
+    return 0;
+}
+
+int zip_delete(struct zip *z, zip_uint64_t index) {
+    z->deleted[index] = true;
+    ++z->deletes;
+    return 0;
+}
+
+int zip_file_rename(struct zip *z, zip_uint64_t index, const char *name,
+        zip_flags_t) {
+    z->names[index] = name;
+    return 0;
+}
+
+const char *zip_strerror(struct zip *) {
+    return "entry has been changed";
+}
+
+int zip_close(struct zip *) {
+    return 0;
+}
+
+// only stubs
+
+zip_int64_t zip_file_add(struct zip *, const char *, struct zip_source *, zip_flags_t) {
+    assert(false);
+    return 0;
+}
+
+zip_int64_t zip_dir_add(struct zip *, const char *, zip_flags_t) {
+    assert(false);
+    return 0;
+}
+
+int zip_file_replace(struct zip *, zip_uint64_t, struct zip_source *, zip_flags_t) {
+    assert(false);
+    return 0;
+}
+
+int zip_file_set_encryption(struct zip *, zip_uint64_t, zip_uint16_t, const char *) {
+    assert(false);
+    return 0;
+}
+
+int zip_register_progress_callback_with_state(struct zip *, double,
+        zip_progress_callback, void (*)(void *), void *) {
+    assert(false);
+    return 0;
+}
+
+void zip_source_free(struct zip_source *) {
+    assert(false);
+}
+
+struct zip_source *zip_source_function(struct zip *, zip_source_callback, void *) {
+    assert(false);
+    return NULL;
+}
+
+const char *zip_file_strerror(struct zip_file *) {
+    assert(false);
+    return NULL;
+}
+
+struct zip *zip_open(const char *, int, int *) {
+    assert(false);
+    return NULL;
+}
+
+void zip_discard(struct zip *) {
+    assert(false);
+}
+
+int zip_error_to_str(char *, zip_uint64_t, int, int) {
+    assert(false);
+    return 0;
+}
+
+// FUSE stub functions
+
+void *fuse_req_userdata(fuse_req_t req) {
+    return req->data;
+}
+
+int fuse_reply_err(fuse_req_t req, int err) {
+    req->err = err;
+    return 0;
+}
+
+int fuse_reply_entry(fuse_req_t req, const struct fuse_entry_param *e) {
+    req->err = 0;
+    req->entry = *e;
+    return 0;
+}
+
+int fuse_reply_open(fuse_req_t req, const struct fuse_file_info *fi) {
+    req->err = 0;
+    req->fi = *fi;
+    return 0;
+}
+
+int fuse_reply_buf(fuse_req_t req, const char *buf, size_t size) {
+    req->err = 0;
+    req->buf.assign(buf, size);
+    return 0;
+}
+
+void fuse_reply_none(fuse_req_t req) {
+    req->err = 0;
+}
+
+// only stubs
+
+int fuse_reply_attr(fuse_req_t, const struct stat *, double) {
+    assert(false);
+    return 0;
+}
+
+int fuse_reply_create(fuse_req_t, const struct fuse_entry_param *,
+        const struct fuse_file_info *) {
+    assert(false);
+    return 0;
+}
+
+int fuse_reply_readlink(fuse_req_t, const char *) {
+    assert(false);
+    return 0;
+}
+
+int fuse_reply_write(fuse_req_t, size_t) {
+    assert(false);
+    return 0;
+}
+
+int fuse_reply_statfs(fuse_req_t, const struct statvfs *) {
+    assert(false);
+    return 0;
+}
+
+size_t fuse_add_direntry(fuse_req_t, char *, size_t, const char *,
+        const struct stat *, off_t) {
+    assert(false);
+    return 0;
+}
+
+#if FUSE_USE_VERSION >= 30
+size_t fuse_add_direntry_plus(fuse_req_t, char *, size_t, const char *,
+        const struct fuse_entry_param *, off_t) {
+    assert(false);
+    return 0;
+}
+#endif
+
+const struct fuse_ctx *fuse_req_ctx(fuse_req_t) {
+    assert(false);
+    return NULL;
+}
+
+// test functions
+
+/**
+ * Make request to file system
+ */
+static void initRequest(struct fuse_req &req, VmasFSData *data) {
+    req.data = data;
+    req.err = -1;
+    req.buf.clear();
+    memset(&req.fi, 0, sizeof(req.fi));
+}
+
+/**
+ * Data of file opened before unlink (or rename over it) is read after
+ * unlink, entry is deleted from archive on save
+ */
+void readAfterUnlink(bool rename) {
+    const char *const ENTRIES[] = {"file", "other", NULL};
+    struct zip z;
+    for (const char *const *name = ENTRIES; *name != NULL; ++name) {
+        z.names.push_back(*name);
+        z.deleted.push_back(false);
+    }
+    z.deletes = 0;
+    VmasFSData data("test.zip", &z, "/tmp");
+    data.build_tree(false);
+
+    struct fuse_req req;
+    initRequest(req, &data);
+    vmasfs_ll_lookup(&req, FUSE_ROOT_ID, "file");
+    assert(req.err == 0);
+    fuse_ino_t ino = req.entry.ino;
+
+    initRequest(req, &data);
+    req.fi.flags = O_RDONLY;
+    vmasfs_ll_open(&req, ino, &req.fi);
+    assert(req.err == 0);
+    struct fuse_file_info fi = req.fi;
+
+    initRequest(req, &data);
+    if (rename) {
+        vmasfs_ll_rename(&req, FUSE_ROOT_ID, "other", FUSE_ROOT_ID, "file"
+#if FUSE_USE_VERSION >= 30
+                , 0
+#endif
+                );
+    } else {
+        vmasfs_ll_unlink(&req, FUSE_ROOT_ID, "file");
+    }
+    assert(req.err == 0);
+    assert(z.deletes == 0);
+
+    initRequest(req, &data);
+    vmasfs_ll_read(&req, ino, 100, 0, &fi);
+    assert(req.err == 0);
+    assert(req.buf == "data of file");
+
+    initRequest(req, &data);
+    vmasfs_ll_release(&req, ino, &fi);
+    assert(req.err == 0);
+    vmasfs_ll_forget(&req, ino, 1);
+
+    data.save();
+    assert(z.deletes == 1);
+    assert(z.deleted[0] && !z.deleted[1]);
+    if (rename) {
+        assert(z.names[1] == "file");
+    }
+}
+
+int main(int, char **) {
+    initTest();
+
+    readAfterUnlink(false);
+    readAfterUnlink(true);
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,221 @@
+#include "../config.h"
+
+#include <zip.h>
+#include <assert.h>
+#include <stdlib.h>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "bigBuffer.h"
+#include "vmasFSData.h"
+#include "common.h"
+
+static const char *const PASSWORD = "secret";
+
+// libzip stub structures
+
+struct entry {
+    const char *name;
+    zip_uint64_t compSize;
+    bool encrypted;
+};
+
+/**
+ * Archive of empty entries, encrypted entries can be opened only with
+ * PASSWORD
+ */
+struct zip {
+    std::vector<entry> entries;
+    zip_int64_t opened;
+};
+struct zip_file {};
+struct zip_source {};
+
+static struct zip_file openedFile;
+
+// libzip stub functions
+
+zip_int64_t zip_get_num_entries(struct zip *z, zip_flags_t) {
+    return z->entries.size();
+}
+
+const char *zip_get_name(struct zip *z, zip_uint64_t index, zip_flags_t) {
+    return z->entries[index].name;
+}
+
+int zip_stat_index(struct zip *z, zip_uint64_t index, zip_flags_t,
+        struct zip_stat *zs) {
+    zs->valid = ZIP_STAT_NAME | ZIP_STAT_INDEX | ZIP_STAT_SIZE |
+        ZIP_STAT_COMP_SIZE | ZIP_STAT_MTIME | ZIP_STAT_CRC |
+        ZIP_STAT_COMP_METHOD | ZIP_STAT_ENCRYPTION_METHOD | ZIP_STAT_FLAGS;
+    zs->name = z->entries[index].name;
+    zs->index = index;
+    zs->size = 0;
+    zs->comp_size = z->entries[index].compSize;
+    zs->mtime = 0;
+    zs->crc = 0;
+    zs->comp_method = ZIP_CM_STORE;
+    zs->encryption_method = z->entries[index].encrypted ?
+        ZIP_EM_AES_256 : ZIP_EM_NONE;
+    zs->flags = 0;
+    return 0;
+}
+
+struct zip_file *zip_fopen_index_encrypted(struct zip *z, zip_uint64_t index,
+        zip_flags_t, const char *password) {
+    z->opened = index;
+    if (strcmp(password, PASSWORD) != 0) {
+        // ZIP_ER_WRONGPASSWD
+        return NULL;
+    }
+    return &openedFile;
+}
+
+int zip_fclose(struct zip_file *zf) {
+    assert(zf == &openedFile);
+    return 0;
+}
+
+int zip_close(struct zip *) {
+    return 0;
+}
+
+// only stubs
+
+struct zip *zip_open(const char *, int, int *) {
+    assert(false);
+    return NULL;
+}
+
+void zip_discard(struct zip *) {
+    assert(false);
+}
+
+int zip_error_to_str(char *, zip_uint64_t, int, int) {
+    assert(false);
+    return 0;
+}
+
+zip_int64_t zip_file_add(struct zip *, const char *, struct zip_source *, zip_flags_t) {
+    assert(false);
+    return 0;
+}
+
+zip_int64_t zip_dir_add(struct zip *, const char *, zip_flags_t) {
+    assert(false);
+    return 0;
+}
+
+int zip_delete(struct zip *, zip_uint64_t) {
+    assert(false);
+    return 0;
+}
+
+struct zip_file *zip_fopen_index(struct zip *, zip_uint64_t, zip_flags_t) {
+    assert(false);
+    return NULL;
+}
+
+zip_int64_t zip_fread(struct zip_file *, void *, zip_uint64_t) {
+    assert(false);
+    return 0;
+}
+
+int zip_file_rename(struct zip *, zip_uint64_t, const char *, zip_flags_t) {
+    assert(false);
+    return 0;
+}
+
+int zip_file_replace(struct zip *, zip_uint64_t, struct zip_source *, zip_flags_t) {
+    assert(false);
+    return 0;
+}
+
+int zip_file_set_encryption(struct zip *, zip_uint64_t, zip_uint16_t, const char *) {
+    assert(false);
+    return 0;
+}
+
+int zip_register_progress_callback_with_state(struct zip *, double,
+        zip_progress_callback, void (*)(void *), void *) {
+    assert(false);
+    return 0;
+}
+
+void zip_source_free(struct zip_source *) {
+    assert(false);
+}
+
+struct zip_source *zip_source_function(struct zip *, zip_source_callback, void *) {
+    assert(false);
+    return NULL;
+}
+
+const char *zip_strerror(struct zip *) {
+    assert(false);
+    return NULL;
+}
+
+const char *zip_file_strerror(struct zip_file *) {
+    assert(false);
+    return NULL;
+}
+
+// test functions
+
+void initArchive(struct zip &z, bool encrypted) {
+    const entry ENTRIES[] = {
+        {"big", 100, encrypted},
+        {"plain", 1, false},
+        {"small", 10, encrypted},
+        {"dir/", 0, false}
+    };
+    z.entries.assign(ENTRIES, ENTRIES + sizeof(ENTRIES) / sizeof(ENTRIES[0]));
+    z.opened = -1;
+    BigBuffer::passwd = NULL;
+}
+
+/**
+ * Password can not be checked without encrypted entries, it is used
+ * as is
+ */
+void unverifiedPasswd() {
+    struct zip z;
+    initArchive(z, false);
+    VmasFSData zd("test.zip", &z, "/tmp");
+
+    assert(!zd.hasEncryptedEntries());
+    assert(zd.try_passwd("typo"));
+    assert(z.opened == -1);
+    assert(strcmp(BigBuffer::passwd, "typo") == 0);
+}
+
+/**
+ * Password is checked against the smallest encrypted entry and used only
+ * if it is correct
+ */
+void verifiedPasswd() {
+    struct zip z;
+    initArchive(z, true);
+    VmasFSData zd("test.zip", &z, "/tmp");
+
+    assert(zd.hasEncryptedEntries());
+    assert(!zd.try_passwd("typo"));
+    assert(z.opened == 2);
+    assert(BigBuffer::passwd == NULL);
+
+    z.opened = -1;
+    assert(zd.try_passwd(PASSWORD));
+    assert(z.opened == 2);
+    assert(strcmp(BigBuffer::passwd, PASSWORD) == 0);
+}
+
+int main(int, char **) {
+    initTest();
+
+    unverifiedPasswd();
+    verifiedPasswd();
+
+    return EXIT_SUCCESS;
+}
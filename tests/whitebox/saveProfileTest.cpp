@@ -0,0 +1,113 @@
+#include "../config.h"
+
+#include <zip.h>
+#include <assert.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+#include "saveProfile.h"
+#include "common.h"
+
+const char *ARCHIVE_FILE = "saveProfileTest.zip";
+
+typedef std::vector<zip_uint8_t> bytes_t;
+
+void putShort(bytes_t &b, zip_uint16_t v) {
+    b.push_back(v & 0xFF);
+    b.push_back(v >> 8);
+}
+
+void putLong(bytes_t &b, zip_uint32_t v) {
+    putShort(b, v & 0xFFFF);
+    putShort(b, v >> 16);
+}
+
+/**
+ * Write archive with one empty entry 'name' declared to have compressed
+ * size 'compSize' in central directory
+ */
+void writeArchive(const char *name, zip_uint32_t compSize) {
+    bytes_t zip;
+    putLong(zip, 0x04034b50);
+    for (int i = 0; i < 5; ++i) {
+        putShort(zip, 0);
+    }
+    for (int i = 0; i < 3; ++i) {
+        putLong(zip, 0);
+    }
+    putShort(zip, strlen(name));
+    putShort(zip, 0);
+    zip.insert(zip.end(), name, name + strlen(name));
+
+    zip_uint32_t cdOffset = zip.size();
+    putLong(zip, 0x02014b50);
+    putShort(zip, 20);
+    putShort(zip, 20);
+    for (int i = 0; i < 4; ++i) {
+        putShort(zip, 0);
+    }
+    putLong(zip, 0);
+    putLong(zip, compSize);
+    putLong(zip, 100);
+    putShort(zip, strlen(name));
+    for (int i = 0; i < 4; ++i) {
+        putShort(zip, 0);
+    }
+    putLong(zip, 0);
+    putLong(zip, 0);
+    zip.insert(zip.end(), name, name + strlen(name));
+    zip_uint32_t cdSize = zip.size() - cdOffset;
+
+    putLong(zip, 0x06054b50);
+    putShort(zip, 0);
+    putShort(zip, 0);
+    putShort(zip, 1);
+    putShort(zip, 1);
+    putLong(zip, cdSize);
+    putLong(zip, cdOffset);
+    putShort(zip, 0);
+
+    FILE *f = fopen(ARCHIVE_FILE, "wb");
+    assert(f != NULL);
+    assert(fwrite(&zip[0], 1, zip.size(), f) == zip.size());
+    fclose(f);
+}
+
+/**
+ * Compressed sizes are taken from central directory, report puts the
+ * slowest entries first
+ */
+void profile() {
+    SaveProfile profile;
+    profile.entrySaved("fast", 10, 1000);
+    profile.entrySaved("dir/slow", 100, 5000000);
+    profile.entrySaved("medium", 50, 20000);
+
+    writeArchive("dir/slow", 42);
+    CentralDirectory cd;
+    assert(cd.open(ARCHIVE_FILE));
+    profile.readSizes(cd);
+    unlink(ARCHIVE_FILE);
+
+    const std::vector<SaveProfile::Entry> &entries = profile.entries();
+    assert(entries.size() == 3);
+    assert(entries[0].bytesOut == 0);
+    assert(entries[1].bytesOut == 42);
+
+    profile.report(10000000, 2);
+    assert(entries[0].name == "dir/slow");
+    assert(entries[0].bytesIn == 100);
+    assert(entries[1].name == "medium");
+    assert(entries[2].name == "fast");
+}
+
+int main(int, char **) {
+    initTest();
+
+    profile();
+
+    return EXIT_SUCCESS;
+}
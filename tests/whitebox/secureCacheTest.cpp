@@ -0,0 +1,87 @@
+#include "../config.h"
+
+#include <assert.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <cstring>
+#include <vector>
+
+#include "secureCache.h"
+#include "common.h"
+
+static size_t pageSize;
+
+/**
+ * Check that block is cached with expected content
+ */
+void checkCached(SecureCache &cache, uint64_t key, size_t size, char fill) {
+    std::vector<char> buf(size);
+    assert(cache.get(key, &buf[0], size));
+    for (size_t i = 0; i < size; ++i) {
+        assert(buf[i] == fill);
+    }
+}
+
+void put(SecureCache &cache, uint64_t key, size_t size, char fill) {
+    std::vector<char> data(size, fill);
+    cache.put(key, &data[0], size);
+}
+
+/**
+ * Least recently used blocks are evicted, big blocks are not cached
+ */
+void eviction() {
+    SecureCache cache;
+    std::vector<char> buf(pageSize);
+    assert(!cache.isEnabled());
+    put(cache, 1, 100, 'a');
+    assert(!cache.get(1, &buf[0], 100));
+
+    // every block takes at least one page
+    cache.setLimits(3 * pageSize, pageSize);
+    assert(cache.isEnabled());
+    put(cache, 1, 100, 'a');
+    put(cache, 2, pageSize, 'b');
+    put(cache, 3, 1, 'c');
+    put(cache, 4, pageSize + 1, 'd');
+    assert(!cache.get(4, &buf[0], pageSize));
+    checkCached(cache, 1, 100, 'a');
+    // size must match
+    assert(!cache.get(1, &buf[0], 99));
+
+    // 2 is the least recently used one
+    put(cache, 5, 10, 'e');
+    assert(!cache.get(2, &buf[0], pageSize));
+    checkCached(cache, 1, 100, 'a');
+    checkCached(cache, 3, 1, 'c');
+    checkCached(cache, 5, 10, 'e');
+
+    uint64_t hits, misses;
+    cache.stats(hits, misses);
+    assert(hits == 4);
+    assert(misses == 4);
+
+    // shrinking limits evicts blocks
+    cache.setLimits(pageSize, pageSize);
+    checkCached(cache, 5, 10, 'e');
+    assert(!cache.get(1, &buf[0], 100));
+
+    cache.clear();
+    assert(!cache.get(5, &buf[0], 10));
+}
+
+int main(int, char **) {
+    initTest();
+
+    pageSize = sysconf(_SC_PAGESIZE);
+    struct rlimit limit;
+    if (geteuid() != 0 && getrlimit(RLIMIT_MEMLOCK, &limit) == 0 &&
+            limit.rlim_cur < 4 * pageSize) {
+        // blocks can not be locked, nothing is cached
+        return EXIT_SUCCESS;
+    }
+    eviction();
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,140 @@
+#include "../config.h"
+
+#include <assert.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <cstdio>
+#include <cstring>
+#include <string>
+
+#include "statistics.h"
+#include "latencyDumper.h"
+#include "common.h"
+
+static const int THREADS = 4;
+static const int CALLS = 10000;
+
+void *reader(void *) {
+    for (int i = 0; i < CALLS; ++i) {
+        Statistics::global.count(Statistics::READ, 10);
+    }
+    return NULL;
+}
+
+/**
+ * Counters updated from several threads are not lost
+ */
+void concurrentCount() {
+    pthread_t threads[THREADS];
+    for (int i = 0; i < THREADS; ++i) {
+        assert(pthread_create(&threads[i], NULL, reader, NULL) == 0);
+    }
+    for (int i = 0; i < THREADS; ++i) {
+        pthread_join(threads[i], NULL);
+    }
+    assert(Statistics::global.calls(Statistics::READ) == THREADS * CALLS);
+}
+
+/**
+ * Counters are printed as "name value" lines
+ */
+void print() {
+    Statistics::global.count(Statistics::LOOKUP);
+    Statistics::global.inflated(1000, 5000);
+    Statistics::global.dirtyChanged(2);
+    Statistics::global.dirtyChanged(-1);
+    Statistics::global.bufferAllocated(4096);
+
+    std::string out;
+    Statistics::global.print(out);
+    assert(out.find("op.lookup.calls 1\n") != std::string::npos);
+    assert(out.find("op.read.calls 40000\n") != std::string::npos);
+    assert(out.find("op.read.bytes 400000\n") != std::string::npos);
+    assert(out.find("op.write.bytes 0\n") != std::string::npos);
+    assert(out.find("inflate.bytes 1000\n") != std::string::npos);
+    assert(out.find("inflate.usec 5\n") != std::string::npos);
+    assert(out.find("nodes.dirty 1\n") != std::string::npos);
+    assert(out.find("buffer.bytes 4096\n") != std::string::npos);
+    // bytes are shown only for read and write
+    assert(out.find("op.lookup.bytes") == std::string::npos);
+}
+
+/**
+ * Latencies are counted in power-of-two buckets, percentiles are bucket
+ * bounds limited by the longest call
+ */
+void latency() {
+    Statistics st;
+    assert(st.percentile(Statistics::READ, 0.5) == 0);
+    for (int i = 0; i < 90; ++i) {
+        st.timed(Statistics::READ, 1000);
+    }
+    for (int i = 0; i < 10; ++i) {
+        st.timed(Statistics::READ, 100000);
+    }
+    assert(st.percentile(Statistics::READ, 0.5) == 1023);
+    assert(st.percentile(Statistics::READ, 0.9) == 1023);
+    assert(st.percentile(Statistics::READ, 0.99) == 100000);
+    assert(st.percentile(Statistics::WRITE, 0.5) == 0);
+
+    std::string out;
+    st.printLatency(out);
+    assert(out == "read     n=100 avg=10900 p50=1023 p90=1023 p99=100000"
+            " p999=100000 max=100000 ns\n");
+}
+
+/**
+ * Operations are timed only if timing is enabled, latencies are dumped
+ * to file
+ */
+void dump() {
+    {
+        OpTimer timer(Statistics::STATFS);
+    }
+    assert(Statistics::global.calls(Statistics::STATFS) == 1);
+    Statistics::global.setTiming(true);
+    {
+        OpTimer timer(Statistics::STATFS);
+        usleep(1000);
+    }
+    assert(Statistics::global.percentile(Statistics::STATFS, 1) >= 1000000);
+
+    char fileName[] = "/tmp/vmas-fs-latency-XXXXXX";
+    int fd = mkstemp(fileName);
+    assert(fd != -1);
+    close(fd);
+    LatencyDumper dumper;
+    dumper.setFileName(fileName);
+    assert(dumper.dump());
+
+    char buf[1024];
+    FILE *f = fopen(fileName, "r");
+    assert(f != NULL);
+    size_t len = fread(buf, 1, sizeof(buf) - 1, f);
+    fclose(f);
+    unlink(fileName);
+    buf[len] = '\0';
+    assert(strncmp(buf, "# latency in ns, timing enabled\n", 32) == 0);
+    assert(strstr(buf, "\nstatfs   n=1 ") != NULL);
+    // operations that were not timed are not shown
+    assert(strstr(buf, "lookup") == NULL);
+
+    // without file name latencies are written only to syslog
+    LatencyDumper syslogOnly;
+    assert(syslogOnly.dump());
+    snprintf(fileName, sizeof(fileName), "/tmp/vmas-fs-%d.latency",
+            (int)getpid());
+    assert(access(fileName, F_OK) != 0);
+}
+
+int main(int, char **) {
+    initTest();
+
+    concurrentCount();
+    print();
+    latency();
+    dump();
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,114 @@
+#include "../config.h"
+
+#include <assert.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <cstdio>
+#include <cstring>
+#include <string>
+
+// Public Morozoff design pattern :)
+#define private public
+
+#include "traceLog.h"
+#include "common.h"
+
+static const int THREADS = 4;
+// all events fit into one ring even if every thread reuses it
+static const int EVENTS = 500;
+
+void *recorder(void *log) {
+    for (int i = 0; i < EVENTS; ++i) {
+        ((TraceLog *)log)->complete("test", "event", 1000 * i + 1, 2500, 10);
+    }
+    return NULL;
+}
+
+/**
+ * Read trace file, remove it and count complete events in it
+ */
+int readTrace(const char *fileName, std::string &text) {
+    FILE *f = fopen(fileName, "r");
+    assert(f != NULL);
+    char buf[4096];
+    size_t nr;
+    while ((nr = fread(buf, 1, sizeof(buf), f)) > 0) {
+        text.append(buf, nr);
+    }
+    fclose(f);
+    unlink(fileName);
+    int count = 0;
+    for (size_t pos = 0; (pos = text.find("\"ph\":\"X\"", pos)) !=
+            std::string::npos; ++pos) {
+        ++count;
+    }
+    return count;
+}
+
+/**
+ * Events of several threads are written as JSON array
+ */
+void record() {
+    char fileName[] = "/tmp/vmas-fs-trace-XXXXXX";
+    close(mkstemp(fileName));
+    TraceLog log;
+    assert(!log.isEnabled());
+    assert(log.open(fileName));
+    assert(log.isEnabled());
+    log.start();
+    pthread_t threads[THREADS];
+    for (int i = 0; i < THREADS; ++i) {
+        assert(pthread_create(&threads[i], NULL, recorder, &log) == 0);
+    }
+    for (int i = 0; i < THREADS; ++i) {
+        pthread_join(threads[i], NULL);
+    }
+    // ring of exited thread is reused
+    recorder(&log);
+    log.stop();
+    assert(!log.isEnabled());
+    int rings = 0;
+    for (TraceLog::Ring *r = log.m_rings; r != NULL; r = r->next) {
+        ++rings;
+    }
+    assert(rings >= 1 && rings <= THREADS);
+
+    std::string text;
+    assert(readTrace(fileName, text) == (THREADS + 1) * EVENTS);
+    assert(text.compare(0, 2, "[\n") == 0);
+    assert(text.compare(text.size() - 4, 4, "}\n]\n") == 0);
+    assert(text.find("{\"name\":\"event\",\"cat\":\"test\",\"ph\":\"X\"") !=
+            std::string::npos);
+    assert(text.find("\"ts\":1.001,\"dur\":2.500,\"args\":{\"bytes\":10}},\n")
+            != std::string::npos);
+}
+
+/**
+ * Events are dropped if ring is full
+ */
+void overflow() {
+    char fileName[] = "/tmp/vmas-fs-trace-XXXXXX";
+    close(mkstemp(fileName));
+    TraceLog log;
+    assert(log.open(fileName));
+    // without flusher thread
+    for (unsigned int i = 0; i < TraceLog::RING_SIZE + 10; ++i) {
+        log.complete("test", "event", i, 1);
+    }
+    assert(log.m_dropped == 10);
+    log.stop();
+
+    std::string text;
+    assert(readTrace(fileName, text) == (int)TraceLog::RING_SIZE);
+    assert(text.find("args") == text.rfind("args"));
+}
+
+int main(int, char **) {
+    initTest();
+
+    record();
+    overflow();
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,210 @@
+#include "../config.h"
+
+#include <zip.h>
+#include <assert.h>
+#include <stdlib.h>
+#include <cstring>
+#include <cerrno>
+
+#include "zipStream.h"
+#include "common.h"
+
+// libzip stub structures
+struct zip {
+    zip_uint64_t size;
+    int opens;
+    bool fail_zip_fread;
+
+    zip(zip_uint64_t sz): size(sz), opens(0), fail_zip_fread(false) {}
+};
+struct zip_file {
+    struct zip *zip;
+    zip_uint64_t pos;
+};
+struct zip_source {};
+
+/**
+ * Byte of entry data at given offset
+ */
+static char dataAt(zip_uint64_t offset) {
+    return (char)(offset % 251);
+}
+
+// libzip stub functions
+
+struct zip_file *zip_fopen_index(struct zip *z, zip_uint64_t, zip_flags_t) {
+    ++z->opens;
+    struct zip_file *res = (struct zip_file *)malloc(sizeof(struct zip_file));
+    res->zip = z;
+    res->pos = 0;
+    return res;
+}
+
+zip_int64_t zip_fread(struct zip_file *zf, void *dest, zip_uint64_t size) {
+    if (zf->zip->fail_zip_fread) {
+        return -1;
+    }
+    // return data by small pieces like decompressor does
+    if (size > 1000) {
+        size = 1000;
+    }
+    if (size > zf->zip->size - zf->pos) {
+        size = zf->zip->size - zf->pos;
+    }
+    for (zip_uint64_t i = 0; i < size; ++i) {
+        ((char *)dest)[i] = dataAt(zf->pos++);
+    }
+    return size;
+}
+
+int zip_fclose(struct zip_file *zf) {
+    free(zf);
+    return 0;
+}
+
+const char *zip_strerror(struct zip *) {
+    return "error";
+}
+
+const char *zip_file_strerror(struct zip_file *) {
+    return "error";
+}
+
+// only stubs
+
+struct zip_file *zip_fopen_index_encrypted(struct zip *, zip_uint64_t, zip_flags_t, const char *) {
+    assert(false);
+    return NULL;
+}
+
+zip_int64_t zip_file_add(struct zip *, const char *, struct zip_source *, zip_flags_t) {
+    assert(false);
+    return 0;
+}
+
+int zip_file_replace(struct zip *, zip_uint64_t, struct zip_source *, zip_flags_t) {
+    assert(false);
+    return 0;
+}
+
+int zip_file_set_encryption(struct zip *, zip_uint64_t, zip_uint16_t, const char *) {
+    assert(false);
+    return 0;
+}
+
+int zip_delete(struct zip *, zip_uint64_t) {
+    assert(false);
+    return 0;
+}
+
+struct zip_source *zip_source_function(struct zip *, zip_source_callback, void *) {
+    assert(false);
+    return NULL;
+}
+
+void zip_source_free(struct zip_source *) {
+    assert(false);
+}
+
+const char *zip_get_name(struct zip *, zip_uint64_t, zip_flags_t) {
+    assert(false);
+    return NULL;
+}
+
+// test functions
+
+/**
+ * Check that buffer contains entry data from 'offset'
+ */
+void checkData(const char *buf, size_t size, zip_uint64_t offset) {
+    for (size_t i = 0; i < size; ++i) {
+        assert(buf[i] == dataAt(offset + i));
+    }
+}
+
+/**
+ * Sequential reads and reads forward are served from one decompression
+ * pass
+ */
+void forwardReads() {
+    struct zip z(100000);
+    ZipStream stream(&z, 0, false);
+    char buf[4096];
+    assert(stream.read(buf, sizeof(buf), 0) == sizeof(buf));
+    checkData(buf, sizeof(buf), 0);
+    assert(stream.read(buf, sizeof(buf), 4096) == sizeof(buf));
+    checkData(buf, sizeof(buf), 4096);
+    // skip a gap bigger than buffer
+    assert(stream.read(buf, 100, 50000) == 100);
+    checkData(buf, 100, 50000);
+    assert(stream.position() == 50100);
+    // tail of entry
+    assert(stream.read(buf, sizeof(buf), 99000) == 1000);
+    checkData(buf, 1000, 99000);
+    assert(z.opens == 1);
+}
+
+/**
+ * Read of recently decompressed data is served from window
+ */
+void windowRead() {
+    struct zip z(10000);
+    ZipStream stream(&z, 0, false);
+    char buf[100];
+    assert(stream.read(buf, sizeof(buf), 5000) == sizeof(buf));
+    assert(stream.read(buf, sizeof(buf), 10) == sizeof(buf));
+    checkData(buf, sizeof(buf), 10);
+    // partly in window, the rest is decompressed
+    assert(stream.read(buf, sizeof(buf), 5050) == sizeof(buf));
+    checkData(buf, sizeof(buf), 5050);
+    assert(stream.position() == 5150);
+    assert(z.opens == 1);
+    assert(stream.restarts() == 0);
+}
+
+/**
+ * Read before window restarts decompression, window wraps around
+ */
+void backwardRead() {
+    const zip_uint64_t size = 3 * ZipStream::WINDOW_SIZE;
+    struct zip z(size);
+    ZipStream stream(&z, 0, false);
+    char buf[4096];
+    assert(stream.read(buf, sizeof(buf), size - sizeof(buf)) == sizeof(buf));
+    assert(z.opens == 1);
+    // the oldest byte in window
+    zip_uint64_t first = size - ZipStream::WINDOW_SIZE;
+    assert(stream.read(buf, sizeof(buf), first) == sizeof(buf));
+    checkData(buf, sizeof(buf), first);
+    assert(z.opens == 1);
+    assert(stream.read(buf, sizeof(buf), first - 1) == sizeof(buf));
+    checkData(buf, sizeof(buf), first - 1);
+    assert(z.opens == 2);
+    assert(stream.restarts() == 1);
+}
+
+/**
+ * Stream is reopened after decompression error
+ */
+void readError() {
+    struct zip z(10000);
+    ZipStream stream(&z, 0, false);
+    char buf[100];
+    z.fail_zip_fread = true;
+    assert(stream.read(buf, sizeof(buf), 0) == -EIO);
+    z.fail_zip_fread = false;
+    assert(stream.read(buf, sizeof(buf), 200) == sizeof(buf));
+    checkData(buf, sizeof(buf), 200);
+    assert(z.opens == 2);
+}
+
+int main(int, char **) {
+    initTest();
+
+    forwardReads();
+    windowRead();
+    backwardRead();
+    readError();
+
+    return EXIT_SUCCESS;
+}